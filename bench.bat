@@ -0,0 +1,7 @@
+@echo off
+REM Runs every benchmark script under benchmarks\ using the interpreter at src\ribbon.exe.
+REM Build with build_release.bat first - timings of a dev build are dominated by memory diagnostics.
+
+for %%f in (benchmarks\*.rib) do (
+    src\ribbon.exe %%f
+)
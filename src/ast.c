@@ -221,13 +221,13 @@ static void print_node(AstNode* node, int nesting) {
             printf("FUNCTION\n");
             print_nesting_string(nesting);
 			printf("Parameters: ");
-			ValueArray parameters = nodeFunction->parameters;
+			AstParameterArray parameters = nodeFunction->parameters;
 			if (parameters.count == 0) {
 				printf("-- No parameters --");
 			} else {
 				for (int i = 0; i < parameters.count; i++) {
-					RawString parameter = parameters.values[i].as.raw_string;
-					printf("%.*s", parameter.length, parameter.data);
+					AstParameter parameter = parameters.values[i];
+					printf("%.*s", parameter.length, parameter.name);
 					if (i != parameters.count - 1) {
 						printf(", ");
 					}
@@ -555,7 +555,7 @@ static void node_free(AstNode* node, int nesting) {
         case AST_NODE_FUNCTION: {
             AstNodeFunction* nodeFunction = (AstNodeFunction*) node;
             node_free((AstNode*) nodeFunction->statements, nesting + 1);
-            value_array_free(&nodeFunction->parameters);
+            ast_parameter_array_free(&nodeFunction->parameters);
             deallocate(nodeFunction, sizeof(AstNodeFunction), deallocationString);
             break;
         }
@@ -757,7 +757,7 @@ AstNodeReturn* ast_new_node_return(AstNode* expression) {
 	return node;
 }
 
-AstNodeFunction* ast_new_node_function(AstNodeStatements* statements, ValueArray parameters) {
+AstNodeFunction* ast_new_node_function(AstNodeStatements* statements, AstParameterArray parameters) {
 	AstNodeFunction* node = ALLOCATE_AST_NODE(AstNodeFunction, AST_NODE_FUNCTION);
 	node->statements = statements;
 	node->parameters = parameters;
@@ -901,3 +901,5 @@ AstNodesKeyValuePair ast_new_key_value_pair(AstNode* key, AstNode* value) {
 }
 
 IMPLEMENT_DYNAMIC_ARRAY(AstNodesKeyValuePair, AstKeyValuePairArray, ast_key_value_pair_array)
+
+IMPLEMENT_DYNAMIC_ARRAY(AstParameter, AstParameterArray, ast_parameter_array)
@@ -119,10 +119,17 @@ typedef struct {
     PointerArray statements;
 } AstNodeStatements;
 
+typedef struct {
+    const char* name; // Points to source code - do not free!
+    int length;
+} AstParameter;
+
+DECLARE_DYNAMIC_ARRAY(AstParameter, AstParameterArray, ast_parameter_array)
+
 typedef struct {
     AstNode base;
     AstNodeStatements* statements;
-    ValueArray parameters;
+    AstParameterArray parameters;
 } AstNodeFunction;
 
 typedef struct {
@@ -236,7 +243,7 @@ AstNodeConstant* ast_new_node_number(double number);
 AstNodeExprStatement* ast_new_node_expr_statement(AstNode* expression);
 AstNodeReturn* ast_new_node_return(AstNode* expression);
 AstNodeCall* ast_new_node_call(AstNode* expression, PointerArray arguments);
-AstNodeFunction* ast_new_node_function(AstNodeStatements* statements, ValueArray parameters);
+AstNodeFunction* ast_new_node_function(AstNodeStatements* statements, AstParameterArray parameters);
 AstNodeIf* ast_new_node_if(AstNode* condition, AstNodeStatements* body, PointerArray elsif_clauses, AstNodeStatements* else_body);
 AstNodeFor* ast_new_node_for(const char* variable_name, int variable_length, AstNode* container, AstNodeStatements* body);
 AstNodeWhile* ast_new_node_while(AstNode* condition, AstNodeStatements* body);
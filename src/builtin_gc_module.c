@@ -0,0 +1,108 @@
+#include "builtin_gc_module.h"
+#include "common.h"
+#include "memory.h"
+#include "ribbon_object.h"
+#include "vm.h"
+#include "threads.h"
+
+/* Functions for the gc module, which lets a program tune the collector while it runs. Sizes are in bytes. */
+
+static bool value_as_whole_number(Value value, size_t* out) {
+    if (!VALUE_IS_NUMBER(value)) {
+        return false;
+    }
+
+    double number = VALUE_AS_NUMBER(value);
+    if (number < 0 || number >= (double) SIZE_MAX || number != (double) (size_t) number) {
+        return false;
+    }
+
+    *out = (size_t) number;
+    return true;
+}
+
+bool builtin_gc_collect(Object* self, ValueArray args, Value* out) {
+    vm_gc();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_gc_get_heap_size(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER((double) get_allocated_memory());
+    return true;
+}
+
+/* Bytes allocated from the heap since the start, whether freed since or not */
+bool builtin_gc_get_allocated_total(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER((double) memory_allocated_total);
+    return true;
+}
+
+bool builtin_gc_get_growth_factor(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER(vm.gc_growth_factor);
+    return true;
+}
+
+bool builtin_gc_set_growth_factor(Object* self, ValueArray args, Value* out) {
+    if (!VALUE_IS_NUMBER(args.values[0]) || !(VALUE_AS_NUMBER(args.values[0]) > 1)) {
+        return false;
+    }
+
+    vm.gc_growth_factor = VALUE_AS_NUMBER(args.values[0]);
+    vm_update_gc_threshold();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_gc_get_min_heap(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER((double) vm.gc_min_heap);
+    return true;
+}
+
+bool builtin_gc_set_min_heap(Object* self, ValueArray args, Value* out) {
+    if (!value_as_whole_number(args.values[0], &vm.gc_min_heap)) {
+        return false;
+    }
+
+    vm_update_gc_threshold();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_gc_get_soft_limit(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER((double) vm.gc_soft_limit);
+    return true;
+}
+
+/* 0 removes the limit */
+bool builtin_gc_set_soft_limit(Object* self, ValueArray args, Value* out) {
+    if (!value_as_whole_number(args.values[0], &vm.gc_soft_limit)) {
+        return false;
+    }
+
+    vm_update_gc_threshold();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_gc_get_threads(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER(vm.gc_threads);
+    return true;
+}
+
+bool builtin_gc_set_threads(Object* self, ValueArray args, Value* out) {
+    size_t threads;
+    if (!value_as_whole_number(args.values[0], &threads) || threads < 1 || threads > THREADS_MAX) {
+        return false;
+    }
+
+    vm.gc_threads = (int) threads;
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+/* Milliseconds spent marking in all full collections so far */
+bool builtin_gc_get_mark_time(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_NUMBER(vm.gc_stats.full_mark_total);
+    return true;
+}
@@ -0,0 +1,20 @@
+#ifndef ribbon_builtin_gc_module_h
+#define ribbon_builtin_gc_module_h
+
+#include "value.h"
+#include "ribbon_object.h"
+
+bool builtin_gc_collect(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_heap_size(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_allocated_total(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_growth_factor(Object* self, ValueArray args, Value* out);
+bool builtin_gc_set_growth_factor(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_min_heap(Object* self, ValueArray args, Value* out);
+bool builtin_gc_set_min_heap(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_soft_limit(Object* self, ValueArray args, Value* out);
+bool builtin_gc_set_soft_limit(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_threads(Object* self, ValueArray args, Value* out);
+bool builtin_gc_set_threads(Object* self, ValueArray args, Value* out);
+bool builtin_gc_get_mark_time(Object* self, ValueArray args, Value* out);
+
+#endif
@@ -7,7 +7,7 @@
 
 bool builtin_test_demo_print(Object* self, ValueArray args, Value* out) {
     assert(object_value_is(args.values[0], OBJECT_FUNCTION));
-    ObjectFunction* function = (ObjectFunction*) args.values[0].as.object;
+    ObjectFunction* function = (ObjectFunction*) VALUE_AS_OBJECT(args.values[0]);
 
     printf("I'm a native function\n");
 
@@ -27,7 +27,7 @@ bool builtin_test_call_callback_with_args(Object* self, ValueArray args, Value*
     assert(args.count == 3);
 
     assert(object_value_is(args.values[0], OBJECT_FUNCTION));
-    ObjectFunction* callback = (ObjectFunction*) args.values[0].as.object;
+    ObjectFunction* callback = (ObjectFunction*) VALUE_AS_OBJECT(args.values[0]);
 
     Value arg1 = args.values[1];
     Value arg2 = args.values[2];
@@ -58,13 +58,13 @@ bool builtin_test_get_value_directly_from_object_attributes(Object* self, ValueA
        a value directly from an object's attribute table. Used to test some internals of the system. */
 
     assert(args.count == 2);
-    assert(args.values[0].type == VALUE_OBJECT);
+    assert(VALUE_IS_OBJECT(args.values[0]));
     assert(object_value_is(args.values[1], OBJECT_STRING));
 
-    Object* object = args.values[0].as.object;
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
+    Object* object = VALUE_AS_OBJECT(args.values[0]);
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
-    if (!load_attribute_bypass_descriptors(object, attr_name, out) || is_value_instance_of_class(*out, "Descriptor")) {
+    if (!load_attribute_bypass_descriptors(object, attr_name, out) || object_is_descriptor(*out)) {
         /* Not super elegant, but fine for now. The tests are based on stdout reading anyway. They look for this when appropriate. */
         printf("Attribute not found\n"); 
         *out = MAKE_VALUE_NIL();
@@ -78,10 +78,10 @@ bool builtin_test_same_object(Object* self, ValueArray args, Value* out) {
     if (args.count != 2) {
         return false;
     }
-    if (args.values[0].type != VALUE_OBJECT || args.values[1].type != VALUE_OBJECT) {
+    if (!VALUE_IS_OBJECT(args.values[0]) || !VALUE_IS_OBJECT(args.values[1])) {
         return false;
     }
-    *out = MAKE_VALUE_BOOLEAN(args.values[0].as.object == args.values[1].as.object);
+    *out = MAKE_VALUE_BOOLEAN(VALUE_AS_OBJECT(args.values[0]) == VALUE_AS_OBJECT(args.values[1]));
     return true;
 }
 
@@ -89,10 +89,10 @@ bool builtin_test_get_object_address(Object* self, ValueArray args, Value* out)
     if (args.count != 1) {
         return false;
     }
-    if (args.values[0].type != VALUE_OBJECT) {
+    if (!VALUE_IS_OBJECT(args.values[0])) {
         return false;
     }
-    *out = MAKE_VALUE_NUMBER((uintptr_t) args.values[0].as.object);
+    *out = MAKE_VALUE_NUMBER((uintptr_t) VALUE_AS_OBJECT(args.values[0]));
     return true;
 }
 
@@ -103,12 +103,52 @@ bool builtin_test_gc(Object* self, ValueArray args, Value* out) {
     return true;
 }
 
+/* Same as builtin_test_gc, for a minor collection */
+bool builtin_test_minor_gc(Object* self, ValueArray args, Value* out) {
+    vm_minor_gc();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+/* Holds off collections while a test builds a structure too big to build under GC_STRESS_TEST */
+bool builtin_test_allow_gc(Object* self, ValueArray args, Value* out) {
+    if (!VALUE_IS_BOOLEAN(args.values[0])) {
+        return false;
+    }
+
+    vm.allow_gc = VALUE_AS_BOOLEAN(args.values[0]);
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+/* Lets a test overflow the stack without first growing it to the default depth */
+bool builtin_test_set_max_call_depth(Object* self, ValueArray args, Value* out) {
+    if (!VALUE_IS_NUMBER(args.values[0]) || VALUE_AS_NUMBER(args.values[0]) < 0) {
+        return false;
+    }
+
+    vm.max_call_depth = (size_t) VALUE_AS_NUMBER(args.values[0]);
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_test_start_incremental_gc(Object* self, ValueArray args, Value* out) {
+    vm_start_incremental_gc();
+    *out = MAKE_VALUE_NIL();
+    return true;
+}
+
+bool builtin_test_incremental_gc_in_progress(Object* self, ValueArray args, Value* out) {
+    *out = MAKE_VALUE_BOOLEAN(vm_incremental_gc_in_progress());
+    return true;
+}
+
 bool builtin_test_table_details(Object* self, ValueArray args, Value* out) {
     if (!object_value_is(args.values[0], OBJECT_TABLE)) {
         return false;
     }
 
-    Table table = ((ObjectTable*) args.values[0].as.object)->table;
+    Table table = ((ObjectTable*) VALUE_AS_OBJECT(args.values[0]))->table;
 
     Table result = table_new_empty();
     table_set(&result, MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated("num_entries")),
@@ -129,7 +169,7 @@ bool builtin_test_table_delete(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectTable* table = (ObjectTable*) args.values[0].as.object;
+    ObjectTable* table = (ObjectTable*) VALUE_AS_OBJECT(args.values[0]);
     Value key = args.values[1];
 
     table_delete(&table->table, key);
@@ -10,6 +10,11 @@ bool builtin_test_get_value_directly_from_object_attributes(Object* self, ValueA
 bool builtin_test_same_object(Object* self, ValueArray args, Value* out);
 bool builtin_test_get_object_address(Object* self, ValueArray args, Value* out);
 bool builtin_test_gc(Object* self, ValueArray args, Value* out);
+bool builtin_test_minor_gc(Object* self, ValueArray args, Value* out);
+bool builtin_test_allow_gc(Object* self, ValueArray args, Value* out);
+bool builtin_test_set_max_call_depth(Object* self, ValueArray args, Value* out);
+bool builtin_test_start_incremental_gc(Object* self, ValueArray args, Value* out);
+bool builtin_test_incremental_gc_in_progress(Object* self, ValueArray args, Value* out);
 bool builtin_test_table_details(Object* self, ValueArray args, Value* out);
 bool builtin_test_table_delete(Object* self, ValueArray args, Value* out);
 
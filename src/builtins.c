@@ -41,7 +41,7 @@ bool builtin_input(Object* self, ValueArray args, Value* out) {
 
 	user_input[length] = '\0';
 	user_input = reallocate(user_input, sizeof(char) * capacity, sizeof(char) * length + 1, alloc_string);
-	ObjectString* obj_string = object_string_take(user_input, length);
+	ObjectString* obj_string = object_string_take_uninterned(user_input, length);
 
 	*out = MAKE_VALUE_OBJECT(obj_string);
 	return true;
@@ -52,7 +52,7 @@ bool builtin_read_text_file(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectString* path = OBJECT_AS_STRING(args.values[0].as.object);
+	ObjectString* path = OBJECT_AS_STRING(VALUE_AS_OBJECT(args.values[0]));
 
 	char* file_data = NULL;
 	size_t file_size = 0;
@@ -62,7 +62,7 @@ bool builtin_read_text_file(Object* self, ValueArray args, Value* out) {
 
 	switch (result) {
 		case IO_SUCCESS: {
-			*out = MAKE_VALUE_OBJECT(object_string_take(file_data, file_size - 1)); // file_size already includes the null byte, so we decrement it
+			*out = MAKE_VALUE_OBJECT(object_string_take_uninterned(file_data, file_size - 1)); // file_size already includes the null byte, so we decrement it
 			return true;
 		}
 		case IO_OPEN_FILE_FAILURE: {
@@ -96,7 +96,7 @@ bool builtin_read_binary_file(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectString* path = OBJECT_AS_STRING(args.values[0].as.object);
+	ObjectString* path = OBJECT_AS_STRING(VALUE_AS_OBJECT(args.values[0]));
 
 	Table file_data;
 	IOResult result = io_read_binary_file(path->chars, &file_data);
@@ -142,8 +142,8 @@ bool builtin_write_text_file(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectString* file_name = (ObjectString*) args.values[0].as.object;
-	ObjectString* text = (ObjectString*) args.values[1].as.object;
+	ObjectString* file_name = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
+	ObjectString* text = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
 	char* file_name_bounded = copy_cstring(file_name->chars, file_name->length, "File name bounded");
 	char* text_bounded = copy_cstring(text->chars, text->length, "File text bounded");
@@ -170,8 +170,8 @@ bool builtin_write_binary_file(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectString* file_name = (ObjectString*) args.values[0].as.object;
-	ObjectTable* data = (ObjectTable*) args.values[1].as.object;
+	ObjectString* file_name = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
+	ObjectTable* data = (ObjectTable*) VALUE_AS_OBJECT(args.values[1]);
 
 	char* file_name_bounded = copy_cstring(file_name->chars, file_name->length, "File name bounded");
 
@@ -193,7 +193,7 @@ bool builtin_file_exists(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectString* file_name = (ObjectString*) args.values[0].as.object;
+	ObjectString* file_name = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
 	char* file_name_bounded = copy_cstring(file_name->chars, file_name->length, "File name bounded");
 	bool exists = io_file_exists(file_name_bounded);
 	deallocate(file_name_bounded, strlen(file_name_bounded) + 1, "File name bounded");
@@ -210,7 +210,7 @@ bool builtin_delete_file(Object* self, ValueArray args, Value* out) {
 
 	bool success = true;
 
-	ObjectString* file_name = (ObjectString*) args.values[0].as.object;
+	ObjectString* file_name = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
 	char* file_name_bounded = copy_cstring(file_name->chars, file_name->length, "File name bounded");
 	if (io_delete_file(file_name_bounded) != IO_SUCCESS) {
 		success = false;
@@ -236,7 +236,7 @@ bool builtin_to_number(Object* self, ValueArray args, Value* out) {
 	double number;
 
 	if (object_value_is(arg, OBJECT_STRING)) {
-		ObjectString* string = (ObjectString*) arg.as.object;
+		ObjectString* string = (ObjectString*) VALUE_AS_OBJECT(arg);
 		char* file_name_bounded = copy_cstring(string->chars, string->length, "File name bounded");
 		if (sscanf(file_name_bounded, "%lf", &number) == EOF) {
 			success = false;
@@ -256,8 +256,8 @@ bool builtin_to_string(Object* self, ValueArray args, Value* out) {
 	char* buffer = NULL;
 
 	Value arg = args.values[0];
-	if (arg.type == VALUE_NUMBER) {
-		double number = arg.as.number;
+	if (VALUE_IS_NUMBER(arg)) {
+		double number = VALUE_AS_NUMBER(arg);
 		size_t string_length = snprintf(NULL, 0, "%g", number);
 		buffer = allocate(string_length + 1, "to_string buffer");
 		int ret = snprintf(buffer, string_length + 1, "%g", number);
@@ -266,17 +266,17 @@ bool builtin_to_string(Object* self, ValueArray args, Value* out) {
 		success = false;
 	}
 
-	*out = success ? MAKE_VALUE_OBJECT(object_string_take(buffer, strlen(buffer))) : MAKE_VALUE_NIL();
+	*out = success ? MAKE_VALUE_OBJECT(object_string_take_uninterned(buffer, strlen(buffer))) : MAKE_VALUE_NIL();
 	return success;
 }
 
 bool builtin_has_attr(Object* self, ValueArray args, Value* out) {
-	if (args.count != 2 || !(args.values[0].type == VALUE_OBJECT && object_value_is(args.values[1], OBJECT_STRING))) {
+	if (args.count != 2 || !(VALUE_IS_OBJECT(args.values[0]) && object_value_is(args.values[1], OBJECT_STRING))) {
 		return false;
 	}
 
-	Object* object = args.values[0].as.object;
-	ObjectString* attr = (ObjectString*) args.values[1].as.object;
+	Object* object = VALUE_AS_OBJECT(args.values[0]);
+	ObjectString* attr = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 	Value throwaway;
 	*out = MAKE_VALUE_BOOLEAN(object_load_attribute(object, attr, &throwaway));
 	return true;
@@ -308,9 +308,9 @@ bool builtin_is_instance(Object* self, ValueArray args, Value* out) {
 	}
 
 	Value value = args.values[0];
-	ObjectString* type_name = (ObjectString*) args.values[1].as.object;
+	ObjectString* type_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
-	if (value.type == VALUE_OBJECT && is_instance_of_class(value.as.object, type_name->chars)) {
+	if (VALUE_IS_OBJECT(value) && is_instance_of_class(VALUE_AS_OBJECT(value), type_name->chars)) {
 		*out = MAKE_VALUE_BOOLEAN(true);
 		return true;
 	}
@@ -329,7 +329,7 @@ bool builtin_super(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectTable* args_table = (ObjectTable*) args.values[0].as.object;
+	ObjectTable* args_table = (ObjectTable*) VALUE_AS_OBJECT(args.values[0]);
 
 	StackFrame* current_frame = vm_peek_previous_frame();
 	if (current_frame->is_native) {
@@ -338,23 +338,23 @@ bool builtin_super(Object* self, ValueArray args, Value* out) {
 	}
 
 	Value object_val;
-	if (!cell_table_get_value_cstring_key(&current_frame->local_variables, "self", &object_val)) {
+	if (!vm_get_frame_self(current_frame, &object_val)) {
 		return false;
 	}
 
 	assert(object_value_is(object_val, OBJECT_INSTANCE));
 
-	ObjectInstance* object = (ObjectInstance*) object_val.as.object;
+	ObjectInstance* object = (ObjectInstance*) VALUE_AS_OBJECT(object_val);
 
-	const char* function_name = current_frame->function->name;
+	ObjectString* function_name = current_frame->function->name;
 
 	ObjectClass* superclass = object->klass->superclass;
-	if (superclass == NULL) {
+	if (superclass == NULL || function_name == NULL) {
 		return false;
 	}
 
 	Value superclass_function_val;
-	if (!object_load_attribute_cstring_key((Object*) superclass, function_name, &superclass_function_val)) {
+	if (!object_load_attribute((Object*) superclass, function_name, &superclass_function_val)) {
 		return false;
 	}
 
@@ -362,7 +362,7 @@ bool builtin_super(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	ObjectFunction* superclass_function = (ObjectFunction*) superclass_function_val.as.object;
+	ObjectFunction* superclass_function = (ObjectFunction*) VALUE_AS_OBJECT(superclass_function_val);
 
 	ObjectBoundMethod* bound_method = object_bound_method_new(superclass_function, (Object*) object);
 
@@ -370,20 +370,20 @@ bool builtin_super(Object* self, ValueArray args, Value* out) {
 
 	ValueArray length_args = value_array_make(0, NULL);
 	Value length_val;
-	if (vm_call_attribute_cstring((Object*) args_table, "length", length_args, &length_val) != CALL_RESULT_SUCCESS) {
+	if (vm_call_attribute((Object*) args_table, vm.symbols.length, length_args, &length_val) != CALL_RESULT_SUCCESS) {
 		success = false;
 		goto cleanup;
 	}
 
-	assert(length_val.type == VALUE_NUMBER);
+	assert(VALUE_IS_NUMBER(length_val));
 
 	ValueArray args_for_super_function;
 	value_array_init(&args_for_super_function);
 
-	for (int i = 0; i < length_val.as.number; i++) {
+	for (int i = 0; i < VALUE_AS_NUMBER(length_val); i++) {
 		ValueArray get_key_args = value_array_make(1, (Value[]) {MAKE_VALUE_NUMBER(i)});
 		Value arg;
-		if (vm_call_attribute_cstring((Object*) args_table, "@get_key", get_key_args, &arg) != CALL_RESULT_SUCCESS) {
+		if (vm_call_attribute((Object*) args_table, vm.symbols.get_key, get_key_args, &arg) != CALL_RESULT_SUCCESS) {
 			success = false;
 		}
 		value_array_free(&get_key_args);
@@ -410,7 +410,7 @@ bool builtin_sin(Object* self, ValueArray args, Value* out) {
 		return false;
 	}
 
-	const double input = args.values[0].as.number;
+	const double input = VALUE_AS_NUMBER(args.values[0]);
 	*out = MAKE_VALUE_NUMBER(sin(input));
 	return true;
 }
\ No newline at end of file
@@ -8,8 +8,16 @@ void bytecode_init(Bytecode* chunk) {
     chunk->count = 0;
     chunk->code = NULL;
     value_array_init(&chunk->constants);
-    integer_array_init(&chunk->referenced_names_indices);
+    upvalue_array_init(&chunk->upvalues);
     integer_array_init(&chunk->assigned_names_indices);
+    integer_array_init(&chunk->local_names_indices);
+    chunk->self_slot = -1;
+    chunk->attribute_caches = NULL;
+    chunk->attribute_caches_count = 0;
+    chunk->attribute_caches_capacity = 0;
+    chunk->global_caches = NULL;
+    chunk->global_caches_count = 0;
+    chunk->global_caches_capacity = 0;
 }
 
 void bytecode_write(Bytecode* chunk, uint8_t byte) {
@@ -31,8 +39,11 @@ void bytecode_set(Bytecode* chunk, int position, uint8_t byte) {
 void bytecode_free(Bytecode* chunk) {
     deallocate(chunk->code, chunk->capacity * sizeof(uint8_t), "Chunk code buffer"); // the sizeof is probably stupid
     value_array_free(&chunk->constants);
-    integer_array_free(&chunk->referenced_names_indices);
+    upvalue_array_free(&chunk->upvalues);
     integer_array_free(&chunk->assigned_names_indices);
+    integer_array_free(&chunk->local_names_indices);
+    deallocate(chunk->attribute_caches, chunk->attribute_caches_capacity * sizeof(AttributeCache), "Attribute caches");
+    deallocate(chunk->global_caches, chunk->global_caches_capacity * sizeof(GlobalCache), "Global caches");
     bytecode_init(chunk);
 }
 
@@ -45,13 +56,57 @@ int bytecode_add_constant(Bytecode* chunk, struct Value* constant) {
     return chunk->constants.count - 1;
 }
 
+int bytecode_add_attribute_cache(Bytecode* chunk) {
+    if (chunk->attribute_caches_count >= 65534) {
+        FAIL("Too many attribute accesses in one code object (>= 65534). Cannot fit the cache index into a short in the bytecode.");
+    }
+
+    if (chunk->attribute_caches_count == chunk->attribute_caches_capacity) {
+        int old_capacity = chunk->attribute_caches_capacity;
+        chunk->attribute_caches_capacity = GROW_CAPACITY(old_capacity);
+        chunk->attribute_caches = reallocate(
+            chunk->attribute_caches, old_capacity * sizeof(AttributeCache),
+            chunk->attribute_caches_capacity * sizeof(AttributeCache), "Attribute caches");
+    }
+
+    AttributeCache* cache = &chunk->attribute_caches[chunk->attribute_caches_count];
+    cache->epoch = 0; /* Never a valid epoch, so the cache starts out empty */
+    cache->count = 0;
+    cache->next_replaced = 0;
+
+    return chunk->attribute_caches_count++;
+}
+
+int bytecode_add_global_cache(Bytecode* chunk) {
+    if (chunk->global_caches_count >= 65534) {
+        FAIL("Too many global variable accesses in one code object (>= 65534). Cannot fit the cache index into a short in the bytecode.");
+    }
+
+    if (chunk->global_caches_count == chunk->global_caches_capacity) {
+        int old_capacity = chunk->global_caches_capacity;
+        chunk->global_caches_capacity = GROW_CAPACITY(old_capacity);
+        chunk->global_caches = reallocate(
+            chunk->global_caches, old_capacity * sizeof(GlobalCache),
+            chunk->global_caches_capacity * sizeof(GlobalCache), "Global caches");
+    }
+
+    GlobalCache* cache = &chunk->global_caches[chunk->global_caches_count];
+    cache->epoch = 0; /* Never a valid epoch, so the cache starts out empty */
+    cache->module_cell = NULL;
+    cache->builtin_cell = NULL;
+
+    return chunk->global_caches_count++;
+}
+
+IMPLEMENT_DYNAMIC_ARRAY(Upvalue, UpvalueArray, upvalue_array)
+
 void bytecode_print_constant_table(Bytecode* chunk) { // For debugging
 	printf("\nConstant table [size %d] of chunk pointing at '%p':\n", chunk->constants.count, chunk->code);
 	for (int i = 0; i < chunk->constants.count; i++) {
 		Value constant = chunk->constants.values[i];
 		printf("%d: ", i);
 		value_print(constant);
-		printf(" [ type %d ]", constant.type);
+		printf(" [ type %d ]", VALUE_TYPE(constant));
 		printf("\n");
 	}
 }
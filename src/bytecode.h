@@ -18,13 +18,23 @@ typedef enum {
     OP_GREATER_EQUAL,
     OP_LESS_EQUAL,
     OP_EQUAL,
+    OP_NOT_EQUAL,
     OP_ACCESS_KEY,
     OP_SET_KEY,
     OP_LOAD_VARIABLE,
     OP_SET_VARIABLE,
+    OP_LOAD_LOCAL,
+    OP_LOAD_UPVALUE,
+    OP_SET_LOCAL,
+    OP_LOAD_GLOBAL,
+    OP_STORE_GLOBAL,
+    OP_ADD_CONSTANT_TO_LOCAL,
+    OP_ADD_CONSTANT_TO_GLOBAL,
+    OP_CAPTURE_PARAMETER,
     OP_DECLARE_EXTERNAL,
 	OP_MAKE_TABLE,
     OP_CALL,
+    OP_INVOKE,
 	OP_GET_ATTRIBUTE,
 	OP_SET_ATTRIBUTE,
 	OP_POP,
@@ -36,6 +46,14 @@ typedef enum {
     OP_SET_OFFSET_FROM_TOP,
 	OP_JUMP_IF_FALSE,
 	OP_JUMP_IF_TRUE,
+	OP_JUMP_IF_FALSE_OR_POP,
+	OP_JUMP_IF_TRUE_OR_POP,
+	OP_JUMP_IF_NOT_LESS,
+	OP_JUMP_IF_NOT_GREATER,
+	OP_JUMP_IF_NOT_LESS_EQUAL,
+	OP_JUMP_IF_NOT_GREATER_EQUAL,
+	OP_JUMP_IF_NOT_EQUAL,
+	OP_JUMP_IF_EQUAL,
 	OP_JUMP_FORWARD,
 	OP_JUMP_BACKWARD,
 	OP_MAKE_STRING,
@@ -46,13 +64,68 @@ typedef enum {
     OP_RETURN
 } OP_CODE;
 
+#define OPCODE_COUNT (OP_RETURN + 1) /* OP_RETURN has to stay last */
+
+struct ObjectClass;
+struct ObjectCell;
+struct Shape;
+
+#define ATTRIBUTE_CACHE_SIZE 4
+
+/* What an attribute access site learned about instances of one shape, or of one class for instances in dictionary mode */
+typedef struct {
+    struct ObjectClass* klass;
+    struct Shape* shape; /* NULL for instances in dictionary mode */
+    int field_index; /* Index of the attribute in the fields of the shape, or -1 if the shape has no such field */
+    struct ObjectCell* class_cell; /* Where the class or a superclass defines the attribute, or NULL if none does */
+    struct Shape* transition; /* Shape after adding the attribute as a field, filled in by the first set which does that */
+} AttributeCacheEntry;
+
+/* Inline cache of one OP_GET_ATTRIBUTE or OP_SET_ATTRIBUTE site. Holds an entry for each receiver shape seen there,
+   up to ATTRIBUTE_CACHE_SIZE of them, after which entries are replaced in turn.
+   The entries are only valid for the epoch they were filled in - see object_invalidate_attribute_caches(). */
+typedef struct {
+    unsigned int epoch;
+    uint8_t count;
+    uint8_t next_replaced;
+    AttributeCacheEntry entries[ATTRIBUTE_CACHE_SIZE];
+} AttributeCache;
+
+/* Inline cache of one OP_LOAD_GLOBAL or OP_STORE_GLOBAL site: the cells the name is bound to in the module and in the builtins.
+   Cells are looked at on every access, as a binding can be created empty and filled later.
+   The cache is only valid for the epoch it was filled in - see cell_table_globals_epoch. */
+typedef struct {
+    unsigned int epoch;
+    struct ObjectCell* module_cell; /* NULL if the module has no binding by that name */
+    struct ObjectCell* builtin_cell; /* NULL if there's no builtin by that name */
+} GlobalCache;
+
+/* A variable of an enclosing scope which a function or class body may refer to, resolved when the enclosing scope is compiled.
+   A created function gets the cell of each of its upvalues from the creating frame - see OP_MAKE_FUNCTION. */
+typedef struct {
+    int name_index; /* Constant index of the name */
+    bool in_enclosing_locals; /* The name may be in the locals table of the creating frame, which takes precedence */
+    bool assigned_in_enclosing; /* If the name isn't there yet, the creating frame makes the cell it's going to assign */
+    int enclosing_index; /* Otherwise the upvalue of the creating function to share, or -1 if it has none by the name */
+} Upvalue;
+
+DECLARE_DYNAMIC_ARRAY(Upvalue, UpvalueArray, upvalue_array)
+
 typedef struct {
     uint8_t* code;
     ValueArray constants;
     int capacity;
     int count;
-    IntegerArray referenced_names_indices;
+    UpvalueArray upvalues;
     IntegerArray assigned_names_indices;
+    IntegerArray local_names_indices; /* Constant index of the name of each local slot. Parameters take the first slots. */
+    int self_slot; /* The local slot self is bound to when called as a method, or -1 */
+    AttributeCache* attribute_caches;
+    int attribute_caches_count;
+    int attribute_caches_capacity;
+    GlobalCache* global_caches;
+    int global_caches_count;
+    int global_caches_capacity;
 } Bytecode;
 
 void bytecode_init(Bytecode* chunk);
@@ -60,6 +133,8 @@ void bytecode_write(Bytecode* chunk, uint8_t byte);
 void bytecode_set(Bytecode* chunk, int position, uint8_t byte);
 void bytecode_free(Bytecode* chunk);
 int bytecode_add_constant(Bytecode* chunk, struct Value* constant);
+int bytecode_add_attribute_cache(Bytecode* chunk);
+int bytecode_add_global_cache(Bytecode* chunk);
 
 void bytecode_print_constant_table(Bytecode* chunk); // For debugging
 
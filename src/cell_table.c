@@ -1,14 +1,37 @@
 #include "cell_table.h"
 #include "table.h"
 #include "ribbon_object.h"
+#include "heap.h"
+
+unsigned int cell_table_globals_epoch = 1;
 
 void cell_table_init(CellTable* table) {
 	table_init(&table->table);
+	table->holds_globals = false;
+	table->owner = NULL;
+}
+
+/* A cell may be older than the table holding it, since closures share the cells of their enclosing function */
+static void write_barrier(CellTable* table, ObjectString* key, ObjectCell* cell) {
+	if (table->owner != NULL) {
+		heap_write_barrier(table->owner, MAKE_VALUE_OBJECT(key));
+		heap_write_barrier(table->owner, MAKE_VALUE_OBJECT(cell));
+	}
 }
 
 void cell_table_set_value(CellTable* table, ObjectString* key, Value value) {
+	size_t entries_before = table->table.num_entries;
+
 	/* Using special case route in table.c for optimization */
-	table_set_value_in_cell(&table->table, MAKE_VALUE_OBJECT(key), value);
+	ObjectCell* cell = table_set_value_in_cell(&table->table, MAKE_VALUE_OBJECT(key), value);
+	heap_write_barrier((Object*) cell, value);
+
+	if (table->table.num_entries != entries_before) {
+		write_barrier(table, key, cell);
+		if (table->holds_globals) {
+			cell_table_globals_epoch++;
+		}
+	}
 }
 
 bool cell_table_get_value(CellTable* table, struct ObjectString* key, Value* out) {
@@ -34,7 +57,7 @@ bool cell_table_get_cell(CellTable* table, struct ObjectString* key, struct Obje
 	Value current;
 	if (table_get(inner_table, MAKE_VALUE_OBJECT(key), &current)) {
 		assert(object_value_is(current, OBJECT_CELL));
-		*out = (ObjectCell*) current.as.object;;
+		*out = (ObjectCell*) VALUE_AS_OBJECT(current);;
 		return true;
 	}
 
@@ -43,6 +66,11 @@ bool cell_table_get_cell(CellTable* table, struct ObjectString* key, struct Obje
 
 void cell_table_set_cell(CellTable* table, struct ObjectString* key, struct ObjectCell* cell) {
 	table_set(&table->table, MAKE_VALUE_OBJECT(key), MAKE_VALUE_OBJECT(cell));
+	write_barrier(table, key, cell);
+
+	if (table->holds_globals) {
+		cell_table_globals_epoch++;
+	}
 }
 
 bool cell_table_get_cell_cstring_key(CellTable* table, const char* key, struct ObjectCell** out) {
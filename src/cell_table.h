@@ -6,8 +6,14 @@
 
 typedef struct {
 	Table table;
+	bool holds_globals; /* The attributes of a module, or the builtins */
+	struct Object* owner; /* The object whose attributes or free variables these are, for the write barrier. NULL for the tables of the VM and of stack frames */
 } CellTable;
 
+/* Bumped whenever a binding is created or replaced in a table which holds globals,
+   which invalidates the caches of all global variable access sites at once */
+extern unsigned int cell_table_globals_epoch;
+
 struct ObjectCell;
 struct ObjectString;
 
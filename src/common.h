@@ -21,6 +21,7 @@
 #define DEBUG_SCANNER 0 // Show low level lexing output and such
 #define DEBUG_PAUSE_AFTER_OPCODES 0 // Wait for user input after each opcode
 #define DEBUG_TABLE_STATS 0 // Collect statistics on general hash table behavior
+#define DEBUG_OPCODE_PAIRS 0 // Count which opcodes run right after which, to find candidates for superinstructions
 
 /* ****************** */
 
@@ -49,6 +50,72 @@
 
 /* **************** */
 
+/* Whether the old generation is collected incrementally by default, and how long each step aims to take, in milliseconds.
+   Both can be changed from the command line. */
+#ifndef GC_INCREMENTAL
+    #define GC_INCREMENTAL 0
+#endif
+
+#ifndef GC_DEFAULT_PAUSE_TARGET
+    #define GC_DEFAULT_PAUSE_TARGET 1.0
+#endif
+
+/* A full collection runs once the allocated memory grows to GC_DEFAULT_GROWTH_FACTOR times what the last one left,
+   but not before it reaches GC_DEFAULT_MIN_HEAP bytes. Past GC_DEFAULT_SOFT_LIMIT bytes the collector stops the world
+   to bring the memory down, 0 meaning no limit. All three can be changed from the command line, the environment
+   and the gc module. */
+#ifndef GC_DEFAULT_GROWTH_FACTOR
+    #define GC_DEFAULT_GROWTH_FACTOR 2.0
+#endif
+
+#ifndef GC_DEFAULT_MIN_HEAP
+    #define GC_DEFAULT_MIN_HEAP (4 * 1024 * 1024)
+#endif
+
+#ifndef GC_DEFAULT_SOFT_LIMIT
+    #define GC_DEFAULT_SOFT_LIMIT 0
+#endif
+
+/* Threads which mark and sweep in full collections, which can be changed the same way */
+#ifndef GC_DEFAULT_THREADS
+    #define GC_DEFAULT_THREADS 1
+#endif
+
+/* **************** */
+
+/* Frames the call stack may grow to before a call fails with a stack overflow, 0 meaning it's only limited by memory.
+   Can be changed from the command line and the environment. The stacks themselves grow on demand, so this only exists to
+   stop runaway recursion early: at about 150 bytes a frame, the default is some 30 MB of frames - far deeper than
+   recursive walks over large structures go, while infinite recursion still fails within a fraction of a second. */
+#ifndef DEFAULT_MAX_CALL_DEPTH
+    #define DEFAULT_MAX_CALL_DEPTH 200000
+#endif
+
+/* **************** */
+
+/* Dispatch the interpreter loop through a table of label addresses (GCC / Clang "labels as values").
+   Set to 0 to fall back to a portable switch statement. */
+#ifndef VM_COMPUTED_GOTO
+    #if defined(__GNUC__) || defined(__clang__)
+        #define VM_COMPUTED_GOTO 1
+    #else
+        #define VM_COMPUTED_GOTO 0
+    #endif
+#endif
+
+/* **************** */
+
+/* Probe the control bytes of hash tables 16 at a time with SSE2 instructions. Set to 0 to fall back to plain loops. */
+#ifndef TABLE_USE_SSE2
+    #if defined(__SSE2__) || defined(_M_X64)
+        #define TABLE_USE_SSE2 1
+    #else
+        #define TABLE_USE_SSE2 0
+    #endif
+#endif
+
+/* **************** */
+
 #if DEBUG
     #define DEBUG_PRINT(...) do { \
             fprintf(stdout, "DEBUG: "); \
@@ -41,6 +41,18 @@ static void emit_opcode_with_constant_operand(Bytecode* chunk, OP_CODE instructi
 	emit_constant_operand(chunk, constant);
 }
 
+/* Attribute accesses take the name's constant index, followed by the index of the inline cache of the site */
+static void emit_attribute_access(Bytecode* chunk, OP_CODE opcode, uint16_t name_constant_index) {
+	emit_byte_with_short_operand(chunk, opcode, name_constant_index);
+	emit_short_as_two_bytes(chunk, bytecode_add_attribute_cache(chunk));
+}
+
+/* Global variable accesses take the name's constant index, followed by the index of the cache of the site */
+static void emit_global_access(Bytecode* chunk, OP_CODE opcode, uint16_t name_constant_index) {
+	emit_byte_with_short_operand(chunk, opcode, name_constant_index);
+	emit_short_as_two_bytes(chunk, bytecode_add_global_cache(chunk));
+}
+
 static size_t emit_opcode_with_short_placeholder(Bytecode* chunk, OP_CODE opcode) {
 	emit_byte(chunk, opcode);
 	size_t placeholder_offset = chunk->count;
@@ -65,6 +77,8 @@ static void backpatch_placeholder_with_current_address(Bytecode* chunk, size_t p
 	backpatch_placeholder(chunk, placeholder_offset, delta);
 }
 
+static void compile_tree(AstNode* node, Bytecode* bytecode);
+
 static void emit_binary_opcode_for_in_place_operator(Bytecode* bytecode, ScannerTokenType operator) {
 	switch(operator) {
 		case TOKEN_PLUS_EQUALS: emit_byte(bytecode, OP_ADD); break;
@@ -76,6 +90,575 @@ static void emit_binary_opcode_for_in_place_operator(Bytecode* bytecode, Scanner
 	}
 }
 
+/* Local slots
+
+   Inside a function body, every variable which is assigned in the function (parameters and loop variables included),
+   and which no nested function or class refers to (other than through a parameter of its own, which always shadows it), is held in a numbered slot of the frame on the eval stack,
+   rather than in a cell in the frame's locals table. Those are accessed with OP_LOAD_LOCAL / OP_SET_LOCAL.
+
+   Names which must stay in the locals table are resolved by name at runtime like before: names captured by nested functions
+   and classes (they need a shared cell), names declared external, and names of imported modules.
+   Module and class bodies have no slots - their variables are attributes of the module or class.
+
+   Global variables
+
+   A name which no enclosing function or class body binds can only refer to a variable of the module, or to a builtin.
+   Those are accessed with OP_LOAD_GLOBAL / OP_STORE_GLOBAL, which cache the cells of the name at each site,
+   and nested functions don't capture them. Class bodies keep resolving their own names by name,
+   because those may also be inherited attributes. */
+
+typedef struct FunctionScope {
+	struct FunctionScope* enclosing; /* NULL in the scope of a function or class nested directly in the module body */
+	bool is_class_body;
+	AstParameterArray* parameters; /* NULL for a class body */
+	ValueArray slot_names; /* ObjectString name of the variable held in each slot, nil for slots which can't be accessed by name */
+	ValueArray bound_names; /* Every name assigned, imported, declared external or taken as a parameter in the scope itself */
+} FunctionScope;
+
+static FunctionScope* current_function_scope = NULL;
+
+typedef struct {
+	ValueArray local_names; /* Assigned in the function itself, in order of appearance */
+	ValueArray cell_names; /* Have to stay in the locals table */
+	ValueArray bound_names; /* Assigned, imported or declared external in the function itself */
+} ScopeNames;
+
+static bool names_contain(ValueArray* names, ObjectString* name) {
+	for (int i = 0; i < names->count; i++) {
+		Value existing = names->values[i];
+		if (VALUE_IS_OBJECT(existing) && object_strings_equal((ObjectString*) VALUE_AS_OBJECT(existing), name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void add_name(ValueArray* names, const char* chars, int length) {
+	ObjectString* name = object_string_copy(chars, length);
+	if (!names_contain(names, name)) {
+		Value name_value = MAKE_VALUE_OBJECT(name);
+		value_array_write(names, &name_value);
+	}
+}
+
+static bool is_shadowed(ValueArray* shadowed, const char* name, int length) {
+	for (int i = 0; shadowed != NULL && i < shadowed->count; i++) {
+		ObjectString* shadowing_name = (ObjectString*) VALUE_AS_OBJECT(shadowed->values[i]);
+		if (cstrings_equal(shadowing_name->chars, shadowing_name->length, name, length)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Names referenced by nested functions and classes go to cell_names, because the nested code may capture them.
+   shadowed holds the parameters of the nested functions walked through - references to those can't escape to this scope. */
+static void collect_scope_names(AstNode* node, ScopeNames* names, bool nested, ValueArray* shadowed) {
+	if (node == NULL) {
+		return;
+	}
+
+	switch (node->type) {
+		case AST_NODE_CONSTANT:
+		case AST_NODE_STRING:
+		case AST_NODE_NIL: {
+			return;
+		}
+		case AST_NODE_BINARY: {
+			AstNodeBinary* node_binary = (AstNodeBinary*) node;
+			collect_scope_names(node_binary->left_operand, names, nested, shadowed);
+			collect_scope_names(node_binary->right_operand, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_IN_PLACE_ATTRIBUTE_BINARY: {
+			AstNodeInPlaceAttributeBinary* node_in_place = (AstNodeInPlaceAttributeBinary*) node;
+			collect_scope_names(node_in_place->subject, names, nested, shadowed);
+			collect_scope_names(node_in_place->value, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_IN_PLACE_KEY_BINARY: {
+			AstNodeInPlaceKeyBinary* node_in_place = (AstNodeInPlaceKeyBinary*) node;
+			collect_scope_names(node_in_place->subject, names, nested, shadowed);
+			collect_scope_names(node_in_place->key, names, nested, shadowed);
+			collect_scope_names(node_in_place->value, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_UNARY: {
+			collect_scope_names(((AstNodeUnary*) node)->operand, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_VARIABLE: {
+			AstNodeVariable* node_variable = (AstNodeVariable*) node;
+			if (nested) {
+				if (!is_shadowed(shadowed, node_variable->name, node_variable->length)) {
+					add_name(&names->cell_names, node_variable->name, node_variable->length);
+				}
+			} else if (cstrings_equal(node_variable->name, node_variable->length, "self", strlen("self"))) {
+				/* self is bound by the call itself when the function is invoked as a method */
+				add_name(&names->local_names, node_variable->name, node_variable->length);
+				add_name(&names->bound_names, node_variable->name, node_variable->length);
+			}
+			return;
+		}
+		case AST_NODE_EXTERNAL: {
+			AstNodeExternal* node_external = (AstNodeExternal*) node;
+			add_name(&names->cell_names, node_external->name, node_external->length);
+			if (!nested) {
+				add_name(&names->bound_names, node_external->name, node_external->length);
+			}
+			return;
+		}
+		case AST_NODE_ASSIGNMENT: {
+			AstNodeAssignment* node_assignment = (AstNodeAssignment*) node;
+			if (!nested) {
+				add_name(&names->local_names, node_assignment->name, node_assignment->length);
+				add_name(&names->bound_names, node_assignment->name, node_assignment->length);
+			}
+			collect_scope_names(node_assignment->value, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_STATEMENTS: {
+			AstNodeStatements* node_statements = (AstNodeStatements*) node;
+			for (int i = 0; i < node_statements->statements.count; i++) {
+				collect_scope_names(node_statements->statements.values[i], names, nested, shadowed);
+			}
+			return;
+		}
+		case AST_NODE_FUNCTION: {
+			/* A parameter always has a value, so in the nested function its name can't refer to an enclosing variable */
+			AstNodeFunction* node_function = (AstNodeFunction*) node;
+			ValueArray function_shadowed;
+			value_array_init(&function_shadowed);
+			for (int i = 0; shadowed != NULL && i < shadowed->count; i++) {
+				value_array_write(&function_shadowed, &shadowed->values[i]);
+			}
+			for (int i = 0; i < node_function->parameters.count; i++) {
+				AstParameter param = node_function->parameters.values[i];
+				add_name(&function_shadowed, param.name, param.length);
+			}
+
+			collect_scope_names((AstNode*) node_function->statements, names, true, &function_shadowed);
+			value_array_free(&function_shadowed);
+			return;
+		}
+		case AST_NODE_CLASS: {
+			AstNodeClass* node_class = (AstNodeClass*) node;
+			collect_scope_names(node_class->superclass, names, nested, shadowed);
+			collect_scope_names((AstNode*) node_class->body, names, true, shadowed);
+			return;
+		}
+		case AST_NODE_CALL: {
+			AstNodeCall* node_call = (AstNodeCall*) node;
+			collect_scope_names(node_call->target, names, nested, shadowed);
+			for (int i = 0; i < node_call->arguments.count; i++) {
+				collect_scope_names(node_call->arguments.values[i], names, nested, shadowed);
+			}
+			return;
+		}
+		case AST_NODE_EXPR_STATEMENT: {
+			collect_scope_names(((AstNodeExprStatement*) node)->expression, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_RETURN: {
+			collect_scope_names(((AstNodeReturn*) node)->expression, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_IF: {
+			AstNodeIf* node_if = (AstNodeIf*) node;
+			collect_scope_names(node_if->condition, names, nested, shadowed);
+			collect_scope_names((AstNode*) node_if->body, names, nested, shadowed);
+			for (int i = 0; i < node_if->elsif_clauses.count; i++) {
+				collect_scope_names(node_if->elsif_clauses.values[i], names, nested, shadowed);
+			}
+			collect_scope_names((AstNode*) node_if->else_body, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_WHILE: {
+			AstNodeWhile* node_while = (AstNodeWhile*) node;
+			collect_scope_names(node_while->condition, names, nested, shadowed);
+			collect_scope_names((AstNode*) node_while->body, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_FOR: {
+			AstNodeFor* node_for = (AstNodeFor*) node;
+			if (!nested) {
+				add_name(&names->local_names, node_for->variable_name, node_for->variable_length);
+				add_name(&names->bound_names, node_for->variable_name, node_for->variable_length);
+			}
+			collect_scope_names(node_for->container, names, nested, shadowed);
+			collect_scope_names((AstNode*) node_for->body, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_AND: {
+			collect_scope_names(((AstNodeAnd*) node)->left, names, nested, shadowed);
+			collect_scope_names(((AstNodeAnd*) node)->right, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_OR: {
+			collect_scope_names(((AstNodeOr*) node)->left, names, nested, shadowed);
+			collect_scope_names(((AstNodeOr*) node)->right, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_ATTRIBUTE: {
+			collect_scope_names(((AstNodeAttribute*) node)->object, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_ATTRIBUTE_ASSIGNMENT: {
+			AstNodeAttributeAssignment* node_attr_assignment = (AstNodeAttributeAssignment*) node;
+			collect_scope_names(node_attr_assignment->object, names, nested, shadowed);
+			collect_scope_names(node_attr_assignment->value, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_KEY_ACCESS: {
+			AstNodeKeyAccess* node_key_access = (AstNodeKeyAccess*) node;
+			collect_scope_names(node_key_access->key, names, nested, shadowed);
+			collect_scope_names(node_key_access->subject, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_KEY_ASSIGNMENT: {
+			AstNodeKeyAssignment* node_key_assignment = (AstNodeKeyAssignment*) node;
+			collect_scope_names(node_key_assignment->subject, names, nested, shadowed);
+			collect_scope_names(node_key_assignment->key, names, nested, shadowed);
+			collect_scope_names(node_key_assignment->value, names, nested, shadowed);
+			return;
+		}
+		case AST_NODE_TABLE: {
+			AstNodeTable* node_table = (AstNodeTable*) node;
+			for (int i = 0; i < node_table->pairs.count; i++) {
+				collect_scope_names(node_table->pairs.values[i].key, names, nested, shadowed);
+				collect_scope_names(node_table->pairs.values[i].value, names, nested, shadowed);
+			}
+			return;
+		}
+		case AST_NODE_IMPORT: {
+			/* The imported module is stored by name in the locals table of the importing frame */
+			AstNodeImport* node_import = (AstNodeImport*) node;
+			if (!nested) {
+				add_name(&names->cell_names, node_import->name, node_import->name_length);
+				add_name(&names->bound_names, node_import->name, node_import->name_length);
+			}
+			return;
+		}
+	}
+
+	FAIL("Unrecognized AST node type while collecting scope names: %d", node->type);
+}
+
+static void add_local_slot(FunctionScope* scope, Bytecode* bytecode, ObjectString* name, bool accessible) {
+	if (scope->slot_names.count >= 65535) {
+		FAIL("A function cannot have more than 65535 local variables.");
+	}
+
+	Value name_value = MAKE_VALUE_OBJECT(name);
+	size_t name_index = (size_t) bytecode_add_constant(bytecode, &name_value);
+	integer_array_write(&bytecode->local_names_indices, &name_index);
+
+	Value slot_name = accessible ? name_value : MAKE_VALUE_NIL();
+	value_array_write(&scope->slot_names, &slot_name);
+}
+
+static int resolve_local_slot(const char* name, int length) {
+	if (current_function_scope == NULL) {
+		return -1;
+	}
+
+	ValueArray* slot_names = &current_function_scope->slot_names;
+	for (int i = 0; i < slot_names->count; i++) {
+		Value slot_name = slot_names->values[i];
+		if (VALUE_IS_OBJECT(slot_name)) {
+			ObjectString* slot_name_string = (ObjectString*) VALUE_AS_OBJECT(slot_name);
+			if (cstrings_equal(slot_name_string->chars, slot_name_string->length, name, length)) {
+				return i;
+			}
+		}
+	}
+
+	return -1;
+}
+
+static void allocate_local_slots(AstNodeFunction* node_function, FunctionScope* scope, Bytecode* bytecode) {
+	ScopeNames names;
+	value_array_init(&names.local_names);
+	value_array_init(&names.cell_names);
+	value_array_init(&names.bound_names);
+
+	collect_scope_names((AstNode*) node_function->statements, &names, false, NULL);
+
+	/* Parameters are bound positionally, so each one gets its slot even if it's captured. A captured parameter is
+	   moved from its slot into the locals table at the start of the function.
+	   Arguments are pushed last to first and left in place as the parameter slots, so the last parameter takes slot 0. */
+	for (int i = node_function->parameters.count - 1; i >= 0; i--) {
+		AstParameter param = node_function->parameters.values[i];
+		ObjectString* param_name = object_string_copy(param.name, param.length);
+		add_local_slot(scope, bytecode, param_name, !names_contain(&names.cell_names, param_name));
+		add_name(&names.bound_names, param_name->chars, param_name->length);
+	}
+
+	for (int i = 0; i < names.local_names.count; i++) {
+		ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(names.local_names.values[i]);
+		if (!names_contain(&names.cell_names, name) && resolve_local_slot(name->chars, name->length) == -1) {
+			add_local_slot(scope, bytecode, name, true);
+		}
+	}
+
+	bytecode->self_slot = resolve_local_slot("self", strlen("self"));
+
+	scope->bound_names = names.bound_names;
+
+	value_array_free(&names.local_names);
+	value_array_free(&names.cell_names);
+}
+
+static ObjectString* upvalue_name(Bytecode* bytecode, Upvalue* upvalue) {
+	return (ObjectString*) VALUE_AS_OBJECT(bytecode->constants.values[upvalue->name_index]);
+}
+
+static int find_upvalue(Bytecode* bytecode, ObjectString* name) {
+	for (int i = 0; i < bytecode->upvalues.count; i++) {
+		if (object_strings_equal(upvalue_name(bytecode, &bytecode->upvalues.values[i]), name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Records that the code may refer to a variable of an enclosing scope by the name. Where the cell comes from
+   is filled in by resolve_upvalues, once the enclosing scope is compiled and all of its assignments are known. */
+static int add_upvalue(Bytecode* bytecode, ObjectString* name) {
+	int existing = find_upvalue(bytecode, name);
+	if (existing >= 0) {
+		return existing;
+	}
+
+	if (bytecode->upvalues.count >= 65535) {
+		FAIL("A function cannot refer to more than 65535 variables of enclosing scopes.");
+	}
+
+	Value name_value = MAKE_VALUE_OBJECT(name);
+	Upvalue upvalue;
+	upvalue.name_index = bytecode_add_constant(bytecode, &name_value);
+	upvalue.in_enclosing_locals = true;
+	upvalue.assigned_in_enclosing = false;
+	upvalue.enclosing_index = -1;
+	upvalue_array_write(&bytecode->upvalues, &upvalue);
+	return bytecode->upvalues.count - 1;
+}
+
+static bool is_assigned_name(Bytecode* bytecode, ObjectString* name) {
+	for (int i = 0; i < bytecode->assigned_names_indices.count; i++) {
+		Value assigned_name = bytecode->constants.values[bytecode->assigned_names_indices.values[i]];
+		if (object_strings_equal((ObjectString*) VALUE_AS_OBJECT(assigned_name), name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Resolves the upvalues of the functions and classes the code creates, against the scope of the code itself.
+   bound_names is NULL for a module or class body, whose variables are attributes that can be created from anywhere.
+   A module has no upvalues of its own, so nothing is ever taken from the creating function there. */
+static void resolve_upvalues(Bytecode* bytecode, ValueArray* bound_names, bool is_module) {
+	for (int i = 0; i < bytecode->constants.count; i++) {
+		if (!object_value_is(bytecode->constants.values[i], OBJECT_CODE)) {
+			continue;
+		}
+
+		Bytecode* created = &((ObjectCode*) VALUE_AS_OBJECT(bytecode->constants.values[i]))->bytecode;
+		for (int j = 0; j < created->upvalues.count; j++) {
+			Upvalue* upvalue = &created->upvalues.values[j];
+			ObjectString* name = upvalue_name(created, upvalue);
+
+			/* A method which doesn't refer to self itself still has it in its locals table, from the call */
+			upvalue->in_enclosing_locals = bound_names == NULL || names_contain(bound_names, name)
+					|| cstrings_equal(name->chars, name->length, "self", strlen("self"));
+			upvalue->assigned_in_enclosing = upvalue->in_enclosing_locals && is_assigned_name(bytecode, name);
+			upvalue->enclosing_index = is_module ? -1 : find_upvalue(bytecode, name);
+		}
+	}
+}
+
+/* A parameter always has a value, so in its function the name can't refer to an enclosing variable */
+static bool is_parameter_of_current_function(ObjectString* name) {
+	if (current_function_scope == NULL || current_function_scope->parameters == NULL) {
+		return false;
+	}
+
+	AstParameterArray* parameters = current_function_scope->parameters;
+	for (int i = 0; i < parameters->count; i++) {
+		AstParameter param = parameters->values[i];
+		if (cstrings_equal(param.name, param.length, name->chars, name->length)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Called for every name the code refers to which might be a variable of an enclosing scope. Returns the upvalue index, or -1 */
+static int record_upvalue(Bytecode* bytecode, ObjectString* name) {
+	if (current_function_scope == NULL || is_parameter_of_current_function(name)) {
+		/* The module body has no enclosing scope */
+		return -1;
+	}
+	return add_upvalue(bytecode, name);
+}
+
+/* Whether the name can only refer to a variable of the module or to a builtin */
+static bool is_global_name(ObjectString* name) {
+	for (FunctionScope* scope = current_function_scope; scope != NULL; scope = scope->enclosing) {
+		if (scope == current_function_scope && scope->is_class_body) {
+			return false;
+		}
+		if (names_contain(&scope->bound_names, name)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void compile_function(AstNodeFunction* node_function, Bytecode* bytecode) {
+	FunctionScope* enclosing_scope = current_function_scope;
+
+	FunctionScope scope;
+	scope.enclosing = enclosing_scope;
+	scope.is_class_body = false;
+	scope.parameters = &node_function->parameters;
+	value_array_init(&scope.slot_names);
+	current_function_scope = &scope;
+
+	allocate_local_slots(node_function, &scope, bytecode);
+
+	for (int i = 0; i < node_function->parameters.count; i++) {
+		if (VALUE_IS_NIL(scope.slot_names.values[i])) {
+			emit_byte_with_short_operand(bytecode, OP_CAPTURE_PARAMETER, i);
+		}
+	}
+
+	compile_tree((AstNode*) node_function->statements, bytecode);
+	emit_two_bytes(bytecode, OP_NIL, OP_RETURN);
+	resolve_upvalues(bytecode, &scope.bound_names, false);
+
+	value_array_free(&scope.slot_names);
+	value_array_free(&scope.bound_names);
+	current_function_scope = enclosing_scope;
+}
+
+static void compile_class_body(AstNodeStatements* body, Bytecode* bytecode) {
+	FunctionScope* enclosing_scope = current_function_scope;
+
+	FunctionScope scope;
+	scope.enclosing = enclosing_scope;
+	scope.is_class_body = true;
+	scope.parameters = NULL;
+	value_array_init(&scope.slot_names);
+	current_function_scope = &scope;
+
+	ScopeNames names;
+	value_array_init(&names.local_names);
+	value_array_init(&names.cell_names);
+	value_array_init(&names.bound_names);
+
+	collect_scope_names((AstNode*) body, &names, false, NULL);
+	scope.bound_names = names.bound_names;
+
+	value_array_free(&names.local_names);
+	value_array_free(&names.cell_names);
+
+	compile_tree((AstNode*) body, bytecode);
+	emit_two_bytes(bytecode, OP_NIL, OP_RETURN);
+	resolve_upvalues(bytecode, NULL, false);
+
+	value_array_free(&scope.bound_names);
+	current_function_scope = enclosing_scope;
+}
+
+/* Superinstructions
+
+   A few sequences of instructions are very common in loops, so they are compiled to a single fused instruction,
+   which saves dispatching each part and the stack traffic between them. They were chosen by counting the pairs
+   of opcodes run by the benchmarks (see DEBUG_OPCODE_PAIRS):
+   - A comparison followed by OP_JUMP_IF_FALSE, in if, while and for conditions
+   - x = x + <number constant>, which is also what x += <number constant> becomes, for slot locals and globals
+   - != as OP_NOT_EQUAL rather than OP_EQUAL, OP_NEGATE
+   - and / or as a single conditional jump which pops the left operand only if it continues to the right one,
+     rather than OP_DUP, jump, OP_POP */
+
+static bool comparison_jump_opcode(ScannerTokenType operator, OP_CODE* out) {
+	switch (operator) {
+		case TOKEN_LESS_THAN: *out = OP_JUMP_IF_NOT_LESS; return true;
+		case TOKEN_GREATER_THAN: *out = OP_JUMP_IF_NOT_GREATER; return true;
+		case TOKEN_LESS_EQUAL: *out = OP_JUMP_IF_NOT_LESS_EQUAL; return true;
+		case TOKEN_GREATER_EQUAL: *out = OP_JUMP_IF_NOT_GREATER_EQUAL; return true;
+		case TOKEN_EQUAL_EQUAL: *out = OP_JUMP_IF_NOT_EQUAL; return true;
+		case TOKEN_BANG_EQUAL: *out = OP_JUMP_IF_EQUAL; return true;
+		default: return false;
+	}
+}
+
+/* Compiles a condition followed by a jump for when it's false, and returns the offset of the jump's placeholder */
+static size_t compile_condition_jump(AstNode* condition, Bytecode* bytecode) {
+	OP_CODE jump_opcode;
+	if (condition->type == AST_NODE_BINARY && comparison_jump_opcode(((AstNodeBinary*) condition)->operator, &jump_opcode)) {
+		AstNodeBinary* comparison = (AstNodeBinary*) condition;
+		compile_tree(comparison->left_operand, bytecode);
+		compile_tree(comparison->right_operand, bytecode);
+		return emit_opcode_with_short_placeholder(bytecode, jump_opcode);
+	}
+
+	compile_tree(condition, bytecode);
+	return emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_FALSE);
+}
+
+/* The number added to the assigned variable itself, for assignments of the form x = x + <number constant>.
+   NULL for any other assignment. */
+static AstNodeConstant* constant_added_to_itself(AstNodeAssignment* node_assignment) {
+	if (node_assignment->value->type != AST_NODE_BINARY) {
+		return NULL;
+	}
+
+	AstNodeBinary* binary = (AstNodeBinary*) node_assignment->value;
+	if (binary->operator != TOKEN_PLUS
+			|| binary->left_operand->type != AST_NODE_VARIABLE
+			|| binary->right_operand->type != AST_NODE_CONSTANT) {
+		return NULL;
+	}
+
+	AstNodeVariable* variable = (AstNodeVariable*) binary->left_operand;
+	AstNodeConstant* constant = (AstNodeConstant*) binary->right_operand;
+	if (!cstrings_equal(variable->name, variable->length, node_assignment->name, node_assignment->length)
+			|| !VALUE_IS_NUMBER(constant->value)) {
+		return NULL;
+	}
+
+	return constant;
+}
+
+/* Returns false without emitting anything if the assignment has to be compiled the usual way */
+static bool compile_add_constant_to_itself(AstNodeAssignment* node_assignment, Bytecode* bytecode) {
+	AstNodeConstant* constant = constant_added_to_itself(node_assignment);
+	int slot = resolve_local_slot(node_assignment->name, node_assignment->length);
+	bool is_global = current_function_scope == NULL;
+
+	if (constant == NULL || (slot < 0 && !is_global)) {
+		return false;
+	}
+
+	Value name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_assignment->name, node_assignment->length));
+	size_t constant_index = (size_t) bytecode_add_constant(bytecode, &name_constant);
+
+	if (slot >= 0) {
+		/* Before being assigned the variable may still refer to an enclosing one, like for OP_LOAD_LOCAL */
+		record_upvalue(bytecode, (ObjectString*) VALUE_AS_OBJECT(name_constant));
+		emit_byte_with_short_operand(bytecode, OP_ADD_CONSTANT_TO_LOCAL, slot);
+	} else {
+		integer_array_write(&bytecode->assigned_names_indices, &constant_index);
+		emit_global_access(bytecode, OP_ADD_CONSTANT_TO_GLOBAL, constant_index);
+	}
+
+	emit_constant_operand(bytecode, constant->value);
+	return true;
+}
+
 static void compile_tree(AstNode* node, Bytecode* bytecode) {
     AstNodeType node_type = node->type;
     
@@ -100,7 +683,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
                 case TOKEN_GREATER_EQUAL: emit_byte(bytecode, OP_GREATER_EQUAL); break;
                 case TOKEN_LESS_EQUAL: emit_byte(bytecode, OP_LESS_EQUAL); break;
                 case TOKEN_EQUAL_EQUAL: emit_byte(bytecode, OP_EQUAL); break;
-                case TOKEN_BANG_EQUAL: emit_two_bytes(bytecode, OP_EQUAL, OP_NEGATE); break;
+                case TOKEN_BANG_EQUAL: emit_byte(bytecode, OP_NOT_EQUAL); break;
                 default: FAIL("Unrecognized operator type: %d", operator); break;
             }
             
@@ -116,7 +699,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 			Value attr_name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_in_place->attribute, node_in_place->attribute_length));
 			int attr_index = bytecode_add_constant(bytecode, &attr_name_constant);
 
-            emit_byte_with_short_operand(bytecode, OP_GET_ATTRIBUTE, attr_index);
+            emit_attribute_access(bytecode, OP_GET_ATTRIBUTE, attr_index);
 
 			compile_tree(node_in_place->value, bytecode);
 
@@ -124,7 +707,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 
 			emit_byte(bytecode, OP_SWAP);
 
-			emit_byte_with_short_operand(bytecode, OP_SET_ATTRIBUTE, attr_index);
+			emit_attribute_access(bytecode, OP_SET_ATTRIBUTE, attr_index);
 
 			break;
 		}
@@ -165,11 +748,31 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
         case AST_NODE_VARIABLE: {
             AstNodeVariable* node_variable = (AstNodeVariable*) node;
             
-            Value name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_variable->name, node_variable->length));
+            ObjectString* name = object_string_copy(node_variable->name, node_variable->length);
+            Value name_constant = MAKE_VALUE_OBJECT(name);
             size_t constant_index = (size_t) bytecode_add_constant(bytecode, &name_constant);
 
-            integer_array_write(&bytecode->referenced_names_indices, &constant_index);
-            
+            if (is_global_name(name)) {
+                /* Not recorded as referenced, because there's no enclosing variable for closures to capture */
+                emit_global_access(bytecode, OP_LOAD_GLOBAL, constant_index);
+                break;
+            }
+
+            /* Recorded even for slot locals, because before being assigned they may still refer to an enclosing variable */
+            int upvalue = record_upvalue(bytecode, name);
+
+            int slot = resolve_local_slot(node_variable->name, node_variable->length);
+            if (slot >= 0) {
+                emit_byte_with_short_operand(bytecode, OP_LOAD_LOCAL, slot);
+                break;
+            }
+
+            if (upvalue >= 0 && !current_function_scope->is_class_body && !names_contain(&current_function_scope->bound_names, name)) {
+                /* Not bound in the function itself, so it's never in the frame's locals table */
+                emit_byte_with_short_operand(bytecode, OP_LOAD_UPVALUE, upvalue);
+                break;
+            }
+
 			emit_byte(bytecode, OP_LOAD_VARIABLE);
             emit_short_as_two_bytes(bytecode, constant_index);
 
@@ -182,7 +785,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
             Value name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_external->name, node_external->length));
             size_t constant_index = (size_t) bytecode_add_constant(bytecode, &name_constant);
 
-            integer_array_write(&bytecode->referenced_names_indices, &constant_index);
+            record_upvalue(bytecode, (ObjectString*) VALUE_AS_OBJECT(name_constant));
             
 			emit_byte_with_short_operand(bytecode, OP_DECLARE_EXTERNAL, constant_index);
 
@@ -191,13 +794,30 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
         
         case AST_NODE_ASSIGNMENT: {
             AstNodeAssignment* node_assignment = (AstNodeAssignment*) node;
+
+            if (compile_add_constant_to_itself(node_assignment, bytecode)) {
+                break;
+            }
             
             compile_tree(node_assignment->value, bytecode);
 
+            int slot = resolve_local_slot(node_assignment->name, node_assignment->length);
+            if (slot >= 0) {
+                emit_byte_with_short_operand(bytecode, OP_SET_LOCAL, slot);
+                break;
+            }
+
 			Value name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_assignment->name, node_assignment->length));
 			size_t constant_index = (size_t) bytecode_add_constant(bytecode, &name_constant);
 
 			integer_array_write(&bytecode->assigned_names_indices, &constant_index);
+
+			if (current_function_scope == NULL) {
+				/* Assigning in the module body binds a global */
+				emit_global_access(bytecode, OP_STORE_GLOBAL, constant_index);
+				break;
+			}
+
 			emit_byte(bytecode, OP_SET_VARIABLE);
             emit_short_as_two_bytes(bytecode, constant_index);
 
@@ -220,32 +840,30 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
             Bytecode func_bytecode;
             bytecode_init(&func_bytecode);
 
-            compiler_compile((AstNode*) node_function->statements, &func_bytecode);
+            compile_function(node_function, &func_bytecode);
 
-            IntegerArray func_referenced_names_indices = func_bytecode.referenced_names_indices;
-            for (int i = 0; i < func_referenced_names_indices.count; i++) {
-            	Value referenced_name = func_bytecode.constants.values[func_referenced_names_indices.values[i]];
-            	size_t constant_index = (size_t) bytecode_add_constant(bytecode, &referenced_name);
-            	integer_array_write(&bytecode->referenced_names_indices, &constant_index);
+            /* Whatever the function may take from an enclosing scope, it takes through this one */
+            for (int i = 0; i < func_bytecode.upvalues.count; i++) {
+            	record_upvalue(bytecode, upvalue_name(&func_bytecode, &func_bytecode.upvalues.values[i]));
 			}
 
-            Value obj_code_constant = MAKE_VALUE_OBJECT(object_code_new(func_bytecode));
-            emit_opcode_with_constant_operand(bytecode, OP_MAKE_FUNCTION, obj_code_constant);
-
             int num_params = node_function->parameters.count;
 
 			assert (num_params >= 0 && num_params < 65535);
 
-            emit_short_as_two_bytes(bytecode, num_params);
-
-            for (int i = 0; i < num_params; i++) {
-            	Value param_value = node_function->parameters.values[i];
-            	ASSERT_VALUE_TYPE(param_value, VALUE_RAW_STRING);
-            	RawString param_raw_string = param_value.as.raw_string;
-				ObjectString* param_as_object_string = object_string_copy(param_raw_string.data, param_raw_string.length);
-				emit_constant_operand(bytecode, MAKE_VALUE_OBJECT(param_as_object_string));
+			/* The parameters go with the code, so every function made from it shares them */
+			ObjectString** params = NULL;
+			if (num_params > 0) {
+				params = allocate(sizeof(ObjectString*) * num_params, "Parameters list strings");
+				for (int i = 0; i < num_params; i++) {
+					AstParameter param = node_function->parameters.values[i];
+					params[i] = object_string_copy(param.name, param.length);
+				}
 			}
 
+            Value obj_code_constant = MAKE_VALUE_OBJECT(object_code_new(func_bytecode, params, num_params));
+            emit_opcode_with_constant_operand(bytecode, OP_MAKE_FUNCTION, obj_code_constant);
+
             break;
         }
 
@@ -255,13 +873,10 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 			Bytecode body_bytecode;
             bytecode_init(&body_bytecode);
 
-            compiler_compile((AstNode*) node_class->body, &body_bytecode);
+            compile_class_body(node_class->body, &body_bytecode);
 
-            IntegerArray refd_names_indices = body_bytecode.referenced_names_indices;
-            for (int i = 0; i < refd_names_indices.count; i++) {
-            	Value referenced_name = body_bytecode.constants.values[refd_names_indices.values[i]];
-            	size_t constant_index = (size_t) bytecode_add_constant(bytecode, &referenced_name);
-            	integer_array_write(&bytecode->referenced_names_indices, &constant_index);
+            for (int i = 0; i < body_bytecode.upvalues.count; i++) {
+            	record_upvalue(bytecode, upvalue_name(&body_bytecode, &body_bytecode.upvalues.values[i]));
 			}
 
 			if (node_class->superclass == NULL) {
@@ -270,7 +885,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 				compile_tree(node_class->superclass, bytecode);
 			}
 
-            Value obj_code_constant = MAKE_VALUE_OBJECT(object_code_new(body_bytecode));
+            Value obj_code_constant = MAKE_VALUE_OBJECT(object_code_new(body_bytecode, NULL, 0));
             emit_opcode_with_constant_operand(bytecode, OP_MAKE_CLASS, obj_code_constant);
 
 			break;
@@ -293,6 +908,18 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 				compile_tree(argument, bytecode);
 			}
 
+			if (node_call->target->type == AST_NODE_ATTRIBUTE) {
+				/* Calling an attribute looks up the method and calls it in one instruction, so that a method
+				   doesn't need a bound method created for it just to be called */
+				AstNodeAttribute* node_attr = (AstNodeAttribute*) node_call->target;
+				compile_tree(node_attr->object, bytecode);
+
+				Value attr_name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_attr->name, node_attr->length));
+				emit_attribute_access(bytecode, OP_INVOKE, bytecode_add_constant(bytecode, &attr_name_constant));
+				emit_byte(bytecode, node_call->arguments.count);
+				break;
+			}
+
             compile_tree(node_call->target, bytecode);
             emit_two_bytes(bytecode, OP_CALL, node_call->arguments.count);
 
@@ -353,7 +980,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
             compile_tree(node_attr->object, bytecode);
 
             Value attr_name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_attr->name, node_attr->length));
-            emit_opcode_with_constant_operand(bytecode, OP_GET_ATTRIBUTE, attr_name_constant);
+            emit_attribute_access(bytecode, OP_GET_ATTRIBUTE, bytecode_add_constant(bytecode, &attr_name_constant));
 
             break;
         }
@@ -365,7 +992,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
             compile_tree(node_attr_assignment->object, bytecode);
 
             Value attr_name_constant = MAKE_VALUE_OBJECT(object_string_copy(node_attr_assignment->name, node_attr_assignment->length));
-            emit_opcode_with_constant_operand(bytecode, OP_SET_ATTRIBUTE, attr_name_constant);
+            emit_attribute_access(bytecode, OP_SET_ATTRIBUTE, bytecode_add_constant(bytecode, &attr_name_constant));
 
             break;
         }
@@ -390,8 +1017,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
         	IntegerArray jump_placeholder_offsets;
         	integer_array_init(&jump_placeholder_offsets);
 
-        	compile_tree(node_if->condition, bytecode);
-        	size_t if_condition_jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_FALSE);
+        	size_t if_condition_jump_address_offset = compile_condition_jump(node_if->condition, bytecode);
 
         	compile_tree((AstNode*) node_if->body, bytecode);
 
@@ -404,8 +1030,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 				AstNode* condition = node_if->elsif_clauses.values[i];
 				AstNodeStatements* body = node_if->elsif_clauses.values[i+1];
 
-				compile_tree(condition, bytecode);
-				if_condition_jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_FALSE);
+				if_condition_jump_address_offset = compile_condition_jump(condition, bytecode);
 				compile_tree((AstNode*) body, bytecode);
 
 				jump_to_end_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_FORWARD);
@@ -434,11 +1059,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 			AstNodeWhile* node_while = (AstNodeWhile*) node;
 
 			int before_condition = bytecode->count;
-			compile_tree(node_while->condition, bytecode);
-
-			emit_byte(bytecode, OP_JUMP_IF_FALSE);
-			size_t placeholderOffset = bytecode->count;
-			emit_two_bytes(bytecode, 0, 0);
+			size_t placeholderOffset = compile_condition_jump(node_while->condition, bytecode);
 
 			compile_tree((AstNode*) node_while->body, bytecode);
 
@@ -475,20 +1096,24 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
 			uint16_t top = bytecode->count;
 
 			emit_byte_with_short_operand(bytecode, OP_GET_OFFSET_FROM_TOP, 1);
-			emit_byte_with_short_operand(bytecode, OP_GET_ATTRIBUTE, length_attr_index);			
-			emit_two_bytes(bytecode, OP_CALL, 0);
+			emit_attribute_access(bytecode, OP_INVOKE, length_attr_index);
+			emit_byte(bytecode, 0);
 			emit_byte_with_short_operand(bytecode, OP_GET_OFFSET_FROM_TOP, 3);
-			emit_byte(bytecode, OP_GREATER_THAN);
-
-			emit_byte(bytecode, OP_JUMP_IF_FALSE);
-			int placeholder_offset = bytecode->count;
-			emit_short_as_two_bytes(bytecode, 0);
+			int placeholder_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_NOT_GREATER);
 
 			emit_byte_with_short_operand(bytecode, OP_GET_OFFSET_FROM_TOP, 2);
 			emit_byte_with_short_operand(bytecode, OP_GET_OFFSET_FROM_TOP, 2);
-			emit_byte_with_short_operand(bytecode, OP_GET_ATTRIBUTE, get_key_attr_index);			
-			emit_two_bytes(bytecode, OP_CALL, 1);
-			emit_byte_with_short_operand(bytecode, OP_SET_VARIABLE, variable_name_index);	
+			emit_attribute_access(bytecode, OP_INVOKE, get_key_attr_index);
+			emit_byte(bytecode, 1);
+
+			int variable_slot = resolve_local_slot(node_for->variable_name, node_for->variable_length);
+			if (variable_slot >= 0) {
+				emit_byte_with_short_operand(bytecode, OP_SET_LOCAL, variable_slot);
+			} else if (current_function_scope == NULL) {
+				emit_global_access(bytecode, OP_STORE_GLOBAL, variable_name_index);
+			} else {
+				emit_byte_with_short_operand(bytecode, OP_SET_VARIABLE, variable_name_index);
+			}
 
 			compile_tree((AstNode*) node_for->body, bytecode);
 
@@ -510,10 +1135,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
         	AstNodeAnd* node_and = (AstNodeAnd*) node;
         	
 			compile_tree((AstNode*) node_and->left, bytecode);
-			emit_byte(bytecode, OP_DUP);
-
-			size_t jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_FALSE);
-			emit_byte(bytecode, OP_POP);
+			size_t jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_FALSE_OR_POP);
 
         	compile_tree((AstNode*) node_and->right, bytecode);
 			backpatch_placeholder_with_current_address(bytecode, jump_address_offset);
@@ -525,10 +1147,7 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
         	AstNodeOr* node_or = (AstNodeOr*) node;
 
         	compile_tree((AstNode*) node_or->left, bytecode);
-			emit_byte(bytecode, OP_DUP);
-
-			size_t jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_TRUE);
-			emit_byte(bytecode, OP_POP);
+			size_t jump_address_offset = emit_opcode_with_short_placeholder(bytecode, OP_JUMP_IF_TRUE_OR_POP);
 
         	compile_tree((AstNode*) node_or->right, bytecode);
 			backpatch_placeholder_with_current_address(bytecode, jump_address_offset);
@@ -548,8 +1167,14 @@ static void compile_tree(AstNode* node, Bytecode* bytecode) {
     }
 }
 
-/* Compile a program or a function */
+/* Compile a module */
 void compiler_compile(AstNode* node, Bytecode* bytecode) {
+    FunctionScope* enclosing_scope = current_function_scope;
+    current_function_scope = NULL;
+
     compile_tree(node, bytecode);
     emit_two_bytes(bytecode, OP_NIL, OP_RETURN);
+    resolve_upvalues(bytecode, NULL, true);
+
+    current_function_scope = enclosing_scope;
 }
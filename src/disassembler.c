@@ -21,6 +21,26 @@ static int short_operand_instruction(const char* name, Bytecode* chunk, int offs
     return offset + 3;
 }
 
+static int local_instruction(const char* name, Bytecode* chunk, int offset) {
+    uint16_t slot = two_bytes_to_short(chunk->code[offset + 1], chunk->code[offset + 2]);
+    Value local_name = chunk->constants.values[chunk->local_names_indices.values[slot]];
+
+    printf("%p %-28s %d (", chunk->code + offset, name, slot);
+    value_print(local_name);
+    printf(")\n");
+    return offset + 3;
+}
+
+static int upvalue_instruction(const char* name, Bytecode* chunk, int offset) {
+    uint16_t index = two_bytes_to_short(chunk->code[offset + 1], chunk->code[offset + 2]);
+    Value upvalue_name = chunk->constants.values[chunk->upvalues.values[index].name_index];
+
+    printf("%p %-28s %d (", chunk->code + offset, name, index);
+    value_print(upvalue_name);
+    printf(")\n");
+    return offset + 3;
+}
+
 static Value read_constant_operand(Bytecode* chunk, int offset) {
 	uint8_t constant_index_byte_1 = chunk->code[offset];
 	uint8_t constant_index_byte_2 = chunk->code[offset + 1];
@@ -41,29 +61,55 @@ static int constant_instruction(const char* name, Bytecode* chunk, int offset) {
     return offset + 3;
 }
 
-static int constant_and_variable_length_constants_instruction(const char* name, Bytecode* chunk, int offset) {
-    // int constantIndex = chunk->code[offset + 1];
-    // Value constant = chunk->constants.values[constantIndex];
+/* Instructions taking a name constant followed by the index of the inline cache of the site */
+static int cached_name_instruction(const char* name, Bytecode* chunk, int offset) {
+	Value name_constant = read_constant_operand(chunk, offset + 1);
+	uint16_t cache_index = two_bytes_to_short(chunk->code[offset + 3], chunk->code[offset + 4]);
 
-	Value constant = read_constant_operand(chunk, offset + 1);
+	printf("%p %-28s ", chunk->code + offset, name);
+	value_print(name_constant);
+	printf(" [cache %d]\n", cache_index);
 
-    printf("%p %-28s ", chunk->code + offset, name);
-    value_print(constant);
+	return offset + 5;
+}
 
-    uint16_t additional_operands_count = two_bytes_to_short(chunk->code[offset + 3], chunk->code[offset + 4]);
+static int invoke_instruction(const char* name, Bytecode* chunk, int offset) {
+	Value name_constant = read_constant_operand(chunk, offset + 1);
+	uint16_t cache_index = two_bytes_to_short(chunk->code[offset + 3], chunk->code[offset + 4]);
+	uint8_t arg_count = chunk->code[offset + 5];
 
-    for (int i = 0; i < additional_operands_count * 2; i += 2) {
-		int additional_operand_offset = offset + 5 + i;
-		Value operand = read_constant_operand(chunk, additional_operand_offset);
-		// uint8_t additional_operand_index = chunk->code[additional_operand_offset];
-		// Value operand = chunk->constants.values[additional_operand_index];
-		printf(", ");
-		value_print(operand);
-	}
+	printf("%p %-28s ", chunk->code + offset, name);
+	value_print(name_constant);
+	printf(" (%d args) [cache %d]\n", arg_count, cache_index);
+
+	return offset + 6;
+}
 
+static int add_constant_to_local_instruction(const char* name, Bytecode* chunk, int offset) {
+    uint16_t slot = two_bytes_to_short(chunk->code[offset + 1], chunk->code[offset + 2]);
+    Value local_name = chunk->constants.values[chunk->local_names_indices.values[slot]];
+    Value constant = read_constant_operand(chunk, offset + 3);
+
+    printf("%p %-28s %d (", chunk->code + offset, name, slot);
+    value_print(local_name);
+    printf(") += ");
+    value_print(constant);
     printf("\n");
+    return offset + 5;
+}
+
+static int add_constant_to_global_instruction(const char* name, Bytecode* chunk, int offset) {
+	Value name_constant = read_constant_operand(chunk, offset + 1);
+	uint16_t cache_index = two_bytes_to_short(chunk->code[offset + 3], chunk->code[offset + 4]);
+	Value constant = read_constant_operand(chunk, offset + 5);
+
+	printf("%p %-28s ", chunk->code + offset, name);
+	value_print(name_constant);
+	printf(" [cache %d] += ", cache_index);
+	value_print(constant);
+	printf("\n");
 
-    return offset + 5 + (additional_operands_count * 2);
+	return offset + 7;
 }
 
 static int simple_instruction(const char* name, Bytecode* chunk, int offset) {
@@ -71,6 +117,69 @@ static int simple_instruction(const char* name, Bytecode* chunk, int offset) {
     return offset + 1;
 }
 
+static const char* opcode_names[OPCODE_COUNT] = {
+	[OP_CONSTANT] = "OP_CONSTANT",
+	[OP_ADD] = "OP_ADD",
+	[OP_SUBTRACT] = "OP_SUBTRACT",
+	[OP_MULTIPLY] = "OP_MULTIPLY",
+	[OP_DIVIDE] = "OP_DIVIDE",
+	[OP_MODULO] = "OP_MODULO",
+	[OP_NEGATE] = "OP_NEGATE",
+	[OP_GREATER_THAN] = "OP_GREATER_THAN",
+	[OP_LESS_THAN] = "OP_LESS_THAN",
+	[OP_GREATER_EQUAL] = "OP_GREATER_EQUAL",
+	[OP_LESS_EQUAL] = "OP_LESS_EQUAL",
+	[OP_EQUAL] = "OP_EQUAL",
+	[OP_NOT_EQUAL] = "OP_NOT_EQUAL",
+	[OP_ACCESS_KEY] = "OP_ACCESS_KEY",
+	[OP_SET_KEY] = "OP_SET_KEY",
+	[OP_LOAD_VARIABLE] = "OP_LOAD_VARIABLE",
+	[OP_SET_VARIABLE] = "OP_SET_VARIABLE",
+	[OP_LOAD_LOCAL] = "OP_LOAD_LOCAL",
+	[OP_LOAD_UPVALUE] = "OP_LOAD_UPVALUE",
+	[OP_SET_LOCAL] = "OP_SET_LOCAL",
+	[OP_LOAD_GLOBAL] = "OP_LOAD_GLOBAL",
+	[OP_STORE_GLOBAL] = "OP_STORE_GLOBAL",
+	[OP_ADD_CONSTANT_TO_LOCAL] = "OP_ADD_CONSTANT_TO_LOCAL",
+	[OP_ADD_CONSTANT_TO_GLOBAL] = "OP_ADD_CONSTANT_TO_GLOBAL",
+	[OP_CAPTURE_PARAMETER] = "OP_CAPTURE_PARAMETER",
+	[OP_DECLARE_EXTERNAL] = "OP_DECLARE_EXTERNAL",
+	[OP_MAKE_TABLE] = "OP_MAKE_TABLE",
+	[OP_CALL] = "OP_CALL",
+	[OP_INVOKE] = "OP_INVOKE",
+	[OP_GET_ATTRIBUTE] = "OP_GET_ATTRIBUTE",
+	[OP_SET_ATTRIBUTE] = "OP_SET_ATTRIBUTE",
+	[OP_POP] = "OP_POP",
+	[OP_DUP] = "OP_DUP",
+	[OP_DUP_TWO] = "OP_DUP_TWO",
+	[OP_SWAP] = "OP_SWAP",
+	[OP_SWAP_TOP_WITH_NEXT_TWO] = "OP_SWAP_TOP_WITH_NEXT_TWO",
+	[OP_GET_OFFSET_FROM_TOP] = "OP_GET_OFFSET_FROM_TOP",
+	[OP_SET_OFFSET_FROM_TOP] = "OP_SET_OFFSET_FROM_TOP",
+	[OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+	[OP_JUMP_IF_TRUE] = "OP_JUMP_IF_TRUE",
+	[OP_JUMP_IF_FALSE_OR_POP] = "OP_JUMP_IF_FALSE_OR_POP",
+	[OP_JUMP_IF_TRUE_OR_POP] = "OP_JUMP_IF_TRUE_OR_POP",
+	[OP_JUMP_IF_NOT_LESS] = "OP_JUMP_IF_NOT_LESS",
+	[OP_JUMP_IF_NOT_GREATER] = "OP_JUMP_IF_NOT_GREATER",
+	[OP_JUMP_IF_NOT_LESS_EQUAL] = "OP_JUMP_IF_NOT_LESS_EQUAL",
+	[OP_JUMP_IF_NOT_GREATER_EQUAL] = "OP_JUMP_IF_NOT_GREATER_EQUAL",
+	[OP_JUMP_IF_NOT_EQUAL] = "OP_JUMP_IF_NOT_EQUAL",
+	[OP_JUMP_IF_EQUAL] = "OP_JUMP_IF_EQUAL",
+	[OP_JUMP_FORWARD] = "OP_JUMP_FORWARD",
+	[OP_JUMP_BACKWARD] = "OP_JUMP_BACKWARD",
+	[OP_MAKE_STRING] = "OP_MAKE_STRING",
+	[OP_MAKE_FUNCTION] = "OP_MAKE_FUNCTION",
+	[OP_MAKE_CLASS] = "OP_MAKE_CLASS",
+	[OP_IMPORT] = "OP_IMPORT",
+	[OP_NIL] = "OP_NIL",
+	[OP_RETURN] = "OP_RETURN"
+};
+
+const char* disassembler_opcode_name(OP_CODE opcode) {
+	return opcode_names[opcode];
+}
+
 int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offset) {
 	printf("%-3d ", offset);
 
@@ -108,12 +217,39 @@ int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offs
 		case OP_EQUAL: {
 			return simple_instruction("OP_EQUAL", chunk, offset);
 		}
+		case OP_NOT_EQUAL: {
+			return simple_instruction("OP_NOT_EQUAL", chunk, offset);
+		}
 		case OP_NEGATE: {
 			return simple_instruction("OP_NEGATE", chunk, offset);
 		}
 		case OP_LOAD_VARIABLE: {
 			return constant_instruction("OP_LOAD_VARIABLE", chunk, offset);
 		}
+		case OP_LOAD_LOCAL: {
+			return local_instruction("OP_LOAD_LOCAL", chunk, offset);
+		}
+		case OP_LOAD_UPVALUE: {
+			return upvalue_instruction("OP_LOAD_UPVALUE", chunk, offset);
+		}
+		case OP_SET_LOCAL: {
+			return local_instruction("OP_SET_LOCAL", chunk, offset);
+		}
+		case OP_LOAD_GLOBAL: {
+			return cached_name_instruction("OP_LOAD_GLOBAL", chunk, offset);
+		}
+		case OP_STORE_GLOBAL: {
+			return cached_name_instruction("OP_STORE_GLOBAL", chunk, offset);
+		}
+		case OP_ADD_CONSTANT_TO_LOCAL: {
+			return add_constant_to_local_instruction("OP_ADD_CONSTANT_TO_LOCAL", chunk, offset);
+		}
+		case OP_ADD_CONSTANT_TO_GLOBAL: {
+			return add_constant_to_global_instruction("OP_ADD_CONSTANT_TO_GLOBAL", chunk, offset);
+		}
+		case OP_CAPTURE_PARAMETER: {
+			return local_instruction("OP_CAPTURE_PARAMETER", chunk, offset);
+		}
 		case OP_DECLARE_EXTERNAL: {
 			return constant_instruction("OP_DECLARE_EXTERNAL", chunk, offset);
 		}
@@ -123,6 +259,9 @@ int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offs
 		case OP_CALL: {
 			return single_operand_instruction("OP_CALL", chunk, offset);
 		}
+		case OP_INVOKE: {
+			return invoke_instruction("OP_INVOKE", chunk, offset);
+		}
 		case OP_ACCESS_KEY: {
 			return simple_instruction("OP_ACCESS_KEY", chunk, offset);
 		}
@@ -133,10 +272,10 @@ int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offs
 			return constant_instruction("OP_IMPORT", chunk, offset);
 		}
 		case OP_GET_ATTRIBUTE: {
-			return constant_instruction("OP_GET_ATTRIBUTE", chunk, offset);
+			return cached_name_instruction("OP_GET_ATTRIBUTE", chunk, offset);
 		}
 		case OP_SET_ATTRIBUTE: {
-			return constant_instruction("OP_SET_ATTRIBUTE", chunk, offset);
+			return cached_name_instruction("OP_SET_ATTRIBUTE", chunk, offset);
 		}
 		case OP_POP: {
 			return simple_instruction("OP_POP", chunk, offset);
@@ -159,6 +298,30 @@ int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offs
 		case OP_JUMP_IF_TRUE: {
 			return short_operand_instruction("OP_JUMP_IF_TRUE", chunk, offset);
 		}
+		case OP_JUMP_IF_FALSE_OR_POP: {
+			return short_operand_instruction("OP_JUMP_IF_FALSE_OR_POP", chunk, offset);
+		}
+		case OP_JUMP_IF_TRUE_OR_POP: {
+			return short_operand_instruction("OP_JUMP_IF_TRUE_OR_POP", chunk, offset);
+		}
+		case OP_JUMP_IF_NOT_LESS: {
+			return short_operand_instruction("OP_JUMP_IF_NOT_LESS", chunk, offset);
+		}
+		case OP_JUMP_IF_NOT_GREATER: {
+			return short_operand_instruction("OP_JUMP_IF_NOT_GREATER", chunk, offset);
+		}
+		case OP_JUMP_IF_NOT_LESS_EQUAL: {
+			return short_operand_instruction("OP_JUMP_IF_NOT_LESS_EQUAL", chunk, offset);
+		}
+		case OP_JUMP_IF_NOT_GREATER_EQUAL: {
+			return short_operand_instruction("OP_JUMP_IF_NOT_GREATER_EQUAL", chunk, offset);
+		}
+		case OP_JUMP_IF_NOT_EQUAL: {
+			return short_operand_instruction("OP_JUMP_IF_NOT_EQUAL", chunk, offset);
+		}
+		case OP_JUMP_IF_EQUAL: {
+			return short_operand_instruction("OP_JUMP_IF_EQUAL", chunk, offset);
+		}
 		case OP_GET_OFFSET_FROM_TOP: {
 			return short_operand_instruction("OP_GET_OFFSET_FROM_TOP", chunk, offset);
 		}
@@ -178,7 +341,7 @@ int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offs
 			return single_operand_instruction("OP_MAKE_TABLE", chunk, offset);
 		}
 		case OP_MAKE_FUNCTION: {
-			return constant_and_variable_length_constants_instruction("OP_MAKE_FUNCTION", chunk, offset);
+			return constant_instruction("OP_MAKE_FUNCTION", chunk, offset);
 		}
 		case OP_MAKE_CLASS: {
 			return constant_instruction("OP_MAKE_CLASS", chunk, offset);
@@ -203,9 +366,9 @@ void disassembler_do_bytecode(Bytecode* chunk) {
     
     for (int i = 0; i < chunk->constants.count; i++) {
         Value constant = chunk->constants.values[i];
-        if (constant.type == VALUE_OBJECT && constant.as.object->type == OBJECT_CODE) {
+        if (VALUE_IS_OBJECT(constant) && VALUE_AS_OBJECT(constant)->type == OBJECT_CODE) {
             printf("\nInner chunk [index %d]:\n", i);
-            ObjectCode* inner_code_object = (ObjectCode*) constant.as.object;
+            ObjectCode* inner_code_object = (ObjectCode*) VALUE_AS_OBJECT(constant);
             Bytecode inner_chunk = inner_code_object->bytecode;
             disassembler_do_bytecode(&inner_chunk);
         }
@@ -6,5 +6,6 @@
 
 void disassembler_do_bytecode(Bytecode* chunk);
 int disassembler_do_single_instruction(OP_CODE opcode, Bytecode* chunk, int offset);
+const char* disassembler_opcode_name(OP_CODE opcode);
 
 #endif
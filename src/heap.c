@@ -0,0 +1,843 @@
+#include <string.h>
+
+#include "heap.h"
+#include "memory.h"
+#include "ribbon_object.h"
+#include "pointerarray.h"
+#include "threads.h"
+
+#define FREED_SLOT_POISON 0xDB
+#define GRAY_OBJECTS_KEEP_CAPACITY 4096 /* Bigger gray objects arrays are released after marking */
+#define SHARED_GRAY_CAPACITY 256 /* Gray objects a marker thread shares with the others at a time */
+
+typedef struct {
+	HeapPage* pages;
+	HeapPage* last_page;
+	HeapPage* allocating; /* Pages before this one were full the last time allocation looked at them. Unused for large pages */
+} PageList;
+
+static PageList size_classes[HEAP_NUM_SIZE_CLASSES];
+static PageList large_pages;
+static size_t num_young;
+static PointerArray young_pages; /* Pages with objects allocated since the last minor or full collection */
+
+static PointerArray remembered;
+static PointerArray always_remembered;
+static PointerArray gray_objects; /* Marked objects whose references weren't marked yet */
+
+bool heap_incremental_marking = false;
+
+/* Parallel marking. Every thread has a private stack of gray objects, and whenever its pool is empty it shares some of them there.
+   A thread which runs out of gray objects takes them back from its own pool, and then steals from the pools of the others.
+   Marking is done once all threads are out of gray objects at the same time, since only a thread with gray objects can make more.
+   Nothing the threads use may touch the tracked memory, which isn't thread safe, so their stacks are allocated without tracking. */
+
+typedef struct {
+	Object** values;
+	size_t count;
+	size_t capacity;
+} GrayStack;
+
+typedef struct {
+	GrayStack local;
+	GrayStack deferred; /* Objects only the main thread may trace */
+	SpinLock lock;
+	int shared_count; /* Read without the lock, to find out cheaply whether there's anything to take */
+	Object* shared[SHARED_GRAY_CAPACITY];
+} Marker;
+
+static Marker markers[THREADS_MAX];
+static int num_markers;
+static int idle_markers;
+static void (*parallel_trace)(Object*);
+static bool marking_in_parallel = false;
+static _Thread_local Marker* current_marker;
+
+static void gray_stack_push(GrayStack* stack, Object* object) {
+	if (stack->count == stack->capacity) {
+		stack->capacity = GROW_CAPACITY(stack->capacity);
+		stack->values = reallocate_no_tracking(stack->values, sizeof(Object*) * stack->capacity);
+		if (stack->values == NULL) {
+			FAIL("Couldn't allocate memory for the gray objects of a marker thread.");
+		}
+	}
+	stack->values[stack->count++] = object;
+}
+
+static void gray_stack_free(GrayStack* stack) {
+	deallocate_no_tracking(stack->values);
+	*stack = (GrayStack) {.values = NULL, .count = 0, .capacity = 0};
+}
+
+void heap_init(void) {
+	for (int i = 0; i < HEAP_NUM_SIZE_CLASSES; i++) {
+		size_classes[i] = (PageList) {.pages = NULL, .last_page = NULL, .allocating = NULL};
+	}
+	large_pages = (PageList) {.pages = NULL, .last_page = NULL, .allocating = NULL};
+	num_young = 0;
+	pointer_array_init(&young_pages, "Young pages");
+	pointer_array_init(&remembered, "Remembered set");
+	pointer_array_init(&always_remembered, "Always remembered set");
+	pointer_array_init(&gray_objects, "Gray objects");
+	heap_incremental_marking = false;
+}
+
+/* Releases the bookkeeping of the heap. The pages themselves are released by sweeping once nothing is reachable */
+void heap_free(void) {
+	pointer_array_free(&young_pages);
+	pointer_array_free(&remembered);
+	pointer_array_free(&always_remembered);
+	pointer_array_free(&gray_objects);
+	for (int i = 0; i < THREADS_MAX; i++) {
+		gray_stack_free(&markers[i].local);
+		gray_stack_free(&markers[i].deferred);
+	}
+}
+
+static HeapPage* new_page(size_t slot_size, size_t size) {
+	HeapPage* page = allocate_aligned(size, HEAP_PAGE_SIZE, "Heap page");
+	page->next = NULL;
+	page->previous = NULL;
+	page->slot_size = slot_size;
+	page->size = size;
+	page->num_used = 0;
+	page->num_young = 0;
+	page->bump_offset = 0;
+	page->free_slots = NULL;
+	memset(page->used_bits, 0, sizeof(page->used_bits));
+	memset(page->mark_bits, 0, sizeof(page->mark_bits));
+	memset(page->old_bits, 0, sizeof(page->old_bits));
+	memset(page->remembered_bits, 0, sizeof(page->remembered_bits));
+	return page;
+}
+
+static void release_page(HeapPage* page) {
+	deallocate_aligned(page, page->size, "Heap page");
+}
+
+static PageList* list_of_page(HeapPage* page) {
+	return page->slot_size > HEAP_MAX_SMALL_SIZE ? &large_pages : &size_classes[page->slot_size / HEAP_GRANULE - 1];
+}
+
+static void append_page(PageList* list, HeapPage* page) {
+	page->next = NULL;
+	page->previous = list->last_page;
+	if (list->last_page == NULL) {
+		list->pages = page;
+	} else {
+		list->last_page->next = page;
+	}
+	list->last_page = page;
+}
+
+static void unlink_page(PageList* list, HeapPage* page) {
+	if (page->previous == NULL) {
+		list->pages = page->next;
+	} else {
+		page->previous->next = page->next;
+	}
+	if (page->next == NULL) {
+		list->last_page = page->previous;
+	} else {
+		page->next->previous = page->previous;
+	}
+	if (list->allocating == page) {
+		list->allocating = page->next;
+	}
+}
+
+static void set_bit(uint64_t* bitmap, size_t granule) {
+	bitmap[granule / 64] |= (uint64_t) 1 << (granule % 64);
+}
+
+static bool test_bit(uint64_t* bitmap, size_t granule) {
+	return (bitmap[granule / 64] & ((uint64_t) 1 << (granule % 64))) != 0;
+}
+
+static int lowest_set_bit(uint64_t word) {
+	#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(word);
+	#else
+	int bit = 0;
+	while ((word & 1) == 0) {
+		word >>= 1;
+		bit++;
+	}
+	return bit;
+	#endif
+}
+
+static void* allocate_from_page(HeapPage* page) {
+	void* slot = NULL;
+
+	if (page->free_slots != NULL) {
+		slot = page->free_slots;
+		page->free_slots = *(void**) slot;
+	} else if (HEAP_PAGE_HEADER_SIZE + page->bump_offset + page->slot_size <= page->size) {
+		slot = HEAP_PAGE_SLOTS(page) + page->bump_offset;
+		page->bump_offset += page->slot_size;
+	} else {
+		return NULL;
+	}
+
+	set_bit(page->used_bits, HEAP_GRANULE_OF(page, slot));
+	page->num_used++;
+	if (page->num_young++ == 0) {
+		pointer_array_write(&young_pages, page);
+	}
+	num_young++;
+
+	/* The new object may be given references the write barrier doesn't see, so it's traced once it's initialized */
+	if (heap_incremental_marking) {
+		set_bit(page->mark_bits, HEAP_GRANULE_OF(page, slot));
+		pointer_array_write(&gray_objects, slot);
+	}
+	return slot;
+}
+
+static Object* allocate_large(size_t size) {
+	HeapPage* page = new_page(size, HEAP_PAGE_HEADER_SIZE + size);
+	append_page(&large_pages, page);
+	return allocate_from_page(page);
+}
+
+Object* heap_allocate(size_t size) {
+	assert(size > 0);
+
+	if (size > HEAP_MAX_SMALL_SIZE) {
+		memory_allocated_total += size;
+		return allocate_large(size);
+	}
+
+	size_t slot_size = (size + HEAP_GRANULE - 1) / HEAP_GRANULE * HEAP_GRANULE;
+	memory_allocated_total += slot_size; /* The pages themselves count in the allocated memory, but not as new allocations */
+	PageList* size_class = &size_classes[slot_size / HEAP_GRANULE - 1];
+
+	for (; size_class->allocating != NULL; size_class->allocating = size_class->allocating->next) {
+		void* slot = allocate_from_page(size_class->allocating);
+		if (slot != NULL) {
+			return slot;
+		}
+	}
+
+	/* All pages are full. New pages go at the end of the list, so the full pages aren't looked at again until the next sweep. */
+	HeapPage* page = new_page(slot_size, HEAP_PAGE_SIZE);
+	append_page(size_class, page);
+	size_class->allocating = page;
+
+	return allocate_from_page(page);
+}
+
+/* Marks the object and returns whether it was already marked */
+static bool heap_mark(Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	size_t granule = HEAP_GRANULE_OF(page, object);
+	uint64_t* word = &page->mark_bits[granule / 64];
+	uint64_t bit = (uint64_t) 1 << (granule % 64);
+
+	if (*word & bit) {
+		return true;
+	}
+	*word |= bit;
+	return false;
+}
+
+static void shade_in_parallel(Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	size_t granule = HEAP_GRANULE_OF(page, object);
+	uint64_t* word = &page->mark_bits[granule / 64];
+	uint64_t bit = (uint64_t) 1 << (granule % 64);
+
+	/* Most objects reached are already marked, and a plain load is cheaper than the atomic operation */
+	if ((threads_load_word(word) & bit) == 0 && (threads_fetch_or(word, bit) & bit) == 0) {
+		gray_stack_push(&current_marker->local, object);
+	}
+}
+
+void heap_shade(Object* object) {
+	if (marking_in_parallel) {
+		shade_in_parallel(object);
+		return;
+	}
+
+	if (!heap_mark(object)) {
+		pointer_array_write(&gray_objects, object);
+	}
+}
+
+bool heap_defer_trace(Object* object) {
+	if (!marking_in_parallel) {
+		return false;
+	}
+
+	gray_stack_push(&current_marker->deferred, object);
+	return true;
+}
+
+/* Moves half of the private gray objects to the pool, if it's empty */
+static void share_gray_objects(Marker* marker) {
+	if (marker->local.count < 2 || threads_load_int(&marker->shared_count) > 0) {
+		return;
+	}
+
+	threads_lock(&marker->lock);
+	size_t count = marker->local.count / 2;
+	if (count > SHARED_GRAY_CAPACITY) {
+		count = SHARED_GRAY_CAPACITY;
+	}
+	for (size_t i = 0; i < count; i++) {
+		marker->shared[i] = marker->local.values[--marker->local.count];
+	}
+	threads_store_int(&marker->shared_count, (int) count);
+	threads_unlock(&marker->lock);
+}
+
+/* Takes all the gray objects in the marker's own pool, or half of those in the pool of another */
+static bool take_gray_objects(Marker* marker, Marker* victim) {
+	if (threads_load_int(&victim->shared_count) == 0) {
+		return false;
+	}
+
+	threads_lock(&victim->lock);
+	int count = victim->shared_count;
+	int taken = victim == marker ? count : (count + 1) / 2;
+	for (int i = 0; i < taken; i++) {
+		gray_stack_push(&marker->local, victim->shared[count - 1 - i]);
+	}
+	threads_store_int(&victim->shared_count, count - taken);
+	threads_unlock(&victim->lock);
+
+	return taken > 0;
+}
+
+static bool find_gray_objects(int index) {
+	for (int i = 0; i < num_markers; i++) {
+		if (take_gray_objects(&markers[index], &markers[(index + i) % num_markers])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool any_shared_gray_objects(void) {
+	for (int i = 0; i < num_markers; i++) {
+		if (threads_load_int(&markers[i].shared_count) > 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Returns true once every thread is out of gray objects, or false as soon as there may be some to steal */
+static bool wait_for_gray_objects(void) {
+	threads_add_int(&idle_markers, 1);
+	for (;;) {
+		if (threads_load_int(&idle_markers) == num_markers) {
+			return true;
+		}
+		if (any_shared_gray_objects()) {
+			threads_add_int(&idle_markers, -1);
+			return false;
+		}
+		threads_yield();
+	}
+}
+
+static void mark_in_parallel(int index, void* argument) {
+	Marker* marker = &markers[index];
+	current_marker = marker;
+
+	do {
+		while (marker->local.count > 0) {
+			parallel_trace(marker->local.values[--marker->local.count]);
+			share_gray_objects(marker);
+		}
+	} while (find_gray_objects(index) || !wait_for_gray_objects());
+
+	current_marker = NULL;
+}
+
+void heap_trace_gray_objects_parallel(int threads, void (*trace)(Object*)) {
+	assert(threads >= 1 && threads <= THREADS_MAX);
+	parallel_trace = trace;
+	num_markers = threads;
+
+	while (gray_objects.count > 0) {
+		for (int i = 0; i < gray_objects.count; i++) {
+			gray_stack_push(&markers[i % threads].local, gray_objects.values[i]);
+		}
+		gray_objects.count = 0;
+		idle_markers = 0;
+
+		marking_in_parallel = true;
+		threads_run(threads, mark_in_parallel, NULL);
+		marking_in_parallel = false;
+
+		/* Tracing them here shades their references onto the gray objects, for another round */
+		for (int i = 0; i < threads; i++) {
+			GrayStack* deferred = &markers[i].deferred;
+			for (size_t j = 0; j < deferred->count; j++) {
+				trace(deferred->values[j]);
+			}
+			deferred->count = 0;
+		}
+	}
+
+	for (int i = 0; i < threads; i++) {
+		if (markers[i].local.capacity > GRAY_OBJECTS_KEEP_CAPACITY) {
+			gray_stack_free(&markers[i].local);
+		}
+	}
+}
+
+Object* heap_pop_gray(void) {
+	return gray_objects.count > 0 ? gray_objects.values[--gray_objects.count] : NULL;
+}
+
+bool heap_is_marked(Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	return test_bit(page->mark_bits, HEAP_GRANULE_OF(page, object));
+}
+
+bool heap_is_allocated(Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	return test_bit(page->used_bits, HEAP_GRANULE_OF(page, object));
+}
+
+void heap_remember(Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	size_t granule = HEAP_GRANULE_OF(page, object);
+	if (!test_bit(page->remembered_bits, granule)) {
+		set_bit(page->remembered_bits, granule);
+		pointer_array_write(&remembered, object);
+	}
+}
+
+void heap_remember_always(Object* object) {
+	pointer_array_write(&always_remembered, object);
+}
+
+void heap_trace_remembered(void (*trace)(Object*)) {
+	for (int i = 0; i < remembered.count; i++) {
+		trace(remembered.values[i]);
+	}
+
+	/* The young ones are marked like any other young object, if they're reachable */
+	for (int i = 0; i < always_remembered.count; i++) {
+		Object* object = always_remembered.values[i];
+		if (!heap_is_young(object)) {
+			trace(object);
+		}
+	}
+}
+
+void heap_trace_always_remembered(void (*trace)(Object*)) {
+	for (int i = 0; i < always_remembered.count; i++) {
+		Object* object = always_remembered.values[i];
+		if (heap_is_marked(object)) {
+			trace(object);
+		}
+	}
+}
+
+size_t heap_num_young(void) {
+	return num_young;
+}
+
+static uint8_t* slot_of_granule(HeapPage* page, size_t word, uint64_t bits) {
+	return HEAP_PAGE_SLOTS(page) + (word * 64 + lowest_set_bit(bits)) * HEAP_GRANULE;
+}
+
+/* The objects a sweep frees: unmarked ones, and only the young or the old ones among them for those kinds of sweeps */
+static uint64_t dead_bits(HeapPage* page, size_t word, HeapSweepKind kind) {
+	uint64_t dead = page->used_bits[word] & ~page->mark_bits[word];
+	switch (kind) {
+		case HEAP_SWEEP_YOUNG: return dead & ~page->old_bits[word];
+		case HEAP_SWEEP_OLD: return dead & page->old_bits[word];
+		case HEAP_SWEEP_ALL: return dead;
+	}
+	return dead;
+}
+
+static bool is_dead(Object* object, HeapSweepKind kind) {
+	return !heap_is_marked(object) && (kind == HEAP_SWEEP_ALL || (kind == HEAP_SWEEP_YOUNG) == heap_is_young(object));
+}
+
+/* A young sweep skips pages with no young objects, since nothing in them was marked or can be freed */
+static bool should_sweep_page(HeapPage* page, HeapSweepKind kind) {
+	return kind != HEAP_SWEEP_YOUNG || page->num_young > 0;
+}
+
+/* Frees either the dead modules or all other dead objects. Returns the number of dead modules found. */
+static size_t finalize_dead_objects(HeapPage* page, bool modules, HeapSweepKind kind) {
+	size_t dead_modules = 0;
+
+	for (size_t word = 0; word < HEAP_BITMAP_WORDS; word++) {
+		for (uint64_t dead = dead_bits(page, word, kind); dead != 0; dead &= dead - 1) {
+			Object* object = (Object*) slot_of_granule(page, word, dead);
+			if (object->type == OBJECT_MODULE) {
+				dead_modules++;
+			}
+			if ((object->type == OBJECT_MODULE) == modules) {
+				object_free(object);
+			}
+		}
+	}
+
+	return dead_modules;
+}
+
+/* Puts the slots of the dead objects on the free list and clears the marks. Young and full sweeps promote the survivors,
+   while an old sweep leaves the young objects young. Returns whether the page is now empty. */
+static bool reclaim_dead_slots(HeapPage* page, HeapSweepKind kind) {
+	for (size_t word = 0; word < HEAP_BITMAP_WORDS; word++) {
+		uint64_t dead = dead_bits(page, word, kind);
+
+		for (uint64_t remaining = dead; remaining != 0; remaining &= remaining - 1) {
+			uint8_t* slot = slot_of_granule(page, word, remaining);
+
+			#if MEMORY_DIAGNOSTICS
+			memset(slot, FREED_SLOT_POISON, page->slot_size);
+			#endif
+
+			*(void**) slot = page->free_slots;
+			page->free_slots = slot;
+			page->num_used--;
+		}
+
+		page->used_bits[word] &= ~dead;
+		page->old_bits[word] = kind == HEAP_SWEEP_OLD ? page->old_bits[word] & ~dead : page->used_bits[word];
+		page->remembered_bits[word] &= ~dead;
+		page->mark_bits[word] = 0;
+	}
+
+	if (kind != HEAP_SWEEP_OLD) {
+		page->num_young = 0;
+	}
+	return page->num_used == 0;
+}
+
+/* Once every object is old, nothing has to be remembered. After an old sweep, the remembered objects which survived
+   still have to be, for the young objects allocated during the incremental collection. */
+static void forget_remembered_objects(HeapSweepKind kind) {
+	int kept = 0;
+	for (int i = 0; i < remembered.count; i++) {
+		Object* object = remembered.values[i];
+		if (kind == HEAP_SWEEP_OLD && !is_dead(object, kind)) {
+			remembered.values[kept++] = object;
+		} else {
+			HeapPage* page = HEAP_PAGE_OF(object);
+			size_t granule = HEAP_GRANULE_OF(page, object);
+			page->remembered_bits[granule / 64] &= ~((uint64_t) 1 << (granule % 64));
+		}
+	}
+	remembered.count = kept;
+
+	kept = 0;
+	for (int i = 0; i < always_remembered.count; i++) {
+		Object* object = always_remembered.values[i];
+		if (!is_dead(object, kind)) {
+			always_remembered.values[kept++] = object;
+		}
+	}
+	always_remembered.count = kept;
+}
+
+/* Dead objects are all finalized before any of their slots are reclaimed, since finalizing an object may still read
+   another dead object - for example, an instance of a native class needs its class to find its deallocation function.
+   Modules go last, because freeing an extension module unloads the code which deallocates its instances.
+   So a sweep passes over the pages up to three times, and a lazy sweep keeps its position in between steps. */
+typedef enum {
+	SWEEP_FINALIZE_OBJECTS,
+	SWEEP_FINALIZE_MODULES,
+	SWEEP_RECLAIM,
+	SWEEP_DONE
+} SweepPhase;
+
+static struct {
+	HeapSweepKind kind;
+	SweepPhase phase;
+	int size_class; /* HEAP_NUM_SIZE_CLASSES for the large pages */
+	HeapPage* page; /* The next page to finalize or reclaim. Pages allocated meanwhile are added after it */
+	size_t dead_modules;
+} sweep = {.phase = SWEEP_DONE};
+
+static PageList* page_list(int size_class) {
+	return size_class < HEAP_NUM_SIZE_CLASSES ? &size_classes[size_class] : &large_pages;
+}
+
+static void start_sweep_phase(SweepPhase phase) {
+	sweep.phase = phase;
+	sweep.size_class = 0;
+	sweep.page = page_list(0)->pages;
+}
+
+static void finalize_step(void) {
+	if (sweep.page != NULL) {
+		if (should_sweep_page(sweep.page, sweep.kind)) {
+			sweep.dead_modules += finalize_dead_objects(sweep.page, sweep.phase == SWEEP_FINALIZE_MODULES, sweep.kind);
+		}
+		sweep.page = sweep.page->next;
+		return;
+	}
+
+	if (sweep.size_class < HEAP_NUM_SIZE_CLASSES) {
+		sweep.size_class++;
+		sweep.page = page_list(sweep.size_class)->pages;
+		return;
+	}
+
+	if (sweep.phase == SWEEP_FINALIZE_OBJECTS && sweep.dead_modules > 0) {
+		start_sweep_phase(SWEEP_FINALIZE_MODULES);
+	} else {
+		forget_remembered_objects(sweep.kind);
+		start_sweep_phase(SWEEP_RECLAIM);
+	}
+}
+
+static void reclaim_step(void) {
+	PageList* list = page_list(sweep.size_class);
+	HeapPage* page = sweep.page;
+
+	if (page != NULL) {
+		sweep.page = page->next;
+		if (should_sweep_page(page, sweep.kind) && reclaim_dead_slots(page, sweep.kind)) {
+			/* An old sweep leaves the young objects, so the young pages never become empty */
+			assert(sweep.kind != HEAP_SWEEP_OLD || page->num_young == 0);
+			unlink_page(list, page);
+			release_page(page);
+		}
+		return;
+	}
+
+	list->allocating = list->pages;
+
+	if (sweep.size_class < HEAP_NUM_SIZE_CLASSES) {
+		sweep.size_class++;
+		sweep.page = page_list(sweep.size_class)->pages;
+		return;
+	}
+
+	if (sweep.kind != HEAP_SWEEP_OLD) {
+		young_pages.count = 0;
+		num_young = 0;
+	}
+	sweep.phase = SWEEP_DONE;
+}
+
+typedef struct {
+	PointerArray pages;
+	int threads;
+} ParallelReclaim;
+
+static void reclaim_region(int index, void* argument) {
+	ParallelReclaim* reclaim = argument;
+	int begin = (int) ((int64_t) reclaim->pages.count * index / reclaim->threads);
+	int end = (int) ((int64_t) reclaim->pages.count * (index + 1) / reclaim->threads);
+	for (int i = begin; i < end; i++) {
+		reclaim_dead_slots(reclaim->pages.values[i], sweep.kind);
+	}
+}
+
+/* Does the whole reclaim phase at once, with the pages split between the threads in contiguous regions.
+   Releasing the pages left empty changes the page lists and the tracked memory, so that's still done by this thread. */
+static void reclaim_in_parallel(int threads) {
+	assert(sweep.phase == SWEEP_RECLAIM && sweep.kind != HEAP_SWEEP_OLD);
+
+	ParallelReclaim reclaim = {.threads = threads};
+	pointer_array_init(&reclaim.pages, "Pages to reclaim");
+	for (int size_class = 0; size_class <= HEAP_NUM_SIZE_CLASSES; size_class++) {
+		for (HeapPage* page = page_list(size_class)->pages; page != NULL; page = page->next) {
+			if (should_sweep_page(page, sweep.kind)) {
+				pointer_array_write(&reclaim.pages, page);
+			}
+		}
+	}
+
+	threads_run(threads, reclaim_region, &reclaim);
+
+	for (int i = 0; i < reclaim.pages.count; i++) {
+		HeapPage* page = reclaim.pages.values[i];
+		if (page->num_used == 0) {
+			unlink_page(list_of_page(page), page);
+			release_page(page);
+		}
+	}
+	pointer_array_free(&reclaim.pages);
+
+	for (int size_class = 0; size_class <= HEAP_NUM_SIZE_CLASSES; size_class++) {
+		page_list(size_class)->allocating = page_list(size_class)->pages;
+	}
+	young_pages.count = 0;
+	num_young = 0;
+	sweep.phase = SWEEP_DONE;
+}
+
+/* Moves a page which got free slots to the end of its list, so that allocation gets to it without starting over from the first page */
+static void requeue_page(PageList* list, HeapPage* page) {
+	if (page != list->last_page) {
+		unlink_page(list, page);
+		append_page(list, page);
+	}
+	if (list->allocating == NULL) {
+		list->allocating = page;
+	}
+}
+
+/* A minor collection only sweeps the pages which young objects were allocated in, so that its pause
+   doesn't grow with the old generation */
+static void sweep_young_pages(void) {
+	size_t dead_modules = 0;
+	for (int i = 0; i < young_pages.count; i++) {
+		dead_modules += finalize_dead_objects(young_pages.values[i], false, HEAP_SWEEP_YOUNG);
+	}
+	if (dead_modules > 0) {
+		for (int i = 0; i < young_pages.count; i++) {
+			finalize_dead_objects(young_pages.values[i], true, HEAP_SWEEP_YOUNG);
+		}
+	}
+
+	forget_remembered_objects(HEAP_SWEEP_YOUNG);
+
+	for (int i = 0; i < young_pages.count; i++) {
+		HeapPage* page = young_pages.values[i];
+		PageList* list = list_of_page(page);
+		size_t used_before = page->num_used;
+
+		if (reclaim_dead_slots(page, HEAP_SWEEP_YOUNG)) {
+			unlink_page(list, page);
+			release_page(page);
+		} else if (page->num_used < used_before && list != &large_pages) {
+			requeue_page(list, page);
+		}
+	}
+
+	young_pages.count = 0;
+	num_young = 0;
+}
+
+/* Marking a wide structure may have grown the gray objects a lot. Don't hold on to that memory until the next collection. */
+static void release_gray_objects(void) {
+	assert(gray_objects.count == 0);
+	if (gray_objects.capacity > GRAY_OBJECTS_KEEP_CAPACITY) {
+		pointer_array_free(&gray_objects);
+	}
+}
+
+void heap_begin_sweep(HeapSweepKind kind) {
+	assert(sweep.phase == SWEEP_DONE);
+	release_gray_objects();
+
+	sweep.kind = kind;
+	sweep.dead_modules = 0;
+	start_sweep_phase(SWEEP_FINALIZE_OBJECTS);
+}
+
+static void sweep_unit(void) {
+	if (sweep.phase == SWEEP_RECLAIM) {
+		reclaim_step();
+	} else {
+		finalize_step();
+	}
+}
+
+bool heap_sweep_step(clock_t deadline) {
+	while (sweep.phase != SWEEP_DONE) {
+		sweep_unit();
+		if (clock() >= deadline) {
+			break;
+		}
+	}
+
+	return sweep.phase == SWEEP_DONE;
+}
+
+void heap_finish_sweep(void) {
+	while (sweep.phase != SWEEP_DONE) {
+		sweep_unit();
+	}
+}
+
+void heap_sweep(HeapSweepKind kind, int threads) {
+	if (kind == HEAP_SWEEP_YOUNG) {
+		assert(sweep.phase == SWEEP_DONE);
+		release_gray_objects();
+		sweep_young_pages();
+		return;
+	}
+
+	heap_begin_sweep(kind);
+
+	/* Finalizing frees memory and touches the string cache, so only reclaiming the slots can be done in parallel */
+	if (threads > 1) {
+		while (sweep.phase != SWEEP_RECLAIM) {
+			sweep_unit();
+		}
+		reclaim_in_parallel(threads);
+	}
+
+	heap_finish_sweep();
+}
+
+bool heap_is_condemned(Object* object) {
+	/* Once the dead objects are finalized they're out of every weak reference. Reclaiming clears the marks, so it can't tell. */
+	bool finalizing = sweep.phase == SWEEP_FINALIZE_OBJECTS || sweep.phase == SWEEP_FINALIZE_MODULES;
+	return finalizing && is_dead(object, sweep.kind);
+}
+
+size_t heap_num_pages(void) {
+	size_t count = 0;
+	for (int i = 0; i < HEAP_NUM_SIZE_CLASSES; i++) {
+		for (HeapPage* page = size_classes[i].pages; page != NULL; page = page->next) {
+			count++;
+		}
+	}
+	for (HeapPage* page = large_pages.pages; page != NULL; page = page->next) {
+		count++;
+	}
+	return count;
+}
+
+/* Moves the iterator to the first page of the first size class from the given one which has pages, and after them to the large pages */
+static void iterate_from_size_class(HeapIterator* iterator, int size_class) {
+	for (; size_class < HEAP_NUM_SIZE_CLASSES; size_class++) {
+		if (size_classes[size_class].pages != NULL) {
+			iterator->size_class = size_class;
+			iterator->page = size_classes[size_class].pages;
+			return;
+		}
+	}
+
+	iterator->size_class = HEAP_NUM_SIZE_CLASSES;
+	iterator->page = large_pages.pages;
+}
+
+void heap_iterator_init(HeapIterator* iterator) {
+	iterator->granule = 0;
+	iterate_from_size_class(iterator, 0);
+}
+
+bool heap_iterator_next(HeapIterator* iterator, Object** object) {
+	while (iterator->page != NULL) {
+		HeapPage* page = iterator->page;
+
+		for (size_t granule = iterator->granule; granule < HEAP_BITMAP_WORDS * 64; granule++) {
+			if (test_bit(page->used_bits, granule)) {
+				*object = (Object*) (HEAP_PAGE_SLOTS(page) + granule * HEAP_GRANULE);
+				iterator->granule = granule + 1;
+				return true;
+			}
+		}
+
+		iterator->granule = 0;
+		if (page->next != NULL) {
+			iterator->page = page->next;
+		} else if (iterator->size_class < HEAP_NUM_SIZE_CLASSES) {
+			iterate_from_size_class(iterator, iterator->size_class + 1);
+		} else {
+			iterator->page = NULL;
+		}
+	}
+
+	return false;
+}
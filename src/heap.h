@@ -0,0 +1,147 @@
+#ifndef ribbon_heap_h
+#define ribbon_heap_h
+
+#include <time.h>
+
+#include "common.h"
+#include "value.h"
+
+/* The heap which objects are allocated from. Small objects are carved out of pages, each holding slots of a single size class.
+   Large objects get a page of their own. Pages are aligned to their size, so an object finds its page by masking its address.
+   Mark bits live in a bitmap in the page header rather than in the objects, and the heap sweeps page by page,
+   freeing the objects which are allocated but weren't marked.
+
+   The heap is split into two generations. Objects are allocated young, and become old once they survive a collection.
+   Objects never move, since native code holds plain pointers to them, so promoting an object only sets its bit in the old bitmap.
+   A minor collection marks and sweeps only the young objects. Old objects are assumed alive, so the young objects which only
+   old objects point to are found through the remembered set: the old objects which had a young object stored into them
+   since the last collection. Every such store has to go through heap_write_barrier.
+
+   Marking is driven by a worklist of gray objects: marked objects whose references weren't marked yet. In incremental mode,
+   collection of the old generation is done in small steps interleaved with the program. While heap_incremental_marking is set,
+   the write barrier also shades every stored object, and new objects are allocated gray, so that nothing the program
+   moves around behind the marker is missed. Sweeping is lazy as well, and only frees old objects - young objects
+   allocated meanwhile are left for the following minor collections.
+
+   Full collections which stop the world can mark and sweep on several threads. */
+
+#define HEAP_PAGE_SIZE ((size_t) 64 * 1024)
+#define HEAP_GRANULE 16 /* Slot sizes are multiples of this. Bitmaps have a bit for each granule of a page */
+#define HEAP_MAX_SMALL_SIZE 1024 /* Bigger objects are allocated in a page of their own */
+#define HEAP_NUM_SIZE_CLASSES (HEAP_MAX_SMALL_SIZE / HEAP_GRANULE)
+#define HEAP_BITMAP_WORDS (HEAP_PAGE_SIZE / HEAP_GRANULE / 64)
+
+struct Object;
+
+typedef struct HeapPage {
+	struct HeapPage* next;
+	struct HeapPage* previous;
+	size_t slot_size;
+	size_t size; /* Size of the whole page. HEAP_PAGE_SIZE, except for large object pages */
+	size_t num_used; /* Slots holding live objects */
+	size_t num_young; /* Objects allocated in the page since the last collection */
+	size_t bump_offset; /* Slots from this offset on were never allocated */
+	void* free_slots; /* Freed slots, linked through their first word */
+	uint64_t used_bits[HEAP_BITMAP_WORDS]; /* Set at the first granule of every allocated slot */
+	uint64_t mark_bits[HEAP_BITMAP_WORDS];
+	uint64_t old_bits[HEAP_BITMAP_WORDS];
+	uint64_t remembered_bits[HEAP_BITMAP_WORDS];
+} HeapPage;
+
+#define HEAP_PAGE_HEADER_SIZE ((sizeof(HeapPage) + HEAP_GRANULE - 1) / HEAP_GRANULE * HEAP_GRANULE)
+#define HEAP_PAGE_SLOTS(page) ((uint8_t*) (page) + HEAP_PAGE_HEADER_SIZE)
+#define HEAP_PAGE_OF(object) ((HeapPage*) ((uintptr_t) (object) & ~(uintptr_t) (HEAP_PAGE_SIZE - 1)))
+#define HEAP_GRANULE_OF(page, object) ((size_t) ((uint8_t*) (object) - HEAP_PAGE_SLOTS(page)) / HEAP_GRANULE)
+
+void heap_init(void);
+void heap_free(void);
+
+struct Object* heap_allocate(size_t size);
+
+/* Marks the object and pushes it onto the gray objects, unless it was already marked */
+void heap_shade(struct Object* object);
+struct Object* heap_pop_gray(void); /* NULL once there are no gray objects left */
+
+/* Traces the gray objects and everything reachable from them, on the given number of threads. Mark bits are set atomically,
+   and trace may be called on any of the threads, so it must not allocate or free memory. Objects which need to can be handed
+   to heap_defer_trace, and they're traced on this thread once the others are done. */
+void heap_trace_gray_objects_parallel(int threads, void (*trace)(struct Object*));
+/* Returns false, and leaves the object alone, outside of parallel marking */
+bool heap_defer_trace(struct Object* object);
+
+bool heap_is_marked(struct Object* object);
+bool heap_is_allocated(struct Object* object); /* For assertions */
+
+static inline bool heap_is_young(struct Object* object) {
+	HeapPage* page = HEAP_PAGE_OF(object);
+	size_t granule = HEAP_GRANULE_OF(page, object);
+	return (page->old_bits[granule / 64] & ((uint64_t) 1 << (granule % 64))) == 0;
+}
+
+void heap_remember(struct Object* object);
+
+/* Objects whose references can't go through the write barrier, like instances of native classes with a GcMarkFunction.
+   They're traced in every minor collection for as long as they live. */
+void heap_remember_always(struct Object* object);
+
+extern bool heap_incremental_marking;
+
+/* Call after storing value into an object which may have survived a collection. Stores into an object allocated
+   since the last safepoint of the interpreter loop don't need it, since no collection ran in between. */
+static inline void heap_write_barrier(struct Object* object, Value value) {
+	if (!VALUE_IS_OBJECT(value)) {
+		return;
+	}
+
+	struct Object* target = VALUE_AS_OBJECT(value);
+	if (heap_incremental_marking) {
+		heap_shade(target);
+	}
+	if (heap_is_young(target) && !heap_is_young(object)) {
+		heap_remember(object);
+	}
+}
+
+/* Calls trace for every old object in the remembered set, whose references a minor collection has to mark */
+void heap_trace_remembered(void (*trace)(struct Object*));
+
+/* Calls trace for every marked object in the always remembered set, since their references may have changed after they were traced */
+void heap_trace_always_remembered(void (*trace)(struct Object*));
+
+size_t heap_num_young(void);
+
+typedef enum {
+	HEAP_SWEEP_YOUNG, /* After a minor collection */
+	HEAP_SWEEP_ALL, /* After a full collection */
+	HEAP_SWEEP_OLD /* After incremental marking */
+} HeapSweepKind;
+
+/* Frees the objects of the kind which weren't marked since the last sweep, and clears the marks. After young and full sweeps
+   the surviving objects become old. Pages left empty are released. A young sweep only looks at the pages young objects were
+   allocated in, so its cost doesn't grow with the old generation. With more than one thread, a full sweep reclaims the pages
+   in parallel. */
+void heap_sweep(HeapSweepKind kind, int threads);
+
+/* The same, lazily: heap_sweep_step sweeps until the deadline, and returns whether the sweep is done.
+   Objects may be allocated in between the steps. */
+void heap_begin_sweep(HeapSweepKind kind);
+bool heap_sweep_step(clock_t deadline);
+void heap_finish_sweep(void);
+
+/* Whether the object is going to be freed by the lazy sweep in progress. Weak references, like those of the string cache,
+   must not hand out such objects. */
+bool heap_is_condemned(struct Object* object);
+
+size_t heap_num_pages(void);
+
+/* Visits all allocated objects */
+typedef struct {
+	HeapPage* page;
+	int size_class; /* HEAP_NUM_SIZE_CLASSES for the large object pages */
+	size_t granule;
+} HeapIterator;
+
+void heap_iterator_init(HeapIterator* iterator);
+bool heap_iterator_next(HeapIterator* iterator, struct Object** object);
+
+#endif
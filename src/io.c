@@ -75,7 +75,7 @@ IOResult io_read_binary_file(const char* file_name, Table* data_out) {
         table_set(data_out, MAKE_VALUE_NUMBER(i), value);
     }
 
-    RIBBON_ASSERT(data_out->num_entries == integer_array.count, "Data buffer from file and table have a different count");
+    RIBBON_ASSERT(table_length(data_out) == integer_array.count, "Data buffer from file and table have a different count");
 
     cleanup:
 	integer_array_free(&integer_array);
@@ -116,7 +116,7 @@ IOResult io_write_binary_file(const char* file_name, Table* data) {
         goto cleanup;
     }
 
-    for (int i = 0; i < data->num_entries; i++) {
+    for (size_t i = 0; i < table_length(data); i++) {
         Value value;
 
         if (!table_get(data, MAKE_VALUE_NUMBER(i), &value)) {
@@ -124,13 +124,13 @@ IOResult io_write_binary_file(const char* file_name, Table* data) {
             goto cleanup;
         }
 
-        if (value.as.number != floor(value.as.number)) {
+        if (VALUE_AS_NUMBER(value) != floor(VALUE_AS_NUMBER(value))) {
             result = IO_WRITE_FILE_FAILURE;
             goto cleanup;
         }
 
-        const int byte = (int) value.as.number;
-        if (fputc(value.as.number, file) == EOF) {
+        const int byte = (int) VALUE_AS_NUMBER(value);
+        if (fputc(VALUE_AS_NUMBER(value), file) == EOF) {
             result = IO_WRITE_FILE_FAILURE;
             goto cleanup;
         }
@@ -14,6 +14,7 @@
 #include "ribbon_object.h"
 #include "vm.h"
 #include "memory.h"
+#include "threads.h"
 
 static bool checkCmdArg(char** argv, int argc, int index, const char* value) {
 	return argc >= index + 1 && strncmp(argv[index], value, strlen(value)) == 0;
@@ -29,6 +30,117 @@ static bool cmdArgExists(char** argv, int argc, const char* value) {
 	return false;
 }
 
+/* Returns the argument which starts with the prefix, or NULL if there is none */
+static char* findCmdArg(char** argv, int argc, const char* prefix) {
+	for (int i = 0; i < argc; i++) {
+		if (checkCmdArg(argv, argc, i, prefix)) {
+			return argv[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* The value of a -flag=<value> argument, or else of the environment variable. NULL if neither is set. */
+static char* findSetting(char** argv, int argc, const char* flag, const char* env_name) {
+	char* arg = findCmdArg(argv, argc, flag);
+	if (arg != NULL) {
+		return arg + strlen(flag);
+	}
+
+	return getenv(env_name);
+}
+
+/* A number of bytes, with an optional K, M or G suffix */
+static bool parseMemorySize(const char* text, size_t* out) {
+	char* end;
+	double size = strtod(text, &end);
+	if (end == text || size < 0) {
+		return false;
+	}
+
+	switch (*end) {
+		case 'k': case 'K': size *= 1024; end++; break;
+		case 'm': case 'M': size *= 1024 * 1024; end++; break;
+		case 'g': case 'G': size *= 1024 * 1024 * 1024; end++; break;
+	}
+
+	if (*end != '\0') {
+		return false;
+	}
+
+	*out = (size_t) size;
+	return true;
+}
+
+/* -gcincremental collects the old generation in steps interleaved with the program. -gcpause=<ms> sets how long each
+   step aims to take, and implies -gcincremental.
+   -gcgrowth=<factor>, -gcminheap=<size> and -gcsoftlimit=<size> pace the full collections. Without the flags they're taken
+   from RIBBON_GC_GROWTH, RIBBON_GC_MIN_HEAP and RIBBON_GC_SOFT_LIMIT in the environment.
+   -gcthreads=<count> (or RIBBON_GC_THREADS) sets how many threads mark and sweep in full collections. */
+static void configureGc(int argc, char* argv[]) {
+	if (cmdArgExists(argv, argc, "-gcincremental")) {
+		vm.gc_incremental = true;
+	}
+
+	char* pause_arg = findCmdArg(argv, argc, "-gcpause=");
+	if (pause_arg != NULL) {
+		double pause_target = atof(pause_arg + strlen("-gcpause="));
+		if (pause_target > 0) {
+			vm.gc_incremental = true;
+			vm.gc_pause_target = pause_target;
+		} else {
+			fprintf(stdout, "Ignoring invalid GC pause target: %s\n", pause_arg);
+		}
+	}
+
+	char* growth_factor = findSetting(argv, argc, "-gcgrowth=", "RIBBON_GC_GROWTH");
+	if (growth_factor != NULL) {
+		if (atof(growth_factor) > 1) {
+			vm.gc_growth_factor = atof(growth_factor);
+		} else {
+			fprintf(stdout, "Ignoring invalid GC growth factor: %s\n", growth_factor);
+		}
+	}
+
+	char* min_heap = findSetting(argv, argc, "-gcminheap=", "RIBBON_GC_MIN_HEAP");
+	if (min_heap != NULL && !parseMemorySize(min_heap, &vm.gc_min_heap)) {
+		fprintf(stdout, "Ignoring invalid GC minimum heap size: %s\n", min_heap);
+	}
+
+	char* soft_limit = findSetting(argv, argc, "-gcsoftlimit=", "RIBBON_GC_SOFT_LIMIT");
+	if (soft_limit != NULL && !parseMemorySize(soft_limit, &vm.gc_soft_limit)) {
+		fprintf(stdout, "Ignoring invalid GC soft memory limit: %s\n", soft_limit);
+	}
+
+	char* threads = findSetting(argv, argc, "-gcthreads=", "RIBBON_GC_THREADS");
+	if (threads != NULL) {
+		int count = atoi(threads);
+		if (count >= 1 && count <= THREADS_MAX) {
+			vm.gc_threads = count;
+		} else {
+			fprintf(stdout, "Ignoring invalid GC thread count: %s\n", threads);
+		}
+	}
+
+	vm_update_gc_threshold();
+}
+
+/* -maxcalldepth=<frames> (or RIBBON_MAX_CALL_DEPTH) sets how deep calls may nest before failing with a stack overflow.
+   0 leaves the depth limited only by memory. */
+static void configureCallDepth(int argc, char* argv[]) {
+	char* max_depth = findSetting(argv, argc, "-maxcalldepth=", "RIBBON_MAX_CALL_DEPTH");
+	if (max_depth != NULL) {
+		char* end;
+		long long depth = strtoll(max_depth, &end, 10);
+		if (end != max_depth && *end == '\0' && depth >= 0) {
+			vm.max_call_depth = (size_t) depth;
+		} else {
+			fprintf(stdout, "Ignoring invalid maximal call depth: %s\n", max_depth);
+		}
+	}
+}
+
 static void printStructures(int argc, char* argv[], Bytecode* chunk, AstNode* ast) {
     bool showBytecode = cmdArgExists(argv, argc, "-asm");
     bool showTree = cmdArgExists(argv, argc, "-tree");
@@ -83,8 +195,9 @@ static void print_memory_diagnostic() {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 5) {
-        fprintf(stdout, "Usage: ribbon <file> [[-asm] [-tree] [-dry]]");
+    if (argc < 2 || argc > 13) {
+        fprintf(stdout, "Usage: ribbon <file> [[-asm] [-tree] [-dry] [-gcstats] [-gcincremental] [-gcpause=<ms>] "
+                "[-gcgrowth=<factor>] [-gcminheap=<size>] [-gcsoftlimit=<size>] [-gcthreads=<count>] [-maxcalldepth=<frames>]]");
         return -1;
     }
 
@@ -116,6 +229,8 @@ int main(int argc, char* argv[]) {
 
     /* Must first init the VM because some parts of the compiler depend on it */
     vm_init();
+    configureGc(argc, argv);
+    configureCallDepth(argc, argv);
 
     Bytecode bytecode;
     bytecode_init(&bytecode);
@@ -129,6 +244,9 @@ int main(int argc, char* argv[]) {
     bool dryRun = checkCmdArg(argv, argc, 2, "-dry") || checkCmdArg(argv, argc, 3, "-dry") || checkCmdArg(argv, argc, 4, "-dry");
     if (!dryRun) {
     	bool result = vm_interpret_program(&bytecode, abs_main_file_path);
+    	if (cmdArgExists(argv, argc, "-gcstats")) {
+    		vm_print_gc_stats();
+    	}
     }
     
     vm_free();
@@ -2,17 +2,126 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <malloc.h>
 
 #include "memory.h"
 #include "common.h"
-#include "table.h"
 
-static Table allocations;
-static size_t allocated_memory = 0;
+/* The allocations map tracks every live allocation by its address, for the MEMORY_DIAGNOSTICS checks.
+   It uses malloc() directly, since it can't track its own memory. */
+
+#define ALLOCATIONS_LOAD_FACTOR 0.75
+
+typedef struct {
+    void* pointer; /* NULL for an empty slot */
+    Allocation allocation;
+    bool tombstone;
+} AllocationEntry;
+
+typedef struct {
+    AllocationEntry* entries;
+    size_t capacity;
+    size_t count; /* Number of entries + tombstones, for determining when to grow */
+    size_t num_entries;
+} AllocationsMap;
+
+static AllocationsMap allocations;
+static size_t allocated_memory = 0; /* Tracked in every build, since the GC paces itself by it */
+size_t memory_allocated_total = 0;
+
+static size_t hash_pointer(void* pointer) {
+    uintptr_t address = (uintptr_t) pointer;
+    return (size_t) ((address >> 4) ^ (address >> 16));
+}
+
+static AllocationEntry* find_allocation(void* pointer) {
+    if (allocations.capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = allocations.capacity - 1;
+    for (size_t index = hash_pointer(pointer) & mask; ; index = (index + 1) & mask) {
+        AllocationEntry* entry = &allocations.entries[index];
+        if (entry->pointer == pointer) {
+            return entry;
+        }
+        if (entry->pointer == NULL && !entry->tombstone) {
+            return NULL;
+        }
+    }
+}
+
+static void insert_allocation(AllocationEntry* entries, size_t capacity, void* pointer, Allocation allocation) {
+    /* Only used when growing, where the new entries array has no tombstones */
+    size_t mask = capacity - 1;
+    size_t index = hash_pointer(pointer) & mask;
+    while (entries[index].pointer != NULL) {
+        index = (index + 1) & mask;
+    }
+    entries[index].pointer = pointer;
+    entries[index].allocation = allocation;
+}
+
+static void grow_allocations(void) {
+    size_t new_capacity = allocations.capacity < 64 ? 64 : allocations.capacity;
+    if (allocations.num_entries + 1 > new_capacity * ALLOCATIONS_LOAD_FACTOR / 2) {
+        new_capacity *= 2; /* Otherwise it's mostly tombstones, and rehashing in place clears them */
+    }
+    AllocationEntry* new_entries = calloc(new_capacity, sizeof(AllocationEntry));
+    if (new_entries == NULL) {
+        FAIL("Couldn't allocate memory for the allocations map.");
+    }
+
+    for (size_t i = 0; i < allocations.capacity; i++) {
+        AllocationEntry* entry = &allocations.entries[i];
+        if (entry->pointer != NULL) {
+            insert_allocation(new_entries, new_capacity, entry->pointer, entry->allocation);
+        }
+    }
+
+    free(allocations.entries);
+    allocations.entries = new_entries;
+    allocations.capacity = new_capacity;
+    allocations.count = allocations.num_entries;
+}
+
+static void add_allocation(void* pointer, const char* name, size_t size) {
+    if (allocations.count + 1 > allocations.capacity * ALLOCATIONS_LOAD_FACTOR) {
+        grow_allocations();
+    }
+
+    size_t mask = allocations.capacity - 1;
+    size_t index = hash_pointer(pointer) & mask;
+    while (allocations.entries[index].pointer != NULL) {
+        index = (index + 1) & mask;
+    }
+
+    AllocationEntry* entry = &allocations.entries[index];
+    if (!entry->tombstone) {
+        allocations.count++;
+    }
+    entry->pointer = pointer;
+    entry->allocation = (Allocation) {.name = name, .size = size};
+    entry->tombstone = false;
+    allocations.num_entries++;
+}
+
+static bool remove_allocation(void* pointer) {
+    AllocationEntry* entry = find_allocation(pointer);
+    if (entry == NULL) {
+        return false;
+    }
+    entry->pointer = NULL;
+    entry->tombstone = true;
+    allocations.num_entries--;
+    return true;
+}
 
 void memory_init(void) {
-    table_init_memory_infrastructure(&allocations);
+    free(allocations.entries);
+    allocations = (AllocationsMap) {.entries = NULL, .capacity = 0, .count = 0, .num_entries = 0};
     allocated_memory = 0; // For consistency
+    memory_allocated_total = 0;
 }
 
 size_t get_allocated_memory() {
@@ -23,6 +132,13 @@ size_t get_allocations_count() {
     return allocations.num_entries;
 }
 
+static void count_reallocation(size_t old_size, size_t new_size) {
+    allocated_memory = allocated_memory - old_size + new_size;
+    if (new_size > old_size) {
+        memory_allocated_total += new_size - old_size;
+    }
+}
+
 static bool is_same_allocation(size_t size, const char* what, Allocation allocation) {
     return (allocation.size == size) && (strcmp(allocation.name, what) == 0);
 }
@@ -37,7 +153,9 @@ void* allocate(size_t size, const char* what) {
 
     #else
 
-    return allocate_no_tracking(size);
+    void* pointer = allocate_no_tracking(size);
+    count_reallocation(0, size);
+    return pointer;
 
     #endif
 }
@@ -49,6 +167,7 @@ void deallocate(void* pointer, size_t oldSize, const char* what) {
 
     #else
 
+    allocated_memory -= oldSize;
     return deallocate_no_tracking(pointer);
 
     #endif
@@ -58,7 +177,7 @@ static void* do_deallocation(void* pointer, size_t old_size, const char* what) {
     // We allow the pointer to be NULL, and if it is we do nothing
 
     if (pointer != NULL) {
-        if (!table_delete(&allocations, MAKE_VALUE_ADDRESS(pointer))) {
+        if (!remove_allocation(pointer)) {
             FAIL("Couldn't remove existing key in allocations table: %p. Allocation tag: '%s'", pointer, what);
         }
     }
@@ -81,26 +200,19 @@ static void* do_reallocation(void* pointer, size_t old_size, size_t new_size, co
         return NULL;
     }
 
-    Value allocation_out;
-    if (table_get(&allocations, MAKE_VALUE_ADDRESS(pointer), &allocation_out)) {
-        Allocation existing = allocation_out.as.allocation;
-        if (!is_same_allocation(old_size, what, existing)) {
+    AllocationEntry* existing = find_allocation(pointer);
+    if (existing != NULL) {
+        if (!is_same_allocation(old_size, what, existing->allocation)) {
             FAIL("When attempting relocation, table returned wrong allocation marker.");
         }
 
-        if (table_delete(&allocations, MAKE_VALUE_ADDRESS(pointer))) {
-            Value new_allocation_key = MAKE_VALUE_ADDRESS(newpointer);
-            Value new_allocation = MAKE_VALUE_ALLOCATION(what, new_size);
-            table_set(&allocations, new_allocation_key, new_allocation);
-        } else {
-            FAIL("In reallocation, couldn't remove entry which was found in the table.");
-        }
+        remove_allocation(pointer);
+        add_allocation(newpointer, what, new_size);
     } else {
         FAIL("memory do_reallocation(): Couldn't find marker to replace.");
     }
     
-    allocated_memory -= old_size;
-    allocated_memory += new_size;
+    count_reallocation(old_size, new_size);
     
     return newpointer;
 }
@@ -114,8 +226,8 @@ static void* do_allocation(void* pointer, size_t new_size, const char* what) {
         FAIL("Couldn't allocate new memory."); // Temp
     }
 
-    table_set(&allocations, MAKE_VALUE_ADDRESS(pointer), MAKE_VALUE_ALLOCATION(what, new_size));
-    allocated_memory += new_size;
+    add_allocation(pointer, what, new_size);
+    count_reallocation(0, new_size);
 
     return pointer;
 }
@@ -136,13 +248,48 @@ void* reallocate(void* pointer, size_t old_size, size_t new_size, const char* wh
     #else
 
     if (new_size == 0) {
+        allocated_memory -= old_size;
         deallocate_no_tracking(pointer);
         return NULL;
     }
 
-    return reallocate_no_tracking(pointer, new_size);
+    void* new_pointer = reallocate_no_tracking(pointer, new_size);
+    count_reallocation(old_size, new_size);
+    return new_pointer;
+
+    #endif
+}
+
+/* For memory which has to start at a multiple of the alignment. Can't be reallocated. */
+void* allocate_aligned(size_t size, size_t alignment, const char* what) {
+    if (size <= 0) {
+        FAIL("allocate_aligned :: size <= 0");
+    }
+
+    void* pointer = _aligned_malloc(size, alignment);
+    if (pointer == NULL) {
+        FAIL("Couldn't allocate aligned memory for '%s'.", what);
+    }
 
+    #if MEMORY_DIAGNOSTICS
+    DEBUG_MEMORY("Allocating aligned for '%s' %" PRI_SIZET " bytes.", what, size);
+    add_allocation(pointer, what, size);
     #endif
+    allocated_memory += size; /* Not in memory_allocated_total - what the heap allocates from its pages counts there instead */
+
+    return pointer;
+}
+
+void deallocate_aligned(void* pointer, size_t size, const char* what) {
+    #if MEMORY_DIAGNOSTICS
+    if (!remove_allocation(pointer)) {
+        FAIL("Couldn't remove existing key in allocations table: %p. Allocation tag: '%s'", pointer, what);
+    }
+    DEBUG_MEMORY("Freeing aligned '%s' ('%p') and %" PRI_SIZET " bytes.", what, pointer, size);
+    #endif
+    allocated_memory -= size;
+
+    _aligned_free(pointer);
 }
 
 void* allocate_no_tracking(size_t size) {
@@ -169,7 +316,11 @@ void memory_print_allocated_entries() {  // for debugging
     DEBUG_IMPORTANT_PRINT("Allocated memory entries:\n");
 
     printf("\n");
-    // table_print_debug_as_buckets(&allocations, false);
-    table_print_debug(&allocations);
+    for (size_t i = 0; i < allocations.capacity; i++) {
+        AllocationEntry* entry = &allocations.entries[i];
+        if (entry->pointer != NULL) {
+            printf("%p: '%s' size %" PRI_SIZET "\n", entry->pointer, entry->allocation.name, entry->allocation.size);
+        }
+    }
     printf("\n");
 }
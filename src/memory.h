@@ -10,7 +10,11 @@ typedef struct {
 
 #define GROW_CAPACITY(capacity) (capacity) < 8 ? 8 : (capacity) * 2
 
+/* Bytes allocated and not yet freed, in every build */
 size_t get_allocated_memory();
+/* Bytes allocated since memory_init, never decreasing. The heap adds the objects it allocates from its pages here,
+   so the GC can pace itself by how much the program allocates. */
+extern size_t memory_allocated_total;
 size_t get_allocations_count();
 
 void memory_init(void);
@@ -19,6 +23,9 @@ void* allocate(size_t size, const char* what);
 void deallocate(void* pointer, size_t oldSize, const char* what);
 void* reallocate(void* pointer, size_t oldSize, size_t newSize, const char* what);
 
+void* allocate_aligned(size_t size, size_t alignment, const char* what);
+void deallocate_aligned(void* pointer, size_t size, const char* what);
+
 void* allocate_no_tracking(size_t size);
 void deallocate_no_tracking(void* pointer);
 void* reallocate_no_tracking(void* pointer, size_t new_size);
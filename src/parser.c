@@ -335,8 +335,8 @@ static AstNode* or(AstNode* left_node, int expression_level) {
 static AstNode* function(int expression_level) {
 	skip_newlines();
 
-	ValueArray parameters;
-	value_array_init(&parameters);
+	AstParameterArray parameters;
+	ast_parameter_array_init(&parameters);
 
 	if (match(TOKEN_PIPE)) {
         while (!match(TOKEN_PIPE)) {
@@ -347,9 +347,8 @@ static AstNode* function(int expression_level) {
 
             do {
                 consume(TOKEN_IDENTIFIER, "Expected parameter name.");
-                unsigned long hash = hash_string_bounded(parser.previous.start, parser.previous.length);
-                Value param = MAKE_VALUE_RAW_STRING(parser.previous.start, parser.previous.length, hash);
-                value_array_write(&parameters, &param);
+                AstParameter param = {.name = parser.previous.start, .length = parser.previous.length};
+                ast_parameter_array_write(&parameters, &param);
             } while (match(TOKEN_COMMA));
         }
 	}
@@ -1,4 +1,10 @@
 #include "ribbon_api.h"
+#include "heap.h"
+
+/* heap_write_barrier is inline, so extensions get it through a function */
+static void write_barrier(Object* object, Value value) {
+    heap_write_barrier(object, value);
+}
 
 RibbonApi API = {
     .EXTENSION_ALLOC_STRING_CSTRING = "extension cstring",
@@ -10,6 +16,7 @@ RibbonApi API = {
     .copy_null_terminated_cstring = copy_null_terminated_cstring,
     .object_native_function_new = object_native_function_new,
     .object_set_attribute_cstring_key = object_set_attribute_cstring_key,
+    .object_set_attribute = object_set_attribute,
     .make_native_function_with_params = make_native_function_with_params,
     .object_class_native_new = object_class_native_new,
     .object_instance_new = object_instance_new,
@@ -50,5 +57,7 @@ RibbonApi API = {
     .object_make_constructor = object_make_constructor,
     .object_descriptor_new = object_descriptor_new,
     .object_descriptor_new_native = object_descriptor_new_native,
-    .arguments_valid = arguments_valid
+    .arguments_valid = arguments_valid,
+    .write_barrier = write_barrier,
+    .symbols = &vm.symbols
 };
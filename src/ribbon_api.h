@@ -30,6 +30,7 @@ typedef struct {
     ObjectInstance* (*object_instance_new) (ObjectClass* klass);
 
     void (*object_set_attribute_cstring_key) (Object* object, const char* key, Value value);
+    void (*object_set_attribute) (Object* object, ObjectString* name, Value value);
 
     ObjectString* (*object_string_take) (char* chars, int length);
     ObjectString* (*object_string_copy_from_null_terminated) (const char* string);
@@ -84,6 +85,14 @@ typedef struct {
     ObjectInstance* (*object_descriptor_new_native) (NativeFunction get, NativeFunction set);
 
     bool (*arguments_valid) (ValueArray args, const char* string);
+
+    /* Call after storing a value directly into an existing object, for example with table_set on the table of an ObjectTable.
+       Otherwise the GC may free the value while the object still references it. */
+    void (*write_barrier) (Object* object, Value value);
+
+    /* Interned names like @init and length, for the functions taking an ObjectString* rather than a C string,
+       which would be interned again on every call */
+    const Symbols* symbols;
 } RibbonApi;
 
 extern RibbonApi API;
@@ -8,18 +8,14 @@
 #include "value.h"
 #include "memory.h"
 #include "table.h"
-
-static ObjectClass* descriptor_class = NULL;
+#include "heap.h"
 
 static Object* allocate_object(size_t size, const char* what, ObjectType type) {
 	DEBUG_OBJECTS_PRINT("Allocating object '%s' of size %" PRI_SIZET " and type %d.", what, size, type);
 
-    Object* object = allocate(size, what);
-    object->type = type;    
-    object->is_reachable = false;
-    object->next = vm.objects;
-    vm.objects = object;
-    cell_table_init(&object->attributes);
+    Object* object = heap_allocate(size);
+    object->type = type;
+    object->attributes = NULL;
     
     vm.num_objects++;
     DEBUG_OBJECTS_PRINT("Incremented num_objects to %d", vm.num_objects);
@@ -27,14 +23,30 @@ static Object* allocate_object(size_t size, const char* what, ObjectType type) {
     return object;
 }
 
+CellTable* object_attributes(Object* object) {
+	if (object->attributes == NULL) {
+		object->attributes = allocate(sizeof(CellTable), "Object attributes");
+		cell_table_init(object->attributes);
+		object->attributes->owner = object;
+	}
+	return object->attributes;
+}
+
+static bool get_attributes_value(Object* object, ObjectString* name, Value* out) {
+	return object->attributes != NULL && cell_table_get_value(object->attributes, name, out);
+}
+
+static bool get_attributes_cell(Object* object, ObjectString* name, ObjectCell** out) {
+	return object->attributes != NULL && cell_table_get_cell(object->attributes, name, out);
+}
+
 bool object_value_is(Value value, ObjectType type) {
-	return value.type == VALUE_OBJECT && value.as.object->type == type;
+	return VALUE_IS_OBJECT(value) && VALUE_AS_OBJECT(value)->type == type;
 }
 
-static void set_object_native_method(Object* object, char* method_name, char** params, int num_params, NativeFunction function) {
+static void set_class_native_method(ObjectClass* klass, char* method_name, char** params, int num_params, NativeFunction function) {
 	ObjectFunction* method = make_native_function_with_params(method_name, num_params, params, function);
-	ObjectBoundMethod* bound_method = object_bound_method_new(method, object);
-	object_set_attribute_cstring_key(object, method_name, MAKE_VALUE_OBJECT(bound_method));
+	object_set_attribute_cstring_key((Object*) klass, method_name, MAKE_VALUE_OBJECT(method));
 }
 
 static bool object_string_add(Object* self, ValueArray args, Value* result) {
@@ -48,14 +60,14 @@ static bool object_string_add(Object* self, ValueArray args, Value* result) {
 	assert(self->type == OBJECT_STRING);
 
     ObjectString* self_string = OBJECT_AS_STRING(self);
-    ObjectString* other_string = OBJECT_AS_STRING(other_value.as.object);
+    ObjectString* other_string = OBJECT_AS_STRING(VALUE_AS_OBJECT(other_value));
 
     char* buffer = allocate(self_string->length + other_string->length + 1, "Object string buffer");
     memcpy(buffer, self_string->chars, self_string->length);
     memcpy(buffer + self_string->length, other_string->chars, other_string->length);
     int string_length = self_string->length + other_string->length;
     buffer[string_length] = '\0';
-    ObjectString* object_string = object_string_take(buffer, string_length);
+    ObjectString* object_string = object_string_take_uninterned(buffer, string_length);
 
     *result = MAKE_VALUE_OBJECT(object_string);
     return true;
@@ -77,10 +89,7 @@ static bool object_table_length(Object* self, ValueArray args, Value* result) {
 
     ObjectTable* self_table = (ObjectTable*) self;
 
-	PointerArray entries = table_iterate(&self_table->table, "table object length table_iterate buffer");
-    *result = MAKE_VALUE_NUMBER(entries.count);
-	pointer_array_free(&entries);
-
+    *result = MAKE_VALUE_NUMBER(table_length(&self_table->table));
     return true;
 }
 
@@ -88,56 +97,23 @@ static bool object_table_add(Object* self, ValueArray args, Value* result) {
 	assert(args.count == 1);
 	assert(self->type == OBJECT_TABLE);
 
-	bool success = true;
-
-	ValueArray length_args = value_array_make(0, NULL);
-	Value length;
-	if (vm_call_attribute_cstring(self, "length", length_args, &length) != CALL_RESULT_SUCCESS) {
-		success = false;
-		goto cleanup;
-	}
-
-	ValueArray set_key_args = value_array_make(2, (Value[]) {length, args.values[0]});
-	Value throwaway;
-	if (vm_call_attribute_cstring(self, "@set_key", set_key_args, &throwaway) != CALL_RESULT_SUCCESS) {
-		success = false;
-	}
-
-	value_array_free(&set_key_args);
-
-	cleanup:
-	value_array_free(&length_args);
+	ObjectTable* self_table = (ObjectTable*) self;
+	table_add(&self_table->table, args.values[0]);
+	heap_write_barrier(self, args.values[0]);
 
 	*result = MAKE_VALUE_NIL();
-	return success;
+	return true;
 }
 
 static bool object_table_pop(Object* self, ValueArray args, Value* result) {
 	assert(args.count == 0);
 	assert(self->type == OBJECT_TABLE);
 
-	bool success = true;
-
-	ValueArray length_args = value_array_make(0, NULL);
-	Value length;
-	if (vm_call_attribute_cstring(self, "length", length_args, &length) != CALL_RESULT_SUCCESS) {
-		success = false;
-		goto cleanup;
-	}
-
-	ValueArray delete_args = value_array_make(1, (Value[]) {MAKE_VALUE_NUMBER(length.as.number - 1)});
+	ObjectTable* self_table = (ObjectTable*) self;
 	Value throwaway;
-	if (vm_call_attribute_cstring(self, "remove_key", delete_args, &throwaway) != CALL_RESULT_SUCCESS) {
-		success = false;
-	}
-
-	value_array_free(&delete_args);
-
-	cleanup:
-	value_array_free(&length_args);
 
 	*result = MAKE_VALUE_NIL();
-	return success;
+	return table_pop(&self_table->table, &throwaway);
 }
 
 static bool object_table_remove_key(Object* self, ValueArray args, Value* result) {
@@ -156,14 +132,14 @@ static bool object_string_get_key(Object* self, ValueArray args, Value* result)
 
 	Value other_value = args.values[0];
 
-    if (other_value.type != VALUE_NUMBER) {
+    if (!VALUE_IS_NUMBER(other_value)) {
     	*result = MAKE_VALUE_NIL();
     	return false;
     }
 
     ObjectString* self_string = object_as_string(self);
 
-    double other_as_number = other_value.as.number;
+    double other_as_number = VALUE_AS_NUMBER(other_value);
     bool number_is_integer = floor(other_as_number) == other_as_number;
     if (!number_is_integer) {
     	*result = MAKE_VALUE_NIL();
@@ -220,19 +196,23 @@ static bool object_table_set_key(Object* self, ValueArray args, Value* result) {
     ObjectTable* self_table = (ObjectTable*) self;
 
     table_set(&self_table->table, key_value, value_to_set);
+    heap_write_barrier(self, key_value);
+    heap_write_barrier(self, value_to_set);
 
 	*result = MAKE_VALUE_NIL();
     return true;
 }
 
-static ObjectString* get_string_from_cache(const char* string, int length) {
-	Value cached_string;
-	unsigned long hash = hash_string_bounded(string, length);
-	if (table_get(&vm.string_cache, MAKE_VALUE_RAW_STRING(string, length, hash), &cached_string)) {
-		assert(object_value_is(cached_string, OBJECT_STRING));
-		return (ObjectString*) cached_string.as.object;
+static ObjectString* get_string_from_cache(const char* string, int length, unsigned long hash) {
+	ObjectString* cached = string_cache_find(&vm.string_cache, string, length, hash);
+
+	/* A lazy sweep in progress may still have to free the string. Then it's forgotten, and a new one is interned instead. */
+	if (cached != NULL && heap_is_condemned((Object*) cached)) {
+		string_cache_remove(&vm.string_cache, cached);
+		return NULL;
 	}
-	return NULL;
+
+	return cached;
 }
 
 static ObjectString* new_bare_string(char* chars, int length) {
@@ -242,65 +222,38 @@ static ObjectString* new_bare_string(char* chars, int length) {
 
     string->chars = chars;
 	string->length = length;
-	string->hash = hash_string_bounded(chars, length);
-
-	return string;
-}
-
-static ObjectString* object_string_new_partial(char* chars, int length) {
-	ObjectString* cached = get_string_from_cache(chars, length);
-	if (cached != NULL) {
-		return cached;
-	}
-
-	ObjectString* string = new_bare_string(copy_null_terminated_cstring(chars, "Object string buffer"), length);
-
-	table_set(&vm.string_cache, MAKE_VALUE_RAW_STRING(string->chars, string->length, string->hash), MAKE_VALUE_OBJECT(string));
+	string->is_interned = false;
+	string->is_hashed = false;
+	string->hash = 0;
 
 	return string;
 }
 
 ObjectString* object_string_new_partial_from_null_terminated(char* chars) {
-	return object_string_new_partial(chars, strlen(chars));
+	/* Strings no longer carry their own methods, so a partial string is the same as a full one.
+	   Kept for extensions which still create their strings through this. */
+	return object_string_copy_from_null_terminated(chars);
 }
 
-static ObjectString* object_string_new(char* chars, int length) {
+static ObjectString* object_string_new(char* chars, int length, unsigned long hash) {
     ObjectString* string = new_bare_string(chars, length);
-
-	ObjectFunction* string_add_method = make_native_function_with_params("@add", 1, (char*[]) {"other"}, object_string_add);
-	ObjectBoundMethod* string_add_bound_method = object_bound_method_new(string_add_method, (Object*) string);
-
-	ObjectFunction* string_get_key_method = make_native_function_with_params("@get_key", 1, (char*[]) {"other"}, object_string_get_key);
-	ObjectBoundMethod* string_get_key_bound_method = object_bound_method_new(string_get_key_method, (Object*) string);
-
-	ObjectFunction* string_length_method = make_native_function_with_params("length", 0, NULL, object_string_length);
-	ObjectBoundMethod* string_length_bound_method = object_bound_method_new(string_length_method, (Object*) string);
-
-	/* TODO: Consider if setting the objects attributes should go through the object_set_attribute function */
-
-	ObjectString* add_attr_key = object_string_new_partial("@add", strlen("@add"));
-	cell_table_set_value(&string->base.attributes, add_attr_key, MAKE_VALUE_OBJECT(string_add_bound_method));
-
-	ObjectString* get_key_attr_key = object_string_new_partial("@get_key", strlen("@get_key"));
-	cell_table_set_value(&string->base.attributes, get_key_attr_key, MAKE_VALUE_OBJECT(string_get_key_bound_method));
-
-	ObjectString* length_attr_key = object_string_new_partial("length", strlen("length"));
-	cell_table_set_value(&string->base.attributes, length_attr_key, MAKE_VALUE_OBJECT(string_length_bound_method));
-
-	table_set(&vm.string_cache, MAKE_VALUE_RAW_STRING(string->chars, string->length, string->hash), MAKE_VALUE_OBJECT(string));
-
+	string->is_hashed = true;
+	string->hash = hash;
+	string->is_interned = true;
+	string_cache_add(&vm.string_cache, string);
     return string;
 }
 
 ObjectString* object_string_copy(const char* string, int length) {
-	ObjectString* cached = get_string_from_cache(string, length);
+	unsigned long hash = hash_string_bounded(string, length);
+	ObjectString* cached = get_string_from_cache(string, length, hash);
 	if (cached != NULL) {
 		return cached;
 	}
 
 	// argument length should not include the null-terminator
     char* chars = copy_cstring(string, length, "Object string buffer");
-    return object_string_new(chars, length);
+    return object_string_new(chars, length, hash);
 }
 
 ObjectString* object_string_copy_from_null_terminated(const char* string) {
@@ -308,14 +261,42 @@ ObjectString* object_string_copy_from_null_terminated(const char* string) {
 }
 
 ObjectString* object_string_take(char* chars, int length) {
-	ObjectString* cached = get_string_from_cache(chars, length);
+	unsigned long hash = hash_string_bounded(chars, length);
+	ObjectString* cached = get_string_from_cache(chars, length, hash);
 	if (cached != NULL) {
 		deallocate(chars, length + 1, "Object string buffer");
 		return cached;
 	}
 
     // Assume chars is already null-terminated
-    return object_string_new(chars, length);
+    return object_string_new(chars, length, hash);
+}
+
+ObjectString* object_string_take_uninterned(char* chars, int length) {
+    // Assume chars is already null-terminated
+	return new_bare_string(chars, length);
+}
+
+ObjectString* object_string_intern(ObjectString* string) {
+	if (string->is_interned) {
+		return string;
+	}
+
+	ObjectString* cached = get_string_from_cache(string->chars, string->length, object_string_hash(string));
+	if (cached != NULL) {
+		return cached;
+	}
+
+	/* Nothing else is interned by these characters yet, so the string itself becomes the interned one */
+	string->is_interned = true;
+	string_cache_add(&vm.string_cache, string);
+	return string;
+}
+
+unsigned long object_string_compute_hash(ObjectString* string) {
+	string->hash = hash_string_bounded(string->chars, string->length);
+	string->is_hashed = true;
+	return string->hash;
 }
 
 ObjectString* object_string_clone(ObjectString* original) {
@@ -336,29 +317,34 @@ bool object_cstrings_equal(const char* a, const char* b, int length) {
 }
 
 bool object_strings_equal(ObjectString* a, ObjectString* b) {
-    return (a->length == b->length) && (object_cstrings_equal(a->chars, b->chars, a->length));
+    return (a->length == b->length) && memcmp(a->chars, b->chars, a->length) == 0;
 }
 
-static ObjectFunction* object_function_base_new(bool isNative, ObjectString** parameters, int numParams, CellTable free_vars) {
-    ObjectFunction* objFunc = (ObjectFunction*) allocate_object(sizeof(ObjectFunction), "ObjectFunction", OBJECT_FUNCTION);
-    objFunc->name = copy_null_terminated_cstring("<Anonymous function>", "Function name");
+static ObjectFunction* object_function_base_new(bool isNative, ObjectString** parameters, int numParams, int num_upvalues) {
+    size_t size = sizeof(ObjectFunction) + sizeof(ObjectCell*) * num_upvalues;
+    ObjectFunction* objFunc = (ObjectFunction*) allocate_object(size, "ObjectFunction", OBJECT_FUNCTION);
+    objFunc->name = NULL;
     objFunc->is_native = isNative;
     objFunc->parameters = parameters;
     objFunc->num_params = numParams;
-    objFunc->free_vars = free_vars;
+    objFunc->module = NULL;
+    objFunc->num_upvalues = num_upvalues;
+    for (int i = 0; i < num_upvalues; i++) {
+    	objFunc->upvalues[i] = NULL;
+    }
     return objFunc;
 }
 
-ObjectFunction* object_user_function_new(ObjectCode* code, ObjectString** parameters, int numParams, CellTable free_vars) {
+ObjectFunction* object_user_function_new(ObjectCode* code) {
     DEBUG_OBJECTS_PRINT("Creating user function object.");
-    ObjectFunction* objFunc = object_function_base_new(false, parameters, numParams, free_vars);
+    ObjectFunction* objFunc = object_function_base_new(false, code->parameters, code->num_params, code->bytecode.upvalues.count);
     objFunc->code = code;
     return objFunc;
 }
 
 ObjectFunction* object_native_function_new(NativeFunction nativeFunction, ObjectString** parameters, int numParams) {
     DEBUG_OBJECTS_PRINT("Creating native function object.");
-    ObjectFunction* objFunc = object_function_base_new(true, parameters, numParams, cell_table_new_empty());
+    ObjectFunction* objFunc = object_function_base_new(true, parameters, numParams, 0);
     objFunc->native_function = nativeFunction;
     return objFunc;
 }
@@ -378,16 +364,17 @@ ObjectFunction* make_native_function_with_params(char* name, int num_params, cha
 	}
 	
 	ObjectFunction* func = object_native_function_new(function, params_buffer, num_params);
-	name = copy_null_terminated_cstring(name, "Function name");
-	object_function_set_name(func, name);
+	object_function_set_name(func, object_string_copy_from_null_terminated(name));
 	return func;
 }
 
-void object_function_set_name(ObjectFunction* function, char* name) {
-	assert(function->name != NULL);
-
-	deallocate(function->name, strlen(function->name) + 1, "Function name");
+void object_function_set_name(ObjectFunction* function, ObjectString* name) {
 	function->name = name;
+	heap_write_barrier((Object*) function, MAKE_VALUE_OBJECT(name));
+}
+
+const char* object_function_name(ObjectFunction* function) {
+	return function->name == NULL ? "<Anonymous function>" : function->name->chars;
 }
 
 void object_class_set_name(ObjectClass* klass, char* name) {
@@ -405,7 +392,7 @@ ObjectBoundMethod* object_bound_method_new(ObjectFunction* method, Object* self)
 static bool descriptor_init(Object* self, ValueArray args, Value* out) {
 	/* TODO: One convenient argument-types-validator thing, to be used also here. */
 
-	assert(is_instance_of_class(self, "Descriptor"));
+	assert(object_is_descriptor(MAKE_VALUE_OBJECT(self)));
 
 	Value get_arg = args.values[0];
 	Value set_arg = args.values[1];
@@ -413,45 +400,51 @@ static bool descriptor_init(Object* self, ValueArray args, Value* out) {
 	/* Assertions are fine as long as this is internal.
 	   TODO to figure out better mechanism if later this is exposed to user code. */
 
-	if (get_arg.type != VALUE_NIL) {
+	if (!VALUE_IS_NIL(get_arg)) {
 		assert(object_value_is(get_arg, OBJECT_FUNCTION));
 		// if (!object_value_is(get_arg, OBJECT_FUNCTION)) {
 		// 	FAIL("get argument passed to descriptor @init is not a function.");
 		// }
-		object_set_attribute_cstring_key((Object*) self, "@get", get_arg);
+		object_set_attribute((Object*) self, vm.symbols.get, get_arg);
 	}
 
-	if (set_arg.type != VALUE_NIL) {
+	if (!VALUE_IS_NIL(set_arg)) {
 		assert(object_value_is(set_arg, OBJECT_FUNCTION));
-		object_set_attribute_cstring_key((Object*) self, "@set", set_arg);
+		object_set_attribute((Object*) self, vm.symbols.set, set_arg);
 	}
 
 	*out = MAKE_VALUE_NIL();
 	return true;
 }
 
-ObjectInstance* object_descriptor_new(ObjectFunction* get, ObjectFunction* set) {
-	if (descriptor_class == NULL) {
-		ObjectFunction* init_func = object_make_constructor(2, (char*[]) {"get", "set"}, descriptor_init);
-		descriptor_class = object_class_native_new("Descriptor", sizeof(ObjectInstance), NULL, NULL, init_func, NULL);
-	}
+ObjectClass* object_descriptor_class_new(void) {
+	ObjectFunction* init_func = object_make_constructor(2, (char*[]) {"get", "set"}, descriptor_init);
+	return object_class_native_new("Descriptor", sizeof(ObjectInstance), NULL, NULL, init_func, NULL);
+}
+
+/* Checked on every attribute access, so it compares the class pointer rather than walking the class chain by name.
+   The Descriptor class isn't exposed to be subclassed, so its instances are exactly the descriptors. */
+bool object_is_descriptor(Value value) {
+	return object_value_is(value, OBJECT_INSTANCE) && ((ObjectInstance*) VALUE_AS_OBJECT(value))->klass == vm.descriptor_class;
+}
 
+ObjectInstance* object_descriptor_new(ObjectFunction* get, ObjectFunction* set) {
 	Value get_val = get == NULL ? MAKE_VALUE_NIL() : MAKE_VALUE_OBJECT(get);
 	Value set_val = set == NULL ? MAKE_VALUE_NIL() : MAKE_VALUE_OBJECT(set);
 
 	Value descriptor_val;
 	ValueArray args = value_array_make(2, (Value[]) {get_val, set_val});
-	if (vm_instantiate_class(descriptor_class, args, &descriptor_val) != CALL_RESULT_SUCCESS) {
+	if (vm_instantiate_class(vm.descriptor_class, args, &descriptor_val) != CALL_RESULT_SUCCESS) {
 		return NULL;
 	}
 	value_array_free(&args);
 
-	assert(is_value_instance_of_class(descriptor_val, "Descriptor"));
-	// if (!is_value_instance_of_class(descriptor_val, "Descriptor")) {
+	assert(object_is_descriptor(descriptor_val));
+	// if (!object_is_descriptor(descriptor_val)) {
 	// 	FAIL("Descriptor instantiated isn't an instance of the Descriptor class.");
 	// }
 
-	return (ObjectInstance*) descriptor_val.as.object;
+	return (ObjectInstance*) VALUE_AS_OBJECT(descriptor_val);
 }
 
 ObjectInstance* object_descriptor_new_native(NativeFunction get, NativeFunction set) {
@@ -460,24 +453,17 @@ ObjectInstance* object_descriptor_new_native(NativeFunction get, NativeFunction
 	return object_descriptor_new(get_object, set_object);
 }
 
-ObjectCode* object_code_new(Bytecode chunk) {
+ObjectCode* object_code_new(Bytecode chunk, ObjectString** parameters, int num_params) {
 	ObjectCode* obj_code = (ObjectCode*) allocate_object(sizeof(ObjectCode), "ObjectCode", OBJECT_CODE);
 	obj_code->bytecode = chunk;
+	obj_code->parameters = parameters;
+	obj_code->num_params = num_params;
 	return obj_code;
 }
 
 ObjectTable* object_table_new(Table table) {
 	ObjectTable* object_table = (ObjectTable*) allocate_object(sizeof(ObjectTable), "ObjectTable", OBJECT_TABLE);
 	object_table->table = table;
-
-	set_object_native_method((Object*) object_table, "length", (char*[]){}, 0, object_table_length);
-	set_object_native_method((Object*) object_table, "@get_key", (char*[]){"other"}, 1, object_table_get_key);
-	set_object_native_method((Object*) object_table, "@set_key", (char*[]){"key", "value"}, 2, object_table_set_key);
-	set_object_native_method((Object*) object_table, "has_key", (char*[]){"key"}, 1, object_table_has_key);
-	set_object_native_method((Object*) object_table, "remove_key", (char*[]){"key"}, 1, object_table_remove_key);
-	set_object_native_method((Object*) object_table, "add", (char*[]){"value"}, 1, object_table_add);
-	set_object_native_method((Object*) object_table, "pop", NULL, 0, object_table_pop);
-
 	return object_table;
 }
 
@@ -504,6 +490,10 @@ static ObjectClass* object_class_new_base(
 		char* name, size_t instance_size, DeallocationFunction dealloc_func, GcMarkFunction gc_mark_func) {
 
 	ObjectClass* klass = (ObjectClass*) allocate_object(sizeof(ObjectClass), "ObjectClass", OBJECT_CLASS);
+
+	/* The new class may take the address of a freed one, which attribute caches might still hold */
+	object_invalidate_attribute_caches();
+
 	name = name == NULL ? "<Anonymous class>" : name;
 	klass->name = copy_null_terminated_cstring(name, "Class name");
 	klass->base_function = base_function;
@@ -511,6 +501,9 @@ static ObjectClass* object_class_new_base(
 	klass->instance_size = instance_size;
 	klass->dealloc_func = dealloc_func;
 	klass->gc_mark_func = gc_mark_func;
+	klass->root_shape = shape_new_root();
+	klass->instance_inline_fields = 0;
+	object_attributes((Object*) klass); /* The class body defines its attributes as its variables, so it always has them */
 
 	return klass;
 }
@@ -527,7 +520,7 @@ ObjectClass* object_class_native_new(
 	ObjectClass* klass = object_class_new_base(NULL, NULL, name, instance_size, dealloc_func, gc_mark_func);
 
 	if (constructor != NULL) {
-		object_set_attribute_cstring_key((Object*) klass, "@init", MAKE_VALUE_OBJECT(constructor));
+		object_set_attribute((Object*) klass, vm.symbols.init, MAKE_VALUE_OBJECT(constructor));
 	}
 
 	if (descriptors != NULL) {
@@ -542,26 +535,156 @@ ObjectClass* object_class_native_new(
 	return klass;
 }
 
+/* The methods of all strings live in a single String class, instead of in the attributes of every string */
+ObjectClass* object_string_class_new(void) {
+	ObjectClass* klass = object_class_new(NULL, NULL, "String");
+	set_class_native_method(klass, "@add", (char*[]) {"other"}, 1, object_string_add);
+	set_class_native_method(klass, "@get_key", (char*[]) {"other"}, 1, object_string_get_key);
+	set_class_native_method(klass, "length", NULL, 0, object_string_length);
+	return klass;
+}
+
+ObjectClass* object_table_class_new(void) {
+	ObjectClass* klass = object_class_new(NULL, NULL, "Table");
+	set_class_native_method(klass, "length", NULL, 0, object_table_length);
+	set_class_native_method(klass, "@get_key", (char*[]) {"other"}, 1, object_table_get_key);
+	set_class_native_method(klass, "@set_key", (char*[]) {"key", "value"}, 2, object_table_set_key);
+	set_class_native_method(klass, "has_key", (char*[]) {"key"}, 1, object_table_has_key);
+	set_class_native_method(klass, "remove_key", (char*[]) {"key"}, 1, object_table_remove_key);
+	set_class_native_method(klass, "add", (char*[]) {"value"}, 1, object_table_add);
+	set_class_native_method(klass, "pop", NULL, 0, object_table_pop);
+	return klass;
+}
+
 ObjectInstance* object_instance_new(ObjectClass* klass) {
 	ObjectInstance* instance = NULL;
+	int inline_fields = 0;
 
 	if (klass->instance_size > 0) { // Native class
 		instance = (ObjectInstance*) allocate_object(klass->instance_size, "ObjectInstance", OBJECT_INSTANCE);
 	} else { // User class
-		instance = (ObjectInstance*) allocate_object(sizeof(ObjectInstance), "ObjectInstance", OBJECT_INSTANCE);
+		/* Room for as many fields as earlier instances ended up with, so instances of a class that were
+		   set up the same way have all their fields inline */
+		inline_fields = klass->instance_inline_fields;
+		instance = (ObjectInstance*) allocate_object(
+			sizeof(ObjectInstance) + sizeof(Value) * inline_fields, "ObjectInstance", OBJECT_INSTANCE);
 	}
 	
 	instance->klass = klass;
 	instance->is_initialized = false;
+	instance->shape = klass->root_shape;
+	instance->inline_fields_capacity = inline_fields;
+	instance->fields_capacity = inline_fields;
+	instance->fields = inline_fields > 0 ? (Value*) (instance + 1) : NULL;
+
+	if (klass->gc_mark_func != NULL) {
+		/* Native code stores references into the instance without a write barrier */
+		heap_remember_always((Object*) instance);
+	}
 
 	return instance;
 }
 
+static bool instance_has_inline_fields(ObjectInstance* instance) {
+	return instance->fields != NULL && instance->fields == (Value*) (instance + 1);
+}
+
+static void instance_free_fields(ObjectInstance* instance) {
+	if (instance->fields != NULL && !instance_has_inline_fields(instance)) {
+		deallocate(instance->fields, sizeof(Value) * instance->fields_capacity, "Instance fields");
+	}
+	instance->fields = NULL;
+	instance->fields_capacity = 0;
+}
+
+static void instance_add_field(ObjectInstance* instance, Shape* new_shape, Value value) {
+	assert(new_shape->parent == instance->shape);
+
+	int field_count = new_shape->field_count;
+
+	if (field_count > instance->fields_capacity) {
+		int new_capacity = instance->fields_capacity < 4 ? 4 : instance->fields_capacity * 2;
+		Value* new_fields = allocate(sizeof(Value) * new_capacity, "Instance fields");
+		for (int i = 0; i < field_count - 1; i++) {
+			new_fields[i] = instance->fields[i];
+		}
+
+		instance_free_fields(instance);
+		instance->fields = new_fields;
+		instance->fields_capacity = new_capacity;
+	}
+
+	instance->fields[field_count - 1] = value;
+	instance->shape = new_shape;
+	heap_write_barrier((Object*) instance, value);
+
+	/* The new shape may have just been added to the shape tree of the class */
+	ObjectClass* klass = instance->klass;
+	heap_write_barrier((Object*) klass, MAKE_VALUE_OBJECT(new_shape->name));
+	if (klass->instance_size == 0 && field_count > klass->instance_inline_fields && field_count <= INSTANCE_MAX_INLINE_FIELDS) {
+		klass->instance_inline_fields = field_count;
+	}
+}
+
+/* For instances which outgrew SHAPE_MAX_FIELDS - their attributes move to the regular attributes table */
+static void instance_to_dictionary_mode(ObjectInstance* instance) {
+	for (Shape* shape = instance->shape; shape->name != NULL; shape = shape->parent) {
+		cell_table_set_value(object_attributes((Object*) instance), shape->name, instance->fields[shape->field_count - 1]);
+	}
+
+	instance_free_fields(instance);
+	instance->shape = NULL;
+}
+
+static bool get_own_attribute(Object* object, ObjectString* name, Value* out) {
+	if (object->type == OBJECT_INSTANCE && ((ObjectInstance*) object)->shape != NULL) {
+		ObjectInstance* instance = (ObjectInstance*) object;
+		int field_index = shape_find_field(instance->shape, name);
+		if (field_index < 0) {
+			return false;
+		}
+
+		*out = instance->fields[field_index];
+		return true;
+	}
+
+	return get_attributes_value(object, name, out);
+}
+
+static void set_own_attribute(Object* object, ObjectString* name, Value value) {
+	if (object->type == OBJECT_INSTANCE && ((ObjectInstance*) object)->shape != NULL) {
+		ObjectInstance* instance = (ObjectInstance*) object;
+		int field_index = shape_find_field(instance->shape, name);
+		if (field_index >= 0) {
+			instance->fields[field_index] = value;
+			heap_write_barrier(object, value);
+			return;
+		}
+
+		Shape* new_shape = shape_add_field(instance->shape, name);
+		if (new_shape != NULL) {
+			instance_add_field(instance, new_shape, value);
+			return;
+		}
+
+		instance_to_dictionary_mode(instance);
+	}
+
+	cell_table_set_value(object_attributes(object), name, value);
+}
+
 ObjectModule* object_module_new(ObjectString* name, ObjectFunction* function) {
 	ObjectModule* module = (ObjectModule*) allocate_object(sizeof(ObjectModule), "ObjectModule", OBJECT_MODULE);
 	module->name = name;
 	module->function = function;
 	module->dll = NULL;
+	object_attributes((Object*) module)->holds_globals = true;
+
+	if (function != NULL) {
+		function->module = module;
+		heap_write_barrier((Object*) function, MAKE_VALUE_OBJECT(module));
+	}
+
 	return module;
 }
 
@@ -572,7 +695,10 @@ ObjectModule* object_module_native_new(ObjectString* name, HMODULE dll) {
 }
 
 void object_free(Object* o) {
-	cell_table_free(&o->attributes);
+	if (o->attributes != NULL) {
+		cell_table_free(o->attributes);
+		deallocate(o->attributes, sizeof(CellTable), "Object attributes");
+	}
 
 	ObjectType type = o->type;
 
@@ -580,9 +706,10 @@ void object_free(Object* o) {
         case OBJECT_STRING: {
             ObjectString* string = (ObjectString*) o;
             DEBUG_OBJECTS_PRINT("Freeing ObjectString '%s'", string->chars);
-			table_delete(&vm.string_cache, MAKE_VALUE_RAW_STRING(string->chars, string->length, string->hash));
+			if (string->is_interned) {
+				string_cache_remove(&vm.string_cache, string);
+			}
             deallocate(string->chars, string->length + 1, "Object string buffer");
-            deallocate(string, sizeof(ObjectString), "ObjectString");
             break;
         }
         case OBJECT_FUNCTION: {
@@ -592,32 +719,29 @@ void object_free(Object* o) {
 			} else {
 				DEBUG_OBJECTS_PRINT("Freeing user ObjectFunction");
 			}
-            if (func->num_params > 0) {
+            if (func->is_native && func->num_params > 0) {
             	deallocate(func->parameters, sizeof(ObjectString*) * func->num_params, "Parameters list strings");
             }
-            cell_table_free(&func->free_vars);
-            deallocate(func->name, strlen(func->name) + 1, "Function name");
-            deallocate(func, sizeof(ObjectFunction), "ObjectFunction");
             break;
         }
         case OBJECT_CODE: {
         	ObjectCode* code = (ObjectCode*) o;
         	DEBUG_OBJECTS_PRINT("Freeing ObjectCode at '%p'", code);
         	bytecode_free(&code->bytecode);
-        	deallocate(code, sizeof(ObjectCode), "ObjectCode");
+        	if (code->num_params > 0) {
+        		deallocate(code->parameters, sizeof(ObjectString*) * code->num_params, "Parameters list strings");
+        	}
         	break;
         }
         case OBJECT_TABLE: {
         	ObjectTable* table = (ObjectTable*) o;
         	DEBUG_OBJECTS_PRINT("Freeing ObjectTable at '%p'", table);
         	table_free(&table->table);
-        	deallocate(table, sizeof(ObjectTable), "ObjectTable");
         	break;
         }
         case OBJECT_CELL: {
         	ObjectCell* cell = (ObjectCell*) o;
         	DEBUG_OBJECTS_PRINT("Freeing ObjectCell at '%p'", cell);
-        	deallocate(cell, sizeof(ObjectCell), "ObjectCell");
         	break;
         }
         case OBJECT_MODULE: {
@@ -626,14 +750,15 @@ void object_free(Object* o) {
 			if (module->dll != NULL) {
 				FreeLibrary(module->dll);
 			}
-			deallocate(module, sizeof(ObjectModule), "ObjectModule");
         	break;
         }
 		case OBJECT_CLASS: {
 			ObjectClass* class = (ObjectClass*) o;
 			DEBUG_OBJECTS_PRINT("Freeing ObjectClass at '%p'", class);
+			/* Attribute caches may hold its shapes, and new shapes may take their addresses */
+			shape_free_tree(class->root_shape);
+			object_invalidate_attribute_caches();
 			deallocate(class->name, strlen(class->name) + 1, "Class name");
-			deallocate(class, sizeof(ObjectClass), "ObjectClass");
         	break;
 		}
 		case OBJECT_INSTANCE: {
@@ -646,18 +771,15 @@ void object_free(Object* o) {
 				if (instance->is_initialized && klass->dealloc_func != NULL) {
 					klass->dealloc_func(instance);
 				}
-				deallocate(instance, klass->instance_size, "ObjectInstance");
-			} else {
-				/* Ribbon class */
-				deallocate(instance, sizeof(ObjectInstance), "ObjectInstance");
 			}
 
+			instance_free_fields(instance);
+
 			break;
 		}
 		case OBJECT_BOUND_METHOD: {
 			ObjectBoundMethod* bound_method = (ObjectBoundMethod*) o;
 			DEBUG_OBJECTS_PRINT("Freeing ObjectBoundMethod at '%p'", bound_method);
-			deallocate(bound_method, sizeof(ObjectBoundMethod), "ObjectBoundMethod");
 			break;
 		}
     }
@@ -668,9 +790,9 @@ void object_free(Object* o) {
 
 static void print_function(ObjectFunction* function) {
 	if (function->is_native) {
-		printf("<Native function %s at %p>", function->name, function);
+		printf("<Native function %s at %p>", object_function_name(function), function);
 	} else {
-		printf("<Function %s at %p>", function->name, function);
+		printf("<Function %s at %p>", object_function_name(function), function);
 	}
 }
 
@@ -725,7 +847,7 @@ void object_print(Object* o) {
 		case OBJECT_BOUND_METHOD: {
 			ObjectBoundMethod* bound_method = (ObjectBoundMethod*) o;
 			ObjectFunction* method = bound_method->method;
-			printf("<Bound method %s of object ", method->name);
+			printf("<Bound method %s of object ", object_function_name(method));
 			object_print(bound_method->self);
 			printf(" at %p>", bound_method);
 			return;
@@ -736,7 +858,26 @@ void object_print(Object* o) {
 }
 
 bool object_compare(Object* a, Object* b) {
-	return a == b; /* Strings are interned */
+	if (a == b) {
+		return true;
+	}
+
+	if (a->type != OBJECT_STRING || b->type != OBJECT_STRING) {
+		return false;
+	}
+
+	ObjectString* string_a = (ObjectString*) a;
+	ObjectString* string_b = (ObjectString*) b;
+
+	/* Equal interned strings are the same string. Otherwise only the characters can tell, unless the hashes already differ */
+	if (string_a->is_interned && string_b->is_interned) {
+		return false;
+	}
+	if (string_a->is_hashed && string_b->is_hashed && string_a->hash != string_b->hash) {
+		return false;
+	}
+
+	return object_strings_equal(string_a, string_b);
 }
 
 ObjectFunction* object_as_function(Object* o) {
@@ -759,22 +900,28 @@ MethodAccessResult object_get_method(Object* object, const char* method_name, Ob
 		return METHOD_ACCESS_ATTR_NOT_BOUND_METHOD;
 	}
 
-	*out = (ObjectBoundMethod*) attr_val.as.object;
+	*out = (ObjectBoundMethod*) VALUE_AS_OBJECT(attr_val);
 	return METHOD_ACCESS_SUCCESS;
 }
 
 // For debugging
 void object_print_all_objects(void) {
-	if (vm.objects != NULL) {
-		printf("All live objects:\n");
-		int counter = 0;
-		for (Object* object = vm.objects; object != NULL; object = object->next) {
-			printf("%-2d | Type: %d | isReachable: %d | Print: ", counter, object->type, object->is_reachable);
-			object_print(object);
-			printf("\n");
-			counter++;
+	HeapIterator iterator;
+	heap_iterator_init(&iterator);
+
+	Object* object;
+	int counter = 0;
+	while (heap_iterator_next(&iterator, &object)) {
+		if (counter == 0) {
+			printf("All live objects:\n");
 		}
-	} else {
+		printf("%-2d | Type: %d | isReachable: %d | Print: ", counter, object->type, heap_is_marked(object));
+		object_print(object);
+		printf("\n");
+		counter++;
+	}
+
+	if (counter == 0) {
 		printf("No live objects.\n");
 	}
 }
@@ -785,7 +932,7 @@ bool object_hash(Object* object, unsigned long* result) {
 	switch (object->type) {
 		case OBJECT_STRING: {
 			ObjectString* string = (ObjectString*) object;
-			*result = string->hash;
+			*result = object_string_hash(string);
 			return true;
 		}
 		case OBJECT_CELL: {
@@ -820,111 +967,328 @@ bool object_hash(Object* object, unsigned long* result) {
 	return false;
 }
 
+/* The class whose attributes are looked up for the object after its own attributes, or NULL if it has none */
+static ObjectClass* class_of(Object* object) {
+	switch (object->type) {
+		case OBJECT_INSTANCE: return ((ObjectInstance*) object)->klass;
+		case OBJECT_STRING: return vm.string_class;
+		case OBJECT_TABLE: return vm.table_class;
+		default: return NULL;
+	}
+}
+
 /* This function should generally only be called by the attribute accessor external functions of this module.
    It should almost never be called directly. It's only external here for use in the builtin_test module,
    to test internals of the system. */
 bool load_attribute_bypass_descriptors(Object* object, ObjectString* name, Value* out) {
-	if (cell_table_get_value(&object->attributes, name, out)) {
+	name = object_string_intern(name);
+
+	if (get_own_attribute(object, name, out)) {
 		return true;
 	}
 
-	if (object->type == OBJECT_INSTANCE) {
-		ObjectInstance* instance = (ObjectInstance*) object;
-		ObjectClass* klass = instance->klass;
-
-		while (klass != NULL) {
-			if (cell_table_get_value(&klass->base.attributes, name, out)) {
-				if (object_value_is(*out, OBJECT_FUNCTION)) {
-					ObjectFunction* method = (ObjectFunction*) out->as.object;
-					ObjectBoundMethod* bound_method = object_bound_method_new(method, object);
-					*out = MAKE_VALUE_OBJECT(bound_method);
-				}
-
-				return true;
+	for (ObjectClass* klass = class_of(object); klass != NULL; klass = klass->superclass) {
+		if (get_attributes_value((Object*) klass, name, out)) {
+			if (object_value_is(*out, OBJECT_FUNCTION)) {
+				ObjectFunction* method = (ObjectFunction*) VALUE_AS_OBJECT(*out);
+				ObjectBoundMethod* bound_method = object_bound_method_new(method, object);
+				*out = MAKE_VALUE_OBJECT(bound_method);
 			}
 
-			klass = klass->superclass;
+			return true;
 		}
 	}
 
 	return false;
 }
 
-void object_set_attribute_cstring_key(Object* object, const char* key, Value value) {
-	Value descriptor_value;
-	if (load_attribute_bypass_descriptors(object, object_string_copy_from_null_terminated(key), &descriptor_value)) {
-		if (is_value_instance_of_class(descriptor_value, "Descriptor")) {
-			ObjectInstance* descriptor = (ObjectInstance*) descriptor_value.as.object;
-			
-			Value set_method_val;
-			if (!object_load_attribute_cstring_key((Object*) descriptor, "@set", &set_method_val)) {
-				FAIL("Descriptor found with no @set method."); /* Descriptors without one of @get or @set currently unsupported */
-			}
-			assert(object_value_is(set_method_val, OBJECT_FUNCTION) || object_value_is(set_method_val, OBJECT_BOUND_METHOD));
-
-			ValueArray descriptor_args = value_array_make(3, (Value[]) {
-								MAKE_VALUE_OBJECT(object),
-								MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated(key)),
-								value});
-			
-			Value descriptor_return_val;
-			if (vm_call_object(set_method_val.as.object, descriptor_args, &descriptor_return_val) != CALL_RESULT_SUCCESS) {
-				/* Currently an assertion might be fine, because right now descriptors aren't exposed to user code, it's an internal thing that should work.
-				   Except for extensions. If you're an extension developer, and your descriptor fails, yes right now it will crash everything.
-				   Maybe fix later if and when we make a better error handling system */
-
-				FAIL("Calling descriptor failed.");
+bool object_find_method(Object* object, ObjectString* name, ObjectFunction** out) {
+	name = object_string_intern(name);
+
+	Value own_value;
+	if (get_own_attribute(object, name, &own_value)) {
+		return false;
+	}
+
+	for (ObjectClass* klass = class_of(object); klass != NULL; klass = klass->superclass) {
+		Value value;
+		if (get_attributes_value((Object*) klass, name, &value)) {
+			if (!object_value_is(value, OBJECT_FUNCTION)) {
+				return false;
 			}
 
-			assert(descriptor_return_val.type == VALUE_NIL);
+			*out = (ObjectFunction*) VALUE_AS_OBJECT(value);
+			return true;
+		}
+	}
+
+	return false;
+}
 
-			value_array_free(&descriptor_args);
+static void set_attribute_through_descriptor(Object* object, ObjectString* name, ObjectInstance* descriptor, Value value) {
+	Value set_method_val;
+	if (!object_load_attribute((Object*) descriptor, vm.symbols.set, &set_method_val)) {
+		FAIL("Descriptor found with no @set method."); /* Descriptors without one of @get or @set currently unsupported */
+	}
+	assert(object_value_is(set_method_val, OBJECT_FUNCTION) || object_value_is(set_method_val, OBJECT_BOUND_METHOD));
 
+	ValueArray descriptor_args = value_array_make(3, (Value[]) {MAKE_VALUE_OBJECT(object), MAKE_VALUE_OBJECT(name), value});
+	
+	Value descriptor_return_val;
+	if (vm_call_object(VALUE_AS_OBJECT(set_method_val), descriptor_args, &descriptor_return_val) != CALL_RESULT_SUCCESS) {
+		/* Currently an assertion might be fine, because right now descriptors aren't exposed to user code, it's an internal thing that should work.
+		   Except for extensions. If you're an extension developer, and your descriptor fails, yes right now it will crash everything.
+		   Maybe fix later if and when we make a better error handling system */
+
+		FAIL("Calling descriptor failed.");
+	}
+
+	assert(VALUE_IS_NIL(descriptor_return_val));
+
+	value_array_free(&descriptor_args);
+}
+
+void object_set_attribute(Object* object, ObjectString* name, Value value) {
+	/* Shapes tell attribute names apart by pointer, so a name made at runtime is swapped for the interned one */
+	name = object_string_intern(name);
+
+	Value descriptor_value;
+	if (load_attribute_bypass_descriptors(object, name, &descriptor_value)) {
+		if (object_is_descriptor(descriptor_value)) {
+			set_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(descriptor_value), value);
 			return;
 		}
 	}
 
-	cell_table_set_value_cstring_key(&object->attributes, key, value);
+	if (object->type == OBJECT_CLASS) {
+		object_invalidate_attribute_caches();
+	}
+
+	set_own_attribute(object, name, value);
+}
+
+void object_set_attribute_cstring_key(Object* object, const char* key, Value value) {
+	object_set_attribute(object, object_string_copy_from_null_terminated(key), value);
 }
 
 static Value function_value_to_bound_method(Value func_value, Object* self) {
 	assert(object_value_is(func_value, OBJECT_FUNCTION));
 
-	ObjectFunction* function = (ObjectFunction*) func_value.as.object;
+	ObjectFunction* function = (ObjectFunction*) VALUE_AS_OBJECT(func_value);
 	ObjectBoundMethod* bound_method = object_bound_method_new(function, self);
 	return MAKE_VALUE_OBJECT(bound_method);
 }
 
+static void load_attribute_through_descriptor(Object* object, ObjectString* name, ObjectInstance* descriptor, Value* out) {
+	Value get_method_val;
+	if (!object_load_attribute((Object*) descriptor, vm.symbols.get, &get_method_val)) {
+		FAIL("Found a descriptor without a @get method - currently shouldn't be possible.");
+	}
+
+	assert(object_value_is(get_method_val, OBJECT_FUNCTION) || object_value_is(get_method_val, OBJECT_BOUND_METHOD));
+
+	ValueArray get_args = value_array_make(2, (Value[]) {MAKE_VALUE_OBJECT(object), MAKE_VALUE_OBJECT(name)});
+	if (vm_call_object(VALUE_AS_OBJECT(get_method_val), get_args, out) != CALL_RESULT_SUCCESS) {
+		/* Currently failing for this. Later possibly find a better solution. Possibly not,
+		   if we don't expose descriptors as a user feature */
+		FAIL("Descriptor @get failed.");
+	}
+	value_array_free(&get_args);
+}
+
 bool object_load_attribute(Object* object, ObjectString* name, Value* out) {
 	if (!load_attribute_bypass_descriptors(object, name, out)) {
 		return false;
 	}
 
-	if (is_value_instance_of_class(*out, "Descriptor")) {
-		assert(object_value_is(*out, OBJECT_INSTANCE));
+	if (object_is_descriptor(*out)) {
+		load_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(*out), out);
+	}
+
+	return true;
+}
+
+bool object_load_attribute_cstring_key(Object* object, const char* name, Value* out) {
+	return object_load_attribute(object, object_string_copy_from_null_terminated(name), out);
+}
+
+/* Bumped whenever the attributes of some class are defined or replaced, which invalidates all attribute caches at once.
+   Classes are mostly defined up front, so this is rare once a program is running. */
+static unsigned int attribute_cache_epoch = 1;
+
+void object_invalidate_attribute_caches(void) {
+	attribute_cache_epoch++;
+}
 
-		ObjectInstance* descriptor = (ObjectInstance*) out->as.object;
-		Value get_method_val;
-		if (!object_load_attribute_cstring_key((Object*) descriptor, "@get", &get_method_val)) {
-			FAIL("Found a descriptor without a @get method - currently shouldn't be possible.");
+static ObjectCell* find_class_attribute_cell(ObjectClass* klass, ObjectString* name) {
+	for (; klass != NULL; klass = klass->superclass) {
+		ObjectCell* cell;
+		if (get_attributes_cell((Object*) klass, name, &cell) && cell->is_filled) {
+			return cell;
 		}
+	}
 
-		assert(object_value_is(get_method_val, OBJECT_FUNCTION) || object_value_is(get_method_val, OBJECT_BOUND_METHOD));
+	return NULL;
+}
 
-		ValueArray get_args = value_array_make(2, (Value[]) {MAKE_VALUE_OBJECT(object), MAKE_VALUE_OBJECT(name)});
-		if (vm_call_object(get_method_val.as.object, get_args, out) != CALL_RESULT_SUCCESS) {
-			/* Currently failing for this. Later possibly find a better solution. Possibly not,
-			   if we don't expose descriptors as a user feature */
-			FAIL("Descriptor @get failed.");
+/* Returns the entry of the cache for the shape of the instance, filling it on a miss.
+   Instances in dictionary mode share an entry per class. */
+static AttributeCacheEntry* attribute_cache_lookup(AttributeCache* cache, ObjectInstance* instance, ObjectString* name) {
+	if (cache->epoch != attribute_cache_epoch) {
+		cache->epoch = attribute_cache_epoch;
+		cache->count = 0;
+		cache->next_replaced = 0;
+	}
+
+	for (int i = 0; i < cache->count; i++) {
+		AttributeCacheEntry* entry = &cache->entries[i];
+		if (entry->shape == instance->shape && entry->klass == instance->klass) {
+			return entry;
 		}
-		value_array_free(&get_args);
 	}
 
+	AttributeCacheEntry* entry;
+	if (cache->count < ATTRIBUTE_CACHE_SIZE) {
+		entry = &cache->entries[cache->count++];
+	} else {
+		entry = &cache->entries[cache->next_replaced];
+		cache->next_replaced = (cache->next_replaced + 1) % ATTRIBUTE_CACHE_SIZE;
+	}
+
+	entry->klass = instance->klass;
+	entry->shape = instance->shape;
+	entry->field_index = instance->shape == NULL ? -1 : shape_find_field(instance->shape, name);
+	entry->class_cell = find_class_attribute_cell(instance->klass, name);
+	entry->transition = NULL;
+	return entry;
+}
+
+/* Same as object_load_attribute, but for an instance the shape and class chain are only searched the first time
+   an instance of its shape comes through the cache. After that a field is loaded directly by its index. */
+bool object_load_attribute_cached(Object* object, ObjectString* name, AttributeCache* cache, Value* out) {
+	if (object->type != OBJECT_INSTANCE) {
+		return object_load_attribute(object, name, out);
+	}
+
+	ObjectInstance* instance = (ObjectInstance*) object;
+	AttributeCacheEntry* entry = attribute_cache_lookup(cache, instance, name);
+
+	Value value;
+	if (entry->field_index >= 0) {
+		value = instance->fields[entry->field_index];
+	} else if (instance->shape == NULL && get_attributes_value(object, name, &value)) {
+		/* Own attribute of an instance in dictionary mode */
+	} else {
+		ObjectCell* class_cell = entry->class_cell;
+
+		if (class_cell == NULL) {
+			return false;
+		}
+
+		if (!class_cell->is_filled) {
+			/* Emptied since it was cached */
+			return object_load_attribute(object, name, out);
+		}
+
+		value = class_cell->value;
+		if (object_value_is(value, OBJECT_FUNCTION)) {
+			value = MAKE_VALUE_OBJECT(object_bound_method_new((ObjectFunction*) VALUE_AS_OBJECT(value), object));
+		}
+	}
+
+	if (object_is_descriptor(value)) {
+		load_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(value), out);
+		return true;
+	}
+
+	*out = value;
 	return true;
 }
 
-bool object_load_attribute_cstring_key(Object* object, const char* name, Value* out) {
-	return object_load_attribute(object, object_string_copy_from_null_terminated(name), out);
+/* Same as object_find_method, but for an instance the shape and class chain are only searched the first time
+   an instance of its shape comes through the cache */
+bool object_find_method_cached(Object* object, ObjectString* name, AttributeCache* cache, ObjectFunction** out) {
+	if (object->type != OBJECT_INSTANCE) {
+		return object_find_method(object, name, out);
+	}
+
+	ObjectInstance* instance = (ObjectInstance*) object;
+	AttributeCacheEntry* entry = attribute_cache_lookup(cache, instance, name);
+
+	if (entry->field_index >= 0) {
+		return false;
+	}
+
+	Value own_value;
+	if (instance->shape == NULL && get_attributes_value(object, name, &own_value)) {
+		return false;
+	}
+
+	ObjectCell* class_cell = entry->class_cell;
+	if (class_cell == NULL || !class_cell->is_filled || !object_value_is(class_cell->value, OBJECT_FUNCTION)) {
+		return false;
+	}
+
+	*out = (ObjectFunction*) VALUE_AS_OBJECT(class_cell->value);
+	return true;
+}
+
+/* Same as object_set_attribute, but for an instance the shape and class chain are only searched the first time
+   an instance of its shape comes through the cache. After that a field is stored directly by its index,
+   or added by moving the instance to the cached next shape. */
+void object_set_attribute_cached(Object* object, ObjectString* name, Value value, AttributeCache* cache) {
+	if (object->type != OBJECT_INSTANCE) {
+		object_set_attribute(object, name, value);
+		return;
+	}
+
+	ObjectInstance* instance = (ObjectInstance*) object;
+	AttributeCacheEntry* entry = attribute_cache_lookup(cache, instance, name);
+
+	if (entry->field_index >= 0) {
+		Value* field = &instance->fields[entry->field_index];
+		if (object_is_descriptor(*field)) {
+			set_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(*field), value);
+		} else {
+			*field = value;
+			heap_write_barrier(object, value);
+		}
+		return;
+	}
+
+	if (instance->shape == NULL) {
+		ObjectCell* own_cell;
+		if (get_attributes_cell(object, name, &own_cell) && own_cell->is_filled) {
+			if (object_is_descriptor(own_cell->value)) {
+				set_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(own_cell->value), value);
+			} else {
+				own_cell->value = value;
+				heap_write_barrier((Object*) own_cell, value);
+			}
+			return;
+		}
+	}
+
+	ObjectCell* class_cell = entry->class_cell;
+	if (class_cell != NULL && class_cell->is_filled && object_is_descriptor(class_cell->value)) {
+		set_attribute_through_descriptor(object, name, (ObjectInstance*) VALUE_AS_OBJECT(class_cell->value), value);
+		return;
+	}
+
+	if (instance->shape != NULL) {
+		if (entry->transition == NULL) {
+			entry->transition = shape_add_field(instance->shape, name);
+		}
+
+		if (entry->transition != NULL) {
+			instance_add_field(instance, entry->transition, value);
+			return;
+		}
+
+		instance_to_dictionary_mode(instance);
+	}
+
+	cell_table_set_value(object_attributes(object), name, value);
 }
 
 /* TODO: Rename is_instance functions to object_* namespace */
@@ -950,7 +1314,7 @@ bool is_value_instance_of_class(Value value, char* klass_name) {
         return false;
     }
 
-    return is_instance_of_class(value.as.object, klass_name);
+    return is_instance_of_class(VALUE_AS_OBJECT(value), klass_name);
 }
 
 ObjectFunction* object_make_constructor(int num_params, char** params, NativeFunction function) {
@@ -961,13 +1325,13 @@ bool object_is_callable(Object* object) {
 	return object->type == OBJECT_FUNCTION || object->type == OBJECT_BOUND_METHOD || object->type == OBJECT_CLASS;
 }
 
-char* object_get_callable_name(Object* object) {
+const char* object_get_callable_name(Object* object) {
 	switch (object->type) {
 		case OBJECT_FUNCTION: {
-			return ((ObjectFunction*) object)->name;
+			return object_function_name((ObjectFunction*) object);
 		}
 		case OBJECT_BOUND_METHOD: {
-			return ((ObjectBoundMethod*) object)->method->name;
+			return object_function_name(((ObjectBoundMethod*) object)->method);
 		}
 		case OBJECT_CLASS: {
 			return ((ObjectClass*) object)->name;
@@ -8,6 +8,7 @@
 #include "table.h"
 #include "value.h"
 #include "cell_table.h"
+#include "shape.h"
 
 typedef enum {
     OBJECT_STRING,
@@ -27,18 +28,22 @@ typedef enum {
 	METHOD_ACCESS_ATTR_NOT_BOUND_METHOD
 } MethodAccessResult;
 
+/* Objects are allocated from the heap (heap.h), which also keeps their mark bits. So the header only holds the type,
+   and the attributes of the object itself - allocated on the first write, since most objects never get any. */
 typedef struct Object {
     ObjectType type;
-    struct Object* next;
-    CellTable attributes;
-    bool is_reachable;
+    CellTable* attributes; /* NULL until the object gets an attribute of its own */
 } Object;
 
+/* Only names and literals are interned. Strings made at runtime - concatenations, input, file contents - aren't, and aren't
+   hashed until something needs the hash, so equal strings may be different objects unless both are interned. */
 typedef struct ObjectString {
     Object base;
     char* chars; /* Guaranteed to be NULL terminated */
     int length;
-	unsigned long hash;
+	bool is_interned;
+	bool is_hashed;
+	unsigned long hash; /* Only valid once is_hashed - read it through object_string_hash */
 } ObjectString;
 
 typedef struct ObjectTable {
@@ -46,9 +51,13 @@ typedef struct ObjectTable {
     Table table;
 } ObjectTable;
 
+/* The compiled code of a function, or of a module or class body. Made once when it's compiled, and never changed after,
+   so it's the prototype of all the functions made from it: they share its code and parameters */
 typedef struct ObjectCode {
     Object base;
     Bytecode bytecode;
+    ObjectString** parameters;
+    int num_params;
 } ObjectCode;
 
 typedef bool (*NativeFunction)(Object*, ValueArray, Value*);
@@ -59,17 +68,21 @@ typedef struct ObjectCell {
 	bool is_filled;
 } ObjectCell;
 
+/* A function made from code is just a closure over it - the code, and the cells of its upvalues, which follow the struct.
+   So making one is a single allocation. */
 typedef struct ObjectFunction {
     Object base;
-    char* name;
-	ObjectString** parameters;
+    ObjectString* name; /* The variable the function was last assigned to. NULL until then */
+	ObjectString** parameters; /* Owned by native functions. Functions made from code share those of the code */
     int num_params;
     bool is_native;
-    CellTable free_vars;
+    struct ObjectModule* module; /* Where the global variables of the function live. NULL for native functions */
     union {
     	NativeFunction native_function;
     	ObjectCode* code;
     };
+    int num_upvalues;
+    ObjectCell* upvalues[]; /* Cell of each upvalue of the code, or NULL where the creating frame had none by the name */
 } ObjectFunction;
 
 typedef struct ObjectModule {
@@ -102,12 +115,20 @@ typedef struct ObjectClass {
 	size_t instance_size;
 	DeallocationFunction dealloc_func;
 	GcMarkFunction gc_mark_func;
+	Shape* root_shape; /* Instances of the class start out with this shape */
+	int instance_inline_fields; /* Inline fields new instances are allocated with - the most fields an instance got so far */
 } ObjectClass;
 
+#define INSTANCE_MAX_INLINE_FIELDS 8
+
 typedef struct ObjectInstance {
 	Object base;
 	ObjectClass* klass;
 	bool is_initialized;
+	Shape* shape; /* NULL for an instance in dictionary mode, whose attributes are kept in base.attributes instead */
+	Value* fields; /* Values of the fields of the shape. Points at the inline fields until more are needed */
+	int fields_capacity;
+	int inline_fields_capacity; /* Inline fields follow the struct. Only instances of Ribbon classes have them */
 } ObjectInstance;
 
 typedef struct ObjectBoundMethod {
@@ -118,17 +139,21 @@ typedef struct ObjectBoundMethod {
 
 ObjectString* object_string_copy(const char* string, int length);
 ObjectString* object_string_take(char* chars, int length);
+ObjectString* object_string_take_uninterned(char* chars, int length); /* For runtime results, which are rarely looked up by name */
+ObjectString* object_string_intern(ObjectString* string); /* The interned string equal to this one - possibly itself */
 ObjectString* object_string_clone(ObjectString* original);
 ObjectString** object_create_copied_strings_array(const char** strings, int num, const char* allocDescription);
 ObjectString* object_string_copy_from_null_terminated(const char* string);
 ObjectString* object_string_new_partial_from_null_terminated(char* chars);
 
-ObjectFunction* object_user_function_new(ObjectCode* code, ObjectString** parameters, int numParams, CellTable free_vars);
+/* The upvalues of the function start out NULL, for the creator to fill in */
+ObjectFunction* object_user_function_new(ObjectCode* code);
 ObjectFunction* object_native_function_new(NativeFunction nativeFunction, ObjectString** parameters, int numParams);
-void object_function_set_name(ObjectFunction* function, char* name);
+void object_function_set_name(ObjectFunction* function, ObjectString* name);
+const char* object_function_name(ObjectFunction* function);
 ObjectFunction* make_native_function_with_params(char* name, int num_params, char** params, NativeFunction function);
 
-ObjectCode* object_code_new(Bytecode chunk);
+ObjectCode* object_code_new(Bytecode chunk, ObjectString** parameters, int num_params); /* Takes ownership of parameters */
 
 ObjectTable* object_table_new(Table table);
 ObjectTable* object_table_new_empty(void);
@@ -142,6 +167,10 @@ ObjectClass* object_class_native_new(
 		GcMarkFunction gc_mark_func, ObjectFunction* constructor, void* descriptors[][2]);
 void object_class_set_name(ObjectClass* klass, char* name);
 
+ObjectClass* object_string_class_new(void);
+ObjectClass* object_table_class_new(void);
+ObjectClass* object_descriptor_class_new(void);
+
 ObjectInstance* object_instance_new(ObjectClass* klass);
 
 ObjectModule* object_module_new(ObjectString* name, ObjectFunction* function);
@@ -153,7 +182,13 @@ bool object_compare(Object* a, Object* b);
 
 bool object_strings_equal(ObjectString* a, ObjectString* b);
 
-void object_free(Object* object);
+unsigned long object_string_compute_hash(ObjectString* string);
+
+static inline unsigned long object_string_hash(ObjectString* string) {
+	return string->is_hashed ? string->hash : object_string_compute_hash(string);
+}
+
+void object_free(Object* object); /* Frees what the object owns. The memory of the object itself belongs to the heap */
 void object_print(Object* o);
 void object_print_all_objects(void);
 
@@ -170,14 +205,28 @@ ObjectFunction* object_as_function(Object* o);
 
 bool object_value_is(Value value, ObjectType type);
 
+/* The table of the object's own attributes, allocated if it has none yet. Only for writing - reads should treat NULL as empty. */
+CellTable* object_attributes(Object* object);
+
+void object_set_attribute(Object* object, ObjectString* name, Value value);
 void object_set_attribute_cstring_key(Object* object, const char* key, Value value);
 
 bool object_load_attribute(Object* object, ObjectString* name, Value* out);
 bool object_load_attribute_cstring_key(Object* object, const char* name, Value* out);
+
+bool object_load_attribute_cached(Object* object, ObjectString* name, AttributeCache* cache, Value* out);
+void object_set_attribute_cached(Object* object, ObjectString* name, Value value, AttributeCache* cache);
+void object_invalidate_attribute_caches(void);
 bool load_attribute_bypass_descriptors(Object* object, ObjectString* name, Value* out); /* Internal: only external to be used by some tests */
 
+/* Finds a method the object gets from its class, so it can be called with the object as self without creating a bound method.
+   Returns false if the attribute is anything else, in which case it should be loaded with object_load_attribute */
+bool object_find_method(Object* object, ObjectString* name, ObjectFunction** out);
+bool object_find_method_cached(Object* object, ObjectString* name, AttributeCache* cache, ObjectFunction** out);
+
 ObjectInstance* object_descriptor_new(ObjectFunction* get, ObjectFunction* set);
 ObjectInstance* object_descriptor_new_native(NativeFunction get, NativeFunction set);
+bool object_is_descriptor(Value value);
 
 bool is_instance_of_class(Object* object, char* klass_name);
 bool is_value_instance_of_class(Value value, char* klass_name);
@@ -185,17 +234,17 @@ bool is_value_instance_of_class(Value value, char* klass_name);
 ObjectFunction* object_make_constructor(int num_params, char** params, NativeFunction function);
 
 bool object_is_callable(Object* object);
-char* object_get_callable_name(Object* object);
+const char* object_get_callable_name(Object* object);
 
 const char* object_get_type_name(Object* object);
 
 ObjectClass* object_get_superclass(Object* object);
 
-#define VALUE_AS_OBJECT(value, object_type, cast) object_value_is(value, object_type) ? (cast*) value.as.object : NULL
+#define VALUE_AS_OBJECT_OF_TYPE(value, object_type, cast) object_value_is(value, object_type) ? (cast*) VALUE_AS_OBJECT(value) : NULL
 
 #define ASSERT_VALUE_AS_OBJECT(variable, value, object_type, cast, error) \
 	do { \
-		variable = VALUE_AS_OBJECT((value), object_type, cast); \
+		variable = VALUE_AS_OBJECT_OF_TYPE((value), object_type, cast); \
 		if (variable == NULL) { \
 			FAIL(error); \
 		} \
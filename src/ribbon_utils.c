@@ -64,6 +64,26 @@ unsigned int hash_int(unsigned int x) {
     return x;
 }
 
+/* The finalizer of MurmurHash3 - spreads every bit of the input over the whole result */
+uint64_t hash_mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t hash_double(double number) {
+    if (number == 0) {
+        number = 0; /* -0 and 0 are equal, so they have to hash the same */
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(bits));
+    return hash_mix64(bits);
+}
+
 char* concat_cstrings(const char* str1, int str1_length, const char* str2, int str2_length, const char* alloc_string) {
 	size_t file_name_buffer_size = str1_length + str2_length + 1;
 	char* result = allocate(file_name_buffer_size, alloc_string);
@@ -198,20 +218,20 @@ static bool argument_matches(Value value, const char** c) {
 	int type_length = strcspn(*c, " |");
 
 	if (**c == 'n') {
-		if (value.type != VALUE_NUMBER) {
+		if (!VALUE_IS_NUMBER(value)) {
 			matching = false;
 		}
 	} else if (**c == 'b') {
-		if (value.type != VALUE_BOOLEAN) {
+		if (!VALUE_IS_BOOLEAN(value)) {
 			matching = false;
 		}
 	} else if (**c == 'i') {
-		if (value.type != VALUE_NIL) {
+		if (!VALUE_IS_NIL(value)) {
 			matching = false;
 		}
 	} else if (**c == 'o') {
-		if (value.type == VALUE_OBJECT) {
-			Object* object = value.as.object;
+		if (VALUE_IS_OBJECT(value)) {
+			Object* object = VALUE_AS_OBJECT(value);
 			
 			if (cstrings_equal((*c) + 1, type_length - 1, "String", strlen("String"))) {
 				if (object->type != OBJECT_STRING) {
@@ -18,6 +18,8 @@ char* copy_null_terminated_cstring(const char* string, const char* what);
 unsigned long hash_string(const char* string);
 unsigned long hash_string_bounded(const char* string, int length);
 unsigned int hash_int(unsigned int x);
+uint64_t hash_mix64(uint64_t x);
+uint64_t hash_double(double number);
 
 char* concat_cstrings(const char* str1, int str1_length, const char* str2, int str2_length, const char* alloc_string);
 char* concat_null_terminated_cstrings(const char* str1, const char* str2, const char* alloc_string);
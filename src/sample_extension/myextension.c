@@ -24,13 +24,13 @@ static bool multiply(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    if (args.values[0].type != VALUE_NUMBER || args.values[1].type != VALUE_NUMBER) {
+    if (!VALUE_IS_NUMBER(args.values[0]) || !VALUE_IS_NUMBER(args.values[1])) {
         *out = MAKE_VALUE_NIL();
         return false;
     }
 
-    double num1 = args.values[0].as.number;
-    double num2 = args.values[1].as.number;
+    double num1 = VALUE_AS_NUMBER(args.values[0]);
+    double num2 = VALUE_AS_NUMBER(args.values[1]);
     *out = MAKE_VALUE_NUMBER(num1 * num2);
     return true;
 }
@@ -47,7 +47,7 @@ static void my_thing_b_dealloc(ObjectInstance* instance) {
 
 static bool my_thing_a_init(Object* self, ValueArray args, Value* out) {
     ObjectInstanceMyThingA* a = (ObjectInstanceMyThingA*) self;
-    ObjectString* text = (ObjectString*) args.values[0].as.object;
+    ObjectString* text = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
     a->dynamic_memory = ribbon.copy_cstring(text->chars, text->length, ribbon.EXTENSION_ALLOC_STRING_CSTRING);
     a->x = 0;
     *out = MAKE_VALUE_NIL();
@@ -56,7 +56,7 @@ static bool my_thing_a_init(Object* self, ValueArray args, Value* out) {
 
 static bool my_thing_b_init(Object* self, ValueArray args, Value* out) {
     ObjectInstanceMyThingB* b = (ObjectInstanceMyThingB*) self;
-    b->a = (ObjectInstanceMyThingA*) args.values[0].as.object;
+    b->a = (ObjectInstanceMyThingA*) VALUE_AS_OBJECT(args.values[0]);
     *out = MAKE_VALUE_NIL();
     return true;
 }
@@ -77,7 +77,7 @@ static bool my_thing_a_get_text(Object* self, ValueArray args, Value* out) {
 
 static bool my_thing_b_get_text_multiplied(Object* self, ValueArray args, Value* out) {
     ObjectInstanceMyThingB* b = (ObjectInstanceMyThingB*) self;
-    int times = args.values[0].as.number;
+    int times = VALUE_AS_NUMBER(args.values[0]);
 
     ValueArray get_text_args;
     ribbon.value_array_init(&get_text_args);
@@ -88,7 +88,7 @@ static bool my_thing_b_get_text_multiplied(Object* self, ValueArray args, Value*
     }
     ribbon.value_array_free(&get_text_args);
 
-    ObjectString* text = (ObjectString*) text_out.as.object;
+    ObjectString* text = (ObjectString*) VALUE_AS_OBJECT(text_out);
 
     char* buffer = ribbon.allocate(text->length * times + 1, ribbon.EXTENSION_ALLOC_STRING_CSTRING);
     for (char* cursor = buffer; cursor < buffer + (text->length * times); cursor += text->length) {
@@ -108,8 +108,8 @@ static bool my_thing_a_descriptor_get(Object* self, ValueArray args, Value* out)
     assert(ribbon.is_value_instance_of_class(args.values[0], "MyThingA"));
     assert(ribbon.object_value_is(args.values[1], OBJECT_STRING));
 
-    ObjectInstanceMyThingA* thing = (ObjectInstanceMyThingA*) args.values[0].as.object;
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
+    ObjectInstanceMyThingA* thing = (ObjectInstanceMyThingA*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
     assert(ribbon.cstrings_equal(attr_name->chars, attr_name->length, "x", 1));
 
@@ -123,12 +123,12 @@ static bool my_thing_a_descriptor_set(Object* self, ValueArray args, Value* out)
     assert(args.count == 3);
     assert(ribbon.is_value_instance_of_class(args.values[0], "MyThingA"));
     assert(ribbon.object_value_is(args.values[1], OBJECT_STRING));
-    assert(args.values[2].type == VALUE_NUMBER); /* Not the way to do this in real code, but good for testing right now at least */
+    assert(VALUE_IS_NUMBER(args.values[2])); /* Not the way to do this in real code, but good for testing right now at least */
 
 
-    ObjectInstanceMyThingA* thing = (ObjectInstanceMyThingA*) args.values[0].as.object;
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
-    double value = args.values[2].as.number;
+    ObjectInstanceMyThingA* thing = (ObjectInstanceMyThingA*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
+    double value = VALUE_AS_NUMBER(args.values[2]);
 
     assert(ribbon.cstrings_equal(attr_name->chars, attr_name->length, "x", 1));
 
@@ -191,7 +191,7 @@ static bool square(Object* self, ValueArray args, Value* out) {
     ribbon.value_array_write(&multiply_args, &number);
     ribbon.value_array_write(&multiply_args, &number);
     Value sqr_result;
-    ribbon.vm_call_function((ObjectFunction*) multiply_method_val.as.object, multiply_args, &sqr_result);
+    ribbon.vm_call_function((ObjectFunction*) VALUE_AS_OBJECT(multiply_method_val), multiply_args, &sqr_result);
     ribbon.value_array_free(&multiply_args);
 
     printf("Returned from multiply(). Returning the value.\n");
@@ -218,7 +218,7 @@ static bool more_talk_with_other_extension(Object* self, ValueArray args, Value*
         FAIL("MyThingA of myuserextension isn't a class.");
     }
 
-    ObjectClass* my_thing_a = (ObjectClass*) mythinga_val.as.object;
+    ObjectClass* my_thing_a = (ObjectClass*) VALUE_AS_OBJECT(mythinga_val);
     ValueArray mythinga_args;
     ribbon.value_array_init(&mythinga_args);
     ribbon.value_array_write(&mythinga_args, &MAKE_VALUE_OBJECT(ribbon.object_string_copy_from_null_terminated("Hyelloooo!")));
@@ -228,7 +228,7 @@ static bool more_talk_with_other_extension(Object* self, ValueArray args, Value*
 
     assert(ribbon.object_value_is(instance_val, OBJECT_INSTANCE));
 
-    ObjectInstance* instance = (ObjectInstance*) instance_val.as.object;
+    ObjectInstance* instance = (ObjectInstance*) VALUE_AS_OBJECT(instance_val);
 
     assert(ribbon.cstrings_equal(instance->klass->name, strlen(instance->klass->name), "MyThingA", strlen("MyThingA")));
 
@@ -237,7 +237,7 @@ static bool more_talk_with_other_extension(Object* self, ValueArray args, Value*
 
     assert(ribbon.object_value_is(get_text_val, OBJECT_BOUND_METHOD));
 
-    ObjectBoundMethod* get_text = (ObjectBoundMethod*) get_text_val.as.object;
+    ObjectBoundMethod* get_text = (ObjectBoundMethod*) VALUE_AS_OBJECT(get_text_val);
 
     ValueArray get_text_args;
     ribbon.value_array_init(&get_text_args);
@@ -245,7 +245,7 @@ static bool more_talk_with_other_extension(Object* self, ValueArray args, Value*
     ribbon.vm_call_bound_method(get_text, get_text_args, &get_text_result); 
     ribbon.value_array_free(&get_text_args);
     
-    ObjectString* text = (ObjectString*) get_text_result.as.object;
+    ObjectString* text = (ObjectString*) VALUE_AS_OBJECT(get_text_result);
     size_t string_length = snprintf(NULL, 0, "Text received from MyThingA::get_text(): %.*s", text->length, text->chars);
     char* buffer = ribbon.allocate(string_length + 1, ribbon.EXTENSION_ALLOC_STRING_CSTRING);
     snprintf(buffer, string_length + 1, "Text received from MyThingA::get_text(): %.*s", text->length, text->chars);
@@ -266,8 +266,8 @@ static bool more_talk_with_other_extension(Object* self, ValueArray args, Value*
     // }
     ribbon.value_array_free(&multiply_args);
 
-    assert(multiply_result.type == VALUE_NUMBER);
-    // if (multiply_result.type != VALUE_NUMBER) {
+    assert(VALUE_IS_NUMBER(multiply_result));
+    // if (!VALUE_IS_NUMBER(multiply_result)) {
     //     FAIL("multiply() function of myuserextension returned something other than VALUE_NUMBER, and that's weird.");
     // }
 
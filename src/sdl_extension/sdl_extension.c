@@ -56,12 +56,12 @@ static bool window_init(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectString* title_arg = (ObjectString*) (args.values[0].as.object);
-    double x_arg = args.values[1].as.number;
-    double y_arg = args.values[2].as.number;
-    double w_arg = args.values[3].as.number;
-    double h_arg = args.values[4].as.number;
-    double flags_arg = args.values[5].as.number;
+    ObjectString* title_arg = (ObjectString*) (VALUE_AS_OBJECT(args.values[0]));
+    double x_arg = VALUE_AS_NUMBER(args.values[1]);
+    double y_arg = VALUE_AS_NUMBER(args.values[2]);
+    double w_arg = VALUE_AS_NUMBER(args.values[3]);
+    double h_arg = VALUE_AS_NUMBER(args.values[4]);
+    double flags_arg = VALUE_AS_NUMBER(args.values[5]);
 
     char* title = ribbon.copy_cstring(title_arg->chars, title_arg->length, ribbon.EXTENSION_ALLOC_STRING_CSTRING);
     SDL_Window* window = SDL_CreateWindow(title, x_arg, y_arg, w_arg, h_arg, flags_arg);
@@ -88,9 +88,9 @@ static bool renderer_init(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceWindow* window = (ObjectInstanceWindow*) args.values[0].as.object;
-    int index = args.values[1].as.number;
-    Uint32 flags = args.values[2].as.number;
+    ObjectInstanceWindow* window = (ObjectInstanceWindow*) VALUE_AS_OBJECT(args.values[0]);
+    int index = VALUE_AS_NUMBER(args.values[1]);
+    Uint32 flags = VALUE_AS_NUMBER(args.values[2]);
 
     /* Hopefully passing window->window is safe and makes sense? I think it is */
     SDL_Renderer* renderer = SDL_CreateRenderer(window->window, index, flags);
@@ -114,10 +114,10 @@ static bool rect_init(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    double x = args.values[0].as.number;
-    double y = args.values[1].as.number;
-    double w = args.values[2].as.number;
-    double h = args.values[3].as.number;
+    double x = VALUE_AS_NUMBER(args.values[0]);
+    double y = VALUE_AS_NUMBER(args.values[1]);
+    double w = VALUE_AS_NUMBER(args.values[2]);
+    double h = VALUE_AS_NUMBER(args.values[3]);
 
     SDL_Rect rect = {.x = x, .y = y, .w = w, .h = h};
     instance->rect = rect;
@@ -131,7 +131,7 @@ static bool rect_descriptor_get(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    Object* object = args.values[0].as.object;
+    Object* object = VALUE_AS_OBJECT(args.values[0]);
 
     assert(ribbon.is_instance_of_class(object, "Rect"));
 
@@ -139,7 +139,7 @@ static bool rect_descriptor_get(Object* self, ValueArray args, Value* out) {
 
     assert(ribbon.object_value_is(args.values[1], OBJECT_STRING));
 
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
     char* attr_name_cstring = attr_name->chars;
     int attr_name_length = attr_name->length;
@@ -164,7 +164,7 @@ static bool rect_descriptor_set(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    Object* object = args.values[0].as.object;
+    Object* object = VALUE_AS_OBJECT(args.values[0]);
 
     assert(ribbon.is_instance_of_class(object, "Rect"));
 
@@ -172,10 +172,10 @@ static bool rect_descriptor_set(Object* self, ValueArray args, Value* out) {
 
     assert(ribbon.object_value_is(args.values[1], OBJECT_STRING));
 
-    assert(args.values[2].type == VALUE_NUMBER);
+    assert(VALUE_IS_NUMBER(args.values[2]));
 
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
-    double value = args.values[2].as.number;
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
+    double value = VALUE_AS_NUMBER(args.values[2]);
 
     char* attr_name_cstring = attr_name->chars;
     int attr_name_length = attr_name->length;
@@ -203,13 +203,13 @@ static bool event_descriptor_get(Object* self, ValueArray args, Value* out) {
 
     assert(args.count == 2);
 
-    Object* object = args.values[0].as.object;
+    Object* object = VALUE_AS_OBJECT(args.values[0]);
 
     assert(ribbon.is_instance_of_class(object, "Event"));
 
     ObjectInstanceEvent* event = (ObjectInstanceEvent*) object;
 
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
     char* attr_name_cstring = attr_name->chars;
     int attr_name_length = attr_name->length;
@@ -234,14 +234,14 @@ static bool event_descriptor_set(Object* self, ValueArray args, Value* out) {
 
     assert(args.count == 3);
 
-    Object* object = args.values[0].as.object;
+    Object* object = VALUE_AS_OBJECT(args.values[0]);
 
     assert(ribbon.is_instance_of_class(object, "Event"));
 
     ObjectInstanceEvent* event = (ObjectInstanceEvent*) object;
 
-    ObjectString* attr_name = (ObjectString*) args.values[1].as.object;
-    double value = args.values[2].as.number;
+    ObjectString* attr_name = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
+    double value = VALUE_AS_NUMBER(args.values[2]);
 
     char* attr_name_cstring = attr_name->chars;
     int attr_name_length = attr_name->length;
@@ -269,12 +269,13 @@ static bool texture_init(Object* self, ValueArray args, Value* out) {
 
     ObjectInstanceTexture* texture_instance = (ObjectInstanceTexture*) self;
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
-    ObjectString* filename = (ObjectString*) args.values[1].as.object;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectString* filename = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
     /* Cloning makes sure it's null delimited */
     ObjectString* file_null_delimited = ribbon.object_string_clone(filename);
     ribbon.table_set(&owned_strings->table, MAKE_VALUE_NUMBER(owned_string_counter++), MAKE_VALUE_OBJECT(file_null_delimited));
+    ribbon.write_barrier((Object*) owned_strings, MAKE_VALUE_OBJECT(file_null_delimited));
 
     SDL_Texture* texture = IMG_LoadTexture(renderer->renderer, file_null_delimited->chars);
     
@@ -298,9 +299,9 @@ static bool event_init(Object* self, ValueArray args, Value* out) {
 
     ObjectInstanceEvent* instance = (ObjectInstanceEvent*) self;
 
-    int type = args.values[0].as.number;
-    int scancode = args.values[1].as.number;
-    int repeat = args.values[2].as.number; /* Non-zero if it's a key repeat */
+    int type = VALUE_AS_NUMBER(args.values[0]);
+    int scancode = VALUE_AS_NUMBER(args.values[1]);
+    int repeat = VALUE_AS_NUMBER(args.values[2]); /* Non-zero if it's a key repeat */
 
     instance->type = type;
     instance->scancode = scancode;
@@ -315,7 +316,7 @@ static bool init(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    int flags = args.values[0].as.number;
+    int flags = VALUE_AS_NUMBER(args.values[0]);
     double result = SDL_Init(flags);
     *out = MAKE_VALUE_NUMBER(result);
     return true;
@@ -335,15 +336,18 @@ static bool set_hint(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectString* name_arg = (ObjectString*) args.values[0].as.object;
-    ObjectString* value_arg = (ObjectString*) args.values[1].as.object;
+    ObjectString* name_arg = (ObjectString*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectString* value_arg = (ObjectString*) VALUE_AS_OBJECT(args.values[1]);
 
     /* cloning makes them null delimited */
     ObjectString* name = ribbon.object_string_clone(name_arg);
     ObjectString* value = ribbon.object_string_clone(value_arg);
 
+    /* owned_strings is old by now, and the strings are new - the barrier keeps the collector from missing them */
     ribbon.table_set(&owned_strings->table, MAKE_VALUE_NUMBER(owned_string_counter++), MAKE_VALUE_OBJECT(name));
+    ribbon.write_barrier((Object*) owned_strings, MAKE_VALUE_OBJECT(name));
     ribbon.table_set(&owned_strings->table, MAKE_VALUE_NUMBER(owned_string_counter++), MAKE_VALUE_OBJECT(value));
+    ribbon.write_barrier((Object*) owned_strings, MAKE_VALUE_OBJECT(value));
 
     bool result = SDL_SetHint(name->chars, value->chars);
     *out = MAKE_VALUE_BOOLEAN(result);
@@ -364,7 +368,7 @@ static bool img_init(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    int flags = args.values[0].as.number;
+    int flags = VALUE_AS_NUMBER(args.values[0]);
     int result = IMG_Init(flags);
     *out = MAKE_VALUE_NUMBER(result);
     return true;
@@ -382,7 +386,7 @@ static bool show_cursor(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    int toggle = args.values[0].as.number;
+    int toggle = VALUE_AS_NUMBER(args.values[0]);
     int result = SDL_ShowCursor(toggle);
     *out = MAKE_VALUE_NUMBER(result);
     return true;
@@ -393,7 +397,7 @@ static bool destroy_renderer(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
     if (renderer->renderer != NULL) {
         SDL_DestroyRenderer(renderer->renderer);
         renderer->renderer = NULL;
@@ -407,7 +411,7 @@ static bool destroy_window(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceWindow* window = (ObjectInstanceWindow*) args.values[0].as.object;
+    ObjectInstanceWindow* window = (ObjectInstanceWindow*) VALUE_AS_OBJECT(args.values[0]);
     if (window->window != NULL) {
         SDL_DestroyWindow(window->window);
         window->window = NULL;
@@ -470,19 +474,20 @@ static bool log_message(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    int category = args.values[0].as.number;
-    int priority = args.values[1].as.number;
-    ObjectString* message = (ObjectString*) args.values[2].as.object;
+    int category = VALUE_AS_NUMBER(args.values[0]);
+    int priority = VALUE_AS_NUMBER(args.values[1]);
+    ObjectString* message = (ObjectString*) VALUE_AS_OBJECT(args.values[2]);
 
     ObjectString* message_to_print;
 
     Value cached_val;
     if (ribbon.table_get(&cached_strings->table, MAKE_VALUE_OBJECT(message), &cached_val)) {
-        message_to_print = (ObjectString*) cached_val.as.object;
+        message_to_print = (ObjectString*) VALUE_AS_OBJECT(cached_val);
     } else {
         ObjectString* null_delimited_message = ribbon.object_string_clone(message);
         message_to_print = null_delimited_message;
         ribbon.table_set(&cached_strings->table, MAKE_VALUE_OBJECT(null_delimited_message), MAKE_VALUE_OBJECT(null_delimited_message));
+        ribbon.write_barrier((Object*) cached_strings, MAKE_VALUE_OBJECT(null_delimited_message));
     }
 
     SDL_LogMessage(category, priority, message_to_print->chars);
@@ -495,8 +500,8 @@ static bool query_texture(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) args.values[0].as.object;
-    ObjectTable* out_table = (ObjectTable*) args.values[1].as.object;
+    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectTable* out_table = (ObjectTable*) VALUE_AS_OBJECT(args.values[1]);
 
     Uint32 format;
     int access, width, height;
@@ -516,11 +521,11 @@ static bool set_render_draw_color(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
-    int r = args.values[1].as.number;
-    int g = args.values[2].as.number;
-    int b = args.values[3].as.number;
-    int a = args.values[4].as.number;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
+    int r = VALUE_AS_NUMBER(args.values[1]);
+    int g = VALUE_AS_NUMBER(args.values[2]);
+    int b = VALUE_AS_NUMBER(args.values[3]);
+    int a = VALUE_AS_NUMBER(args.values[4]);
 
     *out = MAKE_VALUE_NUMBER(SDL_SetRenderDrawColor(renderer->renderer, r, g, b, a));
     return true;   
@@ -531,7 +536,7 @@ static bool render_clear(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
     *out = MAKE_VALUE_NUMBER(SDL_RenderClear(renderer->renderer));
     return true;   
 }
@@ -541,7 +546,7 @@ static bool render_present(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
     SDL_RenderPresent(renderer->renderer);
     *out = MAKE_VALUE_NIL();
     return true;   
@@ -552,22 +557,22 @@ static bool render_copy(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
-    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) args.values[1].as.object;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
+    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) VALUE_AS_OBJECT(args.values[1]);
 
     SDL_Rect* src_rect;
-    if (args.values[2].type == VALUE_NIL) {
+    if (VALUE_IS_NIL(args.values[2])) {
         src_rect = NULL;
     } else {
-        ObjectInstanceRect* src_rect_instance = (ObjectInstanceRect*) args.values[2].as.object;
+        ObjectInstanceRect* src_rect_instance = (ObjectInstanceRect*) VALUE_AS_OBJECT(args.values[2]);
         src_rect = &src_rect_instance->rect;
     }
 
     SDL_Rect* dst_rect;
-    if (args.values[3].type == VALUE_NIL) {
+    if (VALUE_IS_NIL(args.values[3])) {
         dst_rect = NULL;
     } else {
-        ObjectInstanceRect* dst_rect_instance = (ObjectInstanceRect*) args.values[3].as.object;
+        ObjectInstanceRect* dst_rect_instance = (ObjectInstanceRect*) VALUE_AS_OBJECT(args.values[3]);
         dst_rect = &dst_rect_instance->rect;
     }
 
@@ -620,7 +625,7 @@ static bool delay(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    int ms = args.values[0].as.number;
+    int ms = VALUE_AS_NUMBER(args.values[0]);
     SDL_Delay(ms);
     *out = MAKE_VALUE_NIL();
     return true;
@@ -631,11 +636,11 @@ static bool render_draw_line(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
-    int x1 = args.values[1].as.number;
-    int y1 = args.values[2].as.number;
-    int x2 = args.values[3].as.number;
-    int y2 = args.values[4].as.number;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
+    int x1 = VALUE_AS_NUMBER(args.values[1]);
+    int y1 = VALUE_AS_NUMBER(args.values[2]);
+    int x2 = VALUE_AS_NUMBER(args.values[3]);
+    int y2 = VALUE_AS_NUMBER(args.values[4]);
 
     *out = MAKE_VALUE_NUMBER(SDL_RenderDrawLine(renderer->renderer, x1, y1, x2, y2));
     return true;
@@ -646,8 +651,8 @@ static bool set_render_draw_blend_mode(Object* self, ValueArray args, Value* out
         return false;
     }
 
-    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) args.values[0].as.object;
-    int blend_mode = args.values[1].as.number;
+    ObjectInstanceRenderer* renderer = (ObjectInstanceRenderer*) VALUE_AS_OBJECT(args.values[0]);
+    int blend_mode = VALUE_AS_NUMBER(args.values[1]);
 
     *out = MAKE_VALUE_NUMBER(SDL_SetRenderDrawBlendMode(renderer->renderer, blend_mode));
     return true;
@@ -658,8 +663,8 @@ static bool set_texture_blend_mode(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) args.values[0].as.object;
-    int blend_mode = args.values[1].as.number;
+    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) VALUE_AS_OBJECT(args.values[0]);
+    int blend_mode = VALUE_AS_NUMBER(args.values[1]);
 
     *out = MAKE_VALUE_NUMBER(SDL_SetTextureBlendMode(texture->texture, blend_mode));
     return true;
@@ -670,10 +675,10 @@ static bool set_texture_color_mod(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) args.values[0].as.object;
-    int r = args.values[1].as.number;
-    int g = args.values[2].as.number;
-    int b = args.values[3].as.number;
+    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) VALUE_AS_OBJECT(args.values[0]);
+    int r = VALUE_AS_NUMBER(args.values[1]);
+    int g = VALUE_AS_NUMBER(args.values[2]);
+    int b = VALUE_AS_NUMBER(args.values[3]);
 
     *out = MAKE_VALUE_NUMBER(SDL_SetTextureColorMod(texture->texture, r, g, b));
     return true;
@@ -684,8 +689,8 @@ static bool set_texture_alpha_mod(Object* self, ValueArray args, Value* out) {
         return false;
     }
 
-    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) args.values[0].as.object;
-    int alpha = args.values[1].as.number;
+    ObjectInstanceTexture* texture = (ObjectInstanceTexture*) VALUE_AS_OBJECT(args.values[0]);
+    int alpha = VALUE_AS_NUMBER(args.values[1]);
 
     *out = MAKE_VALUE_NUMBER(SDL_SetTextureAlphaMod(texture->texture, alpha));
     return true;
@@ -0,0 +1,57 @@
+#include "shape.h"
+#include "memory.h"
+#include "ribbon_object.h"
+
+static Shape* shape_new(Shape* parent, ObjectString* name, int field_count) {
+	Shape* shape = allocate(sizeof(Shape), "Shape");
+	shape->parent = parent;
+	shape->name = name;
+	shape->field_count = field_count;
+	pointer_array_init(&shape->transitions, "Shape transitions");
+	return shape;
+}
+
+Shape* shape_new_root(void) {
+	return shape_new(NULL, NULL, 0);
+}
+
+void shape_free_tree(Shape* root) {
+	for (int i = 0; i < root->transitions.count; i++) {
+		shape_free_tree((Shape*) root->transitions.values[i]);
+	}
+
+	pointer_array_free(&root->transitions);
+	deallocate(root, sizeof(Shape), "Shape");
+}
+
+int shape_find_field(Shape* shape, ObjectString* name) {
+	/* Attribute names are interned, so comparing the pointers is enough */
+	assert(name->is_interned);
+
+	for (; shape->name != NULL; shape = shape->parent) {
+		if (shape->name == name) {
+			return shape->field_count - 1;
+		}
+	}
+
+	return -1;
+}
+
+Shape* shape_add_field(Shape* shape, ObjectString* name) {
+	assert(shape_find_field(shape, name) == -1);
+
+	for (int i = 0; i < shape->transitions.count; i++) {
+		Shape* child = (Shape*) shape->transitions.values[i];
+		if (child->name == name) {
+			return child;
+		}
+	}
+
+	if (shape->field_count == SHAPE_MAX_FIELDS) {
+		return NULL;
+	}
+
+	Shape* child = shape_new(shape, name, shape->field_count + 1);
+	pointer_array_write(&shape->transitions, child);
+	return child;
+}
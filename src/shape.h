@@ -0,0 +1,30 @@
+#ifndef ribbon_shape_h
+#define ribbon_shape_h
+
+#include "common.h"
+#include "pointerarray.h"
+
+/* A shape describes the layout of the fields of instances which got the same attributes in the same order.
+   Each class owns a tree of shapes rooted at the empty shape. Adding a field to an instance moves it to a child shape
+   of its current one, which is shared with every other instance that added the same field at that point. */
+
+#define SHAPE_MAX_FIELDS 64 /* Instances which need more fields than this are moved to dictionary mode */
+
+struct ObjectString;
+
+typedef struct Shape {
+	struct Shape* parent;
+	struct ObjectString* name; /* The field added on top of the parent shape. NULL for the root shape */
+	int field_count; /* The field index of name is field_count - 1 */
+	PointerArray transitions; /* Child shapes, each adding one field */
+} Shape;
+
+Shape* shape_new_root(void);
+void shape_free_tree(Shape* root);
+
+int shape_find_field(Shape* shape, struct ObjectString* name);
+
+/* Returns NULL if the shape already has SHAPE_MAX_FIELDS fields */
+Shape* shape_add_field(Shape* shape, struct ObjectString* name);
+
+#endif
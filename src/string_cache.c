@@ -0,0 +1,178 @@
+#include "string_cache.h"
+#include "memory.h"
+#include "ribbon_object.h"
+#include "ribbon_utils.h"
+
+#define STRING_CACHE_LOAD_FACTOR 0.75
+#define STRING_CACHE_MIGRATE_ENTRIES 64 /* Old entries moved to the new ones on every addition while resizing */
+#define STRING_CACHE_SHRINK_DIVISOR 8 /* Shrink when fewer than 1 / STRING_CACHE_SHRINK_DIVISOR of the capacity is in use */
+
+static ObjectString tombstone_marker;
+#define TOMBSTONE (&tombstone_marker)
+
+void string_cache_init(StringCache* cache) {
+    cache->entries = NULL;
+    cache->capacity = 0;
+    cache->count = 0;
+    cache->num_strings = 0;
+    cache->old_entries = NULL;
+    cache->old_capacity = 0;
+    cache->migrate_index = 0;
+}
+
+static void free_entries(ObjectString** entries, size_t capacity) {
+    deallocate(entries, sizeof(ObjectString*) * capacity, "String cache entries");
+}
+
+void string_cache_free(StringCache* cache) {
+    if (cache->entries != NULL) {
+        free_entries(cache->entries, cache->capacity);
+    }
+    if (cache->old_entries != NULL) {
+        free_entries(cache->old_entries, cache->old_capacity);
+    }
+    string_cache_init(cache);
+}
+
+static ObjectString** find_in(ObjectString** entries, size_t capacity, const char* chars, int length, unsigned long hash) {
+    if (capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+        ObjectString* string = entries[index];
+        if (string == NULL) {
+            return NULL;
+        }
+        if (string != TOMBSTONE && string->hash == hash && cstrings_equal(string->chars, string->length, chars, length)) {
+            return &entries[index];
+        }
+    }
+}
+
+ObjectString* string_cache_find(StringCache* cache, const char* chars, int length, unsigned long hash) {
+    ObjectString** entry = find_in(cache->entries, cache->capacity, chars, length, hash);
+    if (entry == NULL && cache->old_entries != NULL) {
+        entry = find_in(cache->old_entries, cache->old_capacity, chars, length, hash);
+    }
+
+    return entry == NULL ? NULL : *entry;
+}
+
+static void insert_entry(StringCache* cache, ObjectString* string) {
+    size_t mask = cache->capacity - 1;
+    size_t index = string->hash & mask;
+    while (cache->entries[index] != NULL && cache->entries[index] != TOMBSTONE) {
+        index = (index + 1) & mask;
+    }
+
+    if (cache->entries[index] == NULL) {
+        cache->count++;
+    }
+    cache->entries[index] = string;
+}
+
+/* Moved entries become tombstones, so that the old entries after them can still be found */
+static void migrate_entries(StringCache* cache, size_t max_entries) {
+    size_t end = cache->migrate_index + max_entries;
+    if (end > cache->old_capacity) {
+        end = cache->old_capacity;
+    }
+
+    for (size_t i = cache->migrate_index; i < end; i++) {
+        ObjectString* string = cache->old_entries[i];
+        if (string != NULL && string != TOMBSTONE) {
+            insert_entry(cache, string);
+            cache->old_entries[i] = TOMBSTONE;
+        }
+    }
+
+    cache->migrate_index = end;
+
+    if (cache->migrate_index == cache->old_capacity) {
+        free_entries(cache->old_entries, cache->old_capacity);
+        cache->old_entries = NULL;
+        cache->old_capacity = 0;
+        cache->migrate_index = 0;
+    }
+}
+
+/* The smallest capacity which holds the strings at no more than half of the load factor */
+static size_t capacity_for(size_t num_strings) {
+    size_t capacity = 16;
+    while (num_strings > capacity * STRING_CACHE_LOAD_FACTOR / 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+static void start_resize(StringCache* cache, size_t new_capacity) {
+    if (cache->old_entries != NULL) {
+        migrate_entries(cache, cache->old_capacity);
+    }
+
+    cache->old_entries = cache->entries;
+    cache->old_capacity = cache->capacity;
+    cache->migrate_index = 0;
+
+    cache->entries = allocate(sizeof(ObjectString*) * new_capacity, "String cache entries");
+    cache->capacity = new_capacity;
+    cache->count = 0;
+    for (size_t i = 0; i < new_capacity; i++) {
+        cache->entries[i] = NULL;
+    }
+
+    if (cache->old_entries != NULL) {
+        migrate_entries(cache, STRING_CACHE_MIGRATE_ENTRIES);
+    }
+}
+
+void string_cache_add(StringCache* cache, ObjectString* string) {
+    assert(string_cache_find(cache, string->chars, string->length, string->hash) == NULL);
+
+    if (cache->old_entries != NULL) {
+        migrate_entries(cache, STRING_CACHE_MIGRATE_ENTRIES);
+    }
+
+    if (cache->count + 1 > cache->capacity * STRING_CACHE_LOAD_FACTOR) {
+        /* If it's mostly tombstones, this rehashes at the same capacity and clears them */
+        start_resize(cache, capacity_for(cache->num_strings));
+    }
+
+    insert_entry(cache, string);
+    cache->num_strings++;
+}
+
+static bool remove_from(ObjectString** entries, size_t capacity, ObjectString* string) {
+    if (capacity == 0) {
+        return false;
+    }
+
+    size_t mask = capacity - 1;
+    for (size_t index = string->hash & mask; entries[index] != NULL; index = (index + 1) & mask) {
+        if (entries[index] == string) {
+            entries[index] = TOMBSTONE;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void string_cache_remove(StringCache* cache, ObjectString* string) {
+    bool removed = remove_from(cache->entries, cache->capacity, string);
+    if (!removed && cache->old_entries != NULL) {
+        removed = remove_from(cache->old_entries, cache->old_capacity, string);
+    }
+
+    if (!removed) {
+        return;
+    }
+
+    cache->num_strings--;
+
+    if (cache->old_entries == NULL && cache->capacity > 16 && cache->num_strings < cache->capacity / STRING_CACHE_SHRINK_DIVISOR) {
+        start_resize(cache, capacity_for(cache->num_strings));
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef ribbon_string_cache_h
+#define ribbon_string_cache_h
+
+#include "common.h"
+
+/* The set of interned strings. Strings are found by their characters, without needing an ObjectString to look them up with.
+   The cache doesn't keep its strings alive - a string removes itself from the cache when it's freed. */
+
+struct ObjectString;
+
+/* Like the hash part of tables, the cache resizes incrementally: each addition moves some of the old entries to the new ones,
+   and lookups check both until all of them are moved. */
+
+typedef struct {
+    struct ObjectString** entries;
+    size_t capacity;
+    size_t count; /* Number of strings + tombstones in the entries, for determining when to grow */
+    size_t num_strings; /* In both the entries and the old entries */
+    struct ObjectString** old_entries; /* While resizing, the previous entries. NULL when not resizing */
+    size_t old_capacity;
+    size_t migrate_index; /* Old entries before this one were already moved */
+} StringCache;
+
+void string_cache_init(StringCache* cache);
+void string_cache_free(StringCache* cache);
+
+struct ObjectString* string_cache_find(StringCache* cache, const char* chars, int length, unsigned long hash);
+void string_cache_add(StringCache* cache, struct ObjectString* string);
+void string_cache_remove(StringCache* cache, struct ObjectString* string);
+
+#endif
@@ -1,7 +1,15 @@
+#include <string.h>
+
 #include "table.h"
 #include "ribbon_object.h"
+#include "ribbon_utils.h"
+
+#if TABLE_USE_SSE2
+#include <emmintrin.h>
+#endif
 
-#define TABLE_LOAD_FACTOR 0.75
+#define TABLE_MIGRATE_SLOTS 64 /* Old slots moved to the new entries on every write while resizing */
+#define TABLE_SHRINK_DIVISOR 8 /* Shrink when fewer than 1 / TABLE_SHRINK_DIVISOR of the capacity is in use */
 
 #if DEBUG_TABLE_STATS
 
@@ -19,10 +27,7 @@ static double avg_capacity = 0;
 static size_t total_collision_count = 0;
 static double avg_collision_count = 0;
 
-static size_t table_iterate_times_called = 0;
-static size_t table_iterate_length_sum = 0;
-static double avg_table_iterate_length = 0;
-static size_t max_table_iterate_length = 0;
+static size_t array_part_times_called = 0;
 /* ..... */
 
 void table_debug_print_general_stats(void) {
@@ -37,99 +42,186 @@ void table_debug_print_general_stats(void) {
     printf("Avg collison count: %g\n", avg_collision_count);
     printf("Collision count / times called and found: %g\n", (double) total_collision_count / (double) times_called_and_found);
 
-    printf("table_iterate times called: %" PRI_SIZET "\n", table_iterate_times_called);
-    printf("Sum table_iterate lengths: %" PRI_SIZET "\n", table_iterate_length_sum);
-    printf("Avg table_iterate length: %g\n", avg_table_iterate_length);
-    printf("Max table_iterate length: %" PRI_SIZET "\n", max_table_iterate_length);
+    printf("Accesses to array parts: %" PRI_SIZET "\n", array_part_times_called);
 }
 
 #endif
 
-static void* allocate_suitably(Table* table, size_t size, const char* what) {
-    if (!table->is_memory_infrastructure) {
-        return allocate(size, what);
-    }
-    return allocate_no_tracking(size);
-}
-
-static void deallocate_suitably(Table* table, void* pointer, size_t size, const char* what) {
-    if (!table->is_memory_infrastructure) {
-        deallocate(pointer, size, what);
-        return;
-    }
-    deallocate_no_tracking(pointer);
-}
-
 void table_init(Table* table) {
     table->capacity = 0;
     table->count = 0;
     table->num_entries = 0;
     table->entries = NULL;
-    table->is_memory_infrastructure = false;
-    table->is_growing = false;
+    table->control = NULL;
+    table->array = NULL;
+    table->array_count = 0;
+    table->array_capacity = 0;
+    table->array_holes = 0;
+    table->old_entries = NULL;
+    table->old_control = NULL;
+    table->old_capacity = 0;
+    table->migrate_index = 0;
     table->collision_count = 0;
 }
 
-void table_init_memory_infrastructure(Table* table) {
-    table_init(table);
-    table->is_memory_infrastructure = true;
-}
-
 Table table_new_empty(void) {
     Table table;
     table_init(&table);
     return table;
 }
 
-static bool keys_equal(Value v1, Value v2) {
-    int compare_result = -1;
-    bool compare_success = value_compare(v1, v2, &compare_result);
-    return compare_success && (compare_result == 0);
+/* The low 7 bits of a hash go in the control byte of its entry, and the rest choose the group where probing starts */
+#define HASH_FRAGMENT(hash) ((uint8_t) ((hash) & 0x7f))
+#define HASH_POSITION(hash) ((size_t) ((hash) >> 7))
+
+/* A group mask has bit i set for every entry i of a group whose control byte matched */
+typedef uint32_t GroupMask;
+
+static inline GroupMask group_match(const uint8_t* group, uint8_t control) {
+    #if TABLE_USE_SSE2
+
+    __m128i bytes = _mm_loadu_si128((const __m128i*) group);
+    return (GroupMask) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) control)));
+
+    #else
+
+    GroupMask mask = 0;
+    for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+        if (group[i] == control) {
+            mask |= (GroupMask) 1 << i;
+        }
+    }
+    return mask;
+
+    #endif
+}
+
+/* Matches the empty and deleted entries of a group - the control bytes with the high bit set */
+static inline GroupMask group_match_free(const uint8_t* group) {
+    #if TABLE_USE_SSE2
+
+    return (GroupMask) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+
+    #else
+
+    GroupMask mask = 0;
+    for (int i = 0; i < TABLE_GROUP_WIDTH; i++) {
+        if (!TABLE_CONTROL_IS_FULL(group[i])) {
+            mask |= (GroupMask) 1 << i;
+        }
+    }
+    return mask;
+
+    #endif
 }
 
-static bool is_empty(Entry* e) {
-    return e->key.type == VALUE_NIL;
+static inline int lowest_set_bit(GroupMask mask) {
+    assert(mask != 0);
+
+    #if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+    #else
+    int bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+    #endif
 }
 
-static Entry* find_entry(Table* table, Value key) {
+static uint64_t hash_key(Value key) {
+    if (VALUE_IS_NUMBER(key)) {
+        return hash_double(VALUE_AS_NUMBER(key));
+    }
+
+    if (VALUE_IS_OBJECT(key) && VALUE_AS_OBJECT(key)->type == OBJECT_STRING) {
+        return hash_mix64(object_string_hash((ObjectString*) VALUE_AS_OBJECT(key)));
+    }
+
     unsigned long hash;
     if (!value_hash(&key, &hash)) {
-        FAIL("Couldn't hash in table::find_entry."); /* Temporary? */
+        FAIL("Couldn't hash in table::hash_key."); /* Temporary? */
+    }
+    return hash_mix64(hash);
+}
+
+static bool keys_equal(Value v1, Value v2) {
+    if (v1.bits == v2.bits) {
+        return true;
     }
-    
-    size_t capacity = table->capacity;
-    Entry* entries = table->entries;
 
-    // size_t slot = hash % table->capacity;
-    size_t slot = hash & (capacity - 1);
-    // Entry* entry = &table->entries[slot];
-    Entry* entry = &entries[slot];
+    if (VALUE_IS_NUMBER(v1) && VALUE_IS_NUMBER(v2)) {
+        return VALUE_AS_NUMBER(v1) == VALUE_AS_NUMBER(v2);
+    }
 
-    Entry* tombstone = NULL;
+    if (VALUE_IS_OBJECT(v1) && VALUE_IS_OBJECT(v2)) {
+        return object_compare(VALUE_AS_OBJECT(v1), VALUE_AS_OBJECT(v2));
+    }
 
-    bool collision = false;
+    return false;
+}
 
-    while (true) {
-        assert(entry->tombstone == 1 || entry->tombstone == 0);
-
-        if (is_empty(entry)) {
-            if (entry->tombstone == 1) {
-                if (tombstone == NULL) {
-                    tombstone = entry;
-                }
-            } else {
-                entry = tombstone == NULL ? entry : tombstone;
-                break;
-            }
-        } else {
-            if (keys_equal(key, entry->key)) {
-                break;
+/* Groups are probed quadratically: 1, 2, 3... groups away from the previous one. With a power of two number of groups,
+   this visits every group. There is always an empty entry somewhere since the table grows before it fills up. */
+static Entry* probe_for_key(Entry* entries, uint8_t* control, size_t capacity, Value key, uint64_t hash, bool* collision) {
+    if (capacity == 0) {
+        return NULL;
+    }
+
+    uint8_t fragment = HASH_FRAGMENT(hash);
+    size_t group_mask = capacity / TABLE_GROUP_WIDTH - 1;
+    size_t group = HASH_POSITION(hash) & group_mask;
+
+    for (size_t step = 1; ; step++) {
+        const uint8_t* group_control = &control[group * TABLE_GROUP_WIDTH];
+
+        for (GroupMask matches = group_match(group_control, fragment); matches != 0; matches &= matches - 1) {
+            Entry* entry = &entries[group * TABLE_GROUP_WIDTH + lowest_set_bit(matches)];
+            if (keys_equal(entry->key, key)) {
+                return entry;
             }
+            *collision = true;
         }
 
-        collision = true;
-        // entry = &table->entries[++slot % table->capacity];
-        entry = &entries[++slot % capacity];
+        if (group_match(group_control, TABLE_CONTROL_EMPTY) != 0) {
+            return NULL;
+        }
+
+        *collision = true;
+        group = (group + step) & group_mask;
+    }
+}
+
+/* The first empty or deleted entry along the probe sequence of the hash */
+static size_t probe_for_free_slot(uint8_t* control, size_t capacity, uint64_t hash) {
+    size_t group_mask = capacity / TABLE_GROUP_WIDTH - 1;
+    size_t group = HASH_POSITION(hash) & group_mask;
+
+    for (size_t step = 1; ; step++) {
+        GroupMask free_entries = group_match_free(&control[group * TABLE_GROUP_WIDTH]);
+        if (free_entries != 0) {
+            return group * TABLE_GROUP_WIDTH + lowest_set_bit(free_entries);
+        }
+
+        group = (group + step) & group_mask;
+    }
+}
+
+static bool is_resizing(Table* table) {
+    return table->old_entries != NULL;
+}
+
+static bool in_old_entries(Table* table, Entry* entry) {
+    return is_resizing(table) && entry >= table->old_entries && entry < table->old_entries + table->old_capacity;
+}
+
+/* While resizing, a key is either still in the old entries or already in the new ones - never in both */
+static Entry* find_entry(Table* table, Value key, uint64_t hash) {
+    bool collision = false;
+    Entry* result = probe_for_key(table->entries, table->control, table->capacity, key, hash, &collision);
+    if (result == NULL && is_resizing(table)) {
+        result = probe_for_key(table->old_entries, table->old_control, table->old_capacity, key, hash, &collision);
     }
 
     if (collision) {
@@ -137,10 +229,9 @@ static Entry* find_entry(Table* table, Value key) {
     }
 
     #if DEBUG_TABLE_STATS
-    // total_collision_count += table->collision_count;
     total_collision_count += collision ? 1 : 0;
     times_called++;
-    if (!is_empty(entry)) {
+    if (result != NULL) {
         times_called_and_found++;
     }
     capacity_sum += table->capacity;
@@ -151,54 +242,109 @@ static Entry* find_entry(Table* table, Value key) {
     avg_collision_count = (double) total_collision_count / (double) times_called;
     #endif
 
-    return entry;
+    return result;
 }
 
-static void grow_table(Table* table) {
-    assert(!table->is_growing);
-
-    table->is_growing = true;
+static size_t max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
 
-    size_t old_capacity = table->capacity;
-    Entry* old_entries = table->entries;
+/* The smallest capacity which holds the number of entries at no more than half of its maximum load */
+static size_t capacity_for(size_t num_entries) {
+    size_t capacity = TABLE_GROUP_WIDTH;
+    while (max_load(capacity) < num_entries * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
 
-    /* TODO: Grow to a prime number here? */
-    table->capacity = table->capacity < 8 ? 8 : table->capacity * 2;;
-    table->count = 0;
-    table->num_entries = 0;
-    table->collision_count = 0;
-    table->entries = allocate_suitably(table, table->capacity * sizeof(Entry), "Hash table array");
+static void free_hash_part(Entry* entries, size_t capacity) {
+    deallocate(entries, capacity * (sizeof(Entry) + 1), "Hash table array");
+}
 
-    size_t capacity = table->capacity;
-    Entry* entries = table->entries;
+static void free_old_entries(Table* table) {
+    free_hash_part(table->old_entries, table->old_capacity);
+    table->old_entries = NULL;
+    table->old_control = NULL;
+    table->old_capacity = 0;
+    table->migrate_index = 0;
+}
 
-    for (size_t i = 0; i < capacity; i++) {
-        entries[i] = (Entry) {.key = MAKE_VALUE_NIL(), .value = MAKE_VALUE_NIL(), .tombstone = 0};
+/* Moves the entries in up to max_slots of the old slots to the new entries. Moved slots are marked as deleted rather than empty,
+   so that probing the old entries still reaches the keys further along the same probe sequence. */
+static void migrate_entries(Table* table, size_t max_slots) {
+    size_t end = table->migrate_index + max_slots;
+    if (end > table->old_capacity) {
+        end = table->old_capacity;
     }
 
-    for (size_t i = 0; i < old_capacity; i++) {
-        Entry* old_entry = &old_entries[i];
-        if (!is_empty(old_entry)) {
-            assert(old_entry->tombstone == 0);
-            table_set(table, old_entry->key, old_entry->value);
+    for (size_t i = table->migrate_index; i < end; i++) {
+        if (TABLE_CONTROL_IS_FULL(table->old_control[i])) {
+            uint64_t hash = hash_key(table->old_entries[i].key);
+            size_t slot = probe_for_free_slot(table->control, table->capacity, hash);
+            if (table->control[slot] == TABLE_CONTROL_EMPTY) {
+                table->count++;
+            }
+            table->control[slot] = HASH_FRAGMENT(hash);
+            table->entries[slot] = table->old_entries[i];
+            table->old_control[i] = TABLE_CONTROL_DELETED;
         }
     }
 
-    deallocate_suitably(table, old_entries, sizeof(Entry) * old_capacity, "Hash table array");
+    table->migrate_index = end;
 
-    table->is_growing = false;
+    if (table->migrate_index == table->old_capacity) {
+        free_old_entries(table);
+    }
 }
 
-bool table_get(Table* table, Value key, Value* out) {
-    if (table->capacity == 0) {
-        return false;
+/* Resizing doesn't move all of the entries at once, which would stall a single operation on a big table.
+   Instead the current entries become the old entries, and every following write moves some of them to the new ones. */
+static void start_resize(Table* table, size_t new_capacity) {
+    if (is_resizing(table)) {
+        migrate_entries(table, table->old_capacity);
     }
 
-    Entry* entry = find_entry(table, key);
+    table->old_entries = table->entries;
+    table->old_control = table->control;
+    table->old_capacity = table->capacity;
+    table->migrate_index = 0;
 
-    assert(is_empty(entry) || keys_equal(entry->key, key)); /* Remove later */
+    table->capacity = new_capacity;
+    table->count = 0;
+    table->collision_count = 0;
+    table->entries = allocate(new_capacity * (sizeof(Entry) + 1), "Hash table array");
+    table->control = (uint8_t*) (table->entries + new_capacity);
+    memset(table->control, TABLE_CONTROL_EMPTY, new_capacity);
 
-    if (is_empty(entry)) {
+    if (table->old_entries != NULL) {
+        migrate_entries(table, TABLE_MIGRATE_SLOTS);
+    }
+}
+
+/* Claims an entry for a key which isn't in the table. The value of the new entry is nil. */
+static Entry* insert_new_entry(Table* table, Value key, uint64_t hash) {
+    if (table->count + 1 > max_load(table->capacity)) {
+        /* The number of entries decides the new capacity, so a table full of deleted entries is compacted rather than grown */
+        start_resize(table, capacity_for(table->num_entries));
+    }
+
+    size_t slot = probe_for_free_slot(table->control, table->capacity, hash);
+    if (table->control[slot] == TABLE_CONTROL_EMPTY) {
+        table->count++;
+    }
+    table->control[slot] = HASH_FRAGMENT(hash);
+    table->num_entries++;
+
+    Entry* entry = &table->entries[slot];
+    entry->key = key;
+    entry->value = MAKE_VALUE_NIL();
+    return entry;
+}
+
+static bool hash_get(Table* table, Value key, Value* out) {
+    Entry* entry = find_entry(table, key, hash_key(key));
+    if (entry == NULL) {
         return false;
     }
 
@@ -206,137 +352,289 @@ bool table_get(Table* table, Value key, Value* out) {
     return true;
 }
 
-void table_set(Table* table, struct Value key, Value value) {
-    if (table->count + 1 >= table->capacity * TABLE_LOAD_FACTOR) {
-        grow_table(table);
+static void hash_set(Table* table, Value key, Value value) {
+    if (is_resizing(table)) {
+        migrate_entries(table, TABLE_MIGRATE_SLOTS);
     }
 
-    Entry* entry = find_entry(table, key);
-    assert(is_empty(entry) || keys_equal(entry->key, key));
-
-    if (is_empty(entry)) {
-        table->count++;
-        table->num_entries++;
-        entry->key = key;
+    uint64_t hash = hash_key(key);
+    Entry* entry = find_entry(table, key, hash);
+    if (entry == NULL) {
+        entry = insert_new_entry(table, key, hash);
     }
 
     entry->value = value;
-    entry->tombstone = 0;
 }
 
-bool table_get_cstring_key(Table* table, const char* key, Value* out) {
-    return table_get(table, MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated(key)), out);
-}
-
-void table_set_cstring_key(Table* table, const char* key, Value value) {
-    table_set(table, MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated(key)), value);
-}
+static bool hash_delete(Table* table, Value key) {
+    if (is_resizing(table)) {
+        migrate_entries(table, TABLE_MIGRATE_SLOTS);
+    }
 
-bool table_delete(Table* table, Value key) {
-    if (table->capacity == 0) {
+    Entry* entry = find_entry(table, key, hash_key(key));
+    if (entry == NULL) {
         return false;
     }
 
-    Entry* entry = find_entry(table, key);
-    if (is_empty(entry)) {
-        return false;
+    if (in_old_entries(table, entry)) {
+        table->old_control[entry - table->old_entries] = TABLE_CONTROL_DELETED;
+    } else {
+        /* If the group still has an empty entry, no probe ever went past it, so the deleted entry can simply become empty.
+           Otherwise it has to stay marked as deleted, so that probes continue through it. */
+        size_t slot = entry - table->entries;
+        uint8_t* group = &table->control[slot - slot % TABLE_GROUP_WIDTH];
+        if (group_match(group, TABLE_CONTROL_EMPTY) != 0) {
+            table->control[slot] = TABLE_CONTROL_EMPTY;
+            table->count--;
+        } else {
+            table->control[slot] = TABLE_CONTROL_DELETED;
+        }
     }
 
     entry->key = MAKE_VALUE_NIL();
     entry->value = MAKE_VALUE_NIL();
-    entry->tombstone = 1;
 
     table->num_entries--;
 
+    if (!is_resizing(table) && table->capacity > TABLE_GROUP_WIDTH && table->num_entries < table->capacity / TABLE_SHRINK_DIVISOR) {
+        start_resize(table, capacity_for(table->num_entries));
+    }
+
     return true;
 }
 
-/* A special-case route for cell_table.c solely for optimization reasons. */
-void table_set_value_in_cell(Table* table, Value key, Value value) {
-    if (table->count + 1 >= table->capacity * TABLE_LOAD_FACTOR) {
-        grow_table(table);
+/* Whether the key is a whole number which may be an index of the array part. Sets the index if it is. */
+static bool key_as_index(Value key, size_t* index) {
+    if (!VALUE_IS_NUMBER(key)) {
+        return false;
+    }
+
+    double number = VALUE_AS_NUMBER(key);
+    if (number < 0 || number >= (double) SIZE_MAX || number != (double) (size_t) number) {
+        return false;
     }
 
-    Entry* entry = find_entry(table, key);
+    *index = (size_t) number;
+    return true;
+}
 
-    assert(is_empty(entry) || keys_equal(entry->key, key));
+static void array_append(Table* table, Value value) {
+    if (table->array_count == table->array_capacity) {
+        size_t old_capacity = table->array_capacity;
+        table->array_capacity = GROW_CAPACITY(old_capacity);
+        table->array = reallocate(table->array, sizeof(Value) * old_capacity, sizeof(Value) * table->array_capacity, "Table array part");
+    }
 
-    if (is_empty(entry)) {
-        table->count++;
-        table->num_entries++;
-        entry->key = key;
-        entry->value = MAKE_VALUE_OBJECT(object_cell_new(value));
-        entry->tombstone = 0;
-    } else {
-        assert(entry->tombstone == 0);
-        assert(object_value_is(entry->value, OBJECT_CELL));
+    table->array[table->array_count++] = value;
+}
+
+/* After the array part grew, keys which now continue it are moved there from the hash part */
+static void migrate_to_array(Table* table) {
+    if (table->num_entries == 0) {
+        return;
+    }
 
-        ObjectCell* cell = (ObjectCell*) entry->value.as.object;
-        cell->value = value;
-        cell->is_filled = true;
+    Value value;
+    while (hash_get(table, MAKE_VALUE_NUMBER(table->array_count), &value)) {
+        hash_delete(table, MAKE_VALUE_NUMBER(table->array_count));
+        array_append(table, value);
     }
 }
 
-void table_free(Table* table) {
-    deallocate_suitably(table, table->entries, table->capacity * sizeof(Entry), "Hash table array");
-    table_init(table);
+bool table_get(Table* table, Value key, Value* out) {
+    size_t index;
+    if (key_as_index(key, &index) && index < table->array_count) {
+        #if DEBUG_TABLE_STATS
+        array_part_times_called++;
+        #endif
+
+        if (VALUE_IS_UNDEFINED(table->array[index])) {
+            return false;
+        }
+
+        *out = table->array[index];
+        return true;
+    }
+
+    return hash_get(table, key, out);
 }
 
-PointerArray table_iterate(Table* table, const char* alloc_string) {
-	PointerArray array;
-	pointer_array_init(&array, alloc_string);
+void table_set(Table* table, Value key, Value value) {
+    size_t index;
+    if (key_as_index(key, &index) && index <= table->array_count) {
+        #if DEBUG_TABLE_STATS
+        array_part_times_called++;
+        #endif
 
-    for (size_t i = 0; i < table->capacity; i++) {
-        Entry* entry = &table->entries[i];
+        if (index < table->array_count) {
+            if (VALUE_IS_UNDEFINED(table->array[index])) {
+                table->array_holes--;
+            }
+            table->array[index] = value;
+            return;
+        }
 
-        if (!is_empty(entry)) {
-            assert(entry->tombstone == 0);
-            pointer_array_write(&array, entry);
+        if (table->num_entries > 0) {
+            hash_delete(table, key);
         }
+        array_append(table, value);
+        migrate_to_array(table);
+        return;
     }
 
-    #if DEBUG_TABLE_STATS
+    hash_set(table, key, value);
+}
+
+bool table_delete(Table* table, Value key) {
+    size_t index;
+    if (key_as_index(key, &index) && index < table->array_count) {
+        if (VALUE_IS_UNDEFINED(table->array[index])) {
+            return false;
+        }
 
-    table_iterate_times_called++;
-    table_iterate_length_sum += array.count;
-    avg_table_iterate_length = (double) table_iterate_length_sum / (double) table_iterate_times_called;
-    if (array.count > max_table_iterate_length) {
-        max_table_iterate_length = array.count;
+        table->array[index] = MAKE_VALUE_UNDEFINED();
+        table->array_holes++;
+
+        while (table->array_count > 0 && VALUE_IS_UNDEFINED(table->array[table->array_count - 1])) {
+            table->array_count--;
+            table->array_holes--;
+        }
+        return true;
     }
 
-    #endif
+    return hash_delete(table, key);
+}
+
+size_t table_length(Table* table) {
+    return table->array_count - table->array_holes + table->num_entries;
+}
 
-	return array;
+void table_add(Table* table, Value value) {
+    table_set(table, MAKE_VALUE_NUMBER(table_length(table)), value);
+}
+
+bool table_pop(Table* table, Value* out) {
+    size_t length = table_length(table);
+    if (length == 0) {
+        return false;
+    }
+
+    Value last_key = MAKE_VALUE_NUMBER(length - 1);
+    if (!table_get(table, last_key, out)) {
+        return false;
+    }
+
+    return table_delete(table, last_key);
+}
+
+void table_iterator_init(TableIterator* iterator, Table* table) {
+    iterator->table = table;
+    iterator->index = 0;
+}
+
+bool table_iterator_next(TableIterator* iterator, Value* key, Value* value) {
+    Table* table = iterator->table;
+
+    while (iterator->index < table->array_count) {
+        size_t index = iterator->index++;
+        if (!VALUE_IS_UNDEFINED(table->array[index])) {
+            *key = MAKE_VALUE_NUMBER(index);
+            *value = table->array[index];
+            return true;
+        }
+    }
+
+    /* While resizing, the entries which weren't moved yet come after the new entries */
+    size_t num_slots = table->capacity + table->old_capacity;
+    for (size_t i = iterator->index - table->array_count; i < num_slots; i++) {
+        bool in_new = i < table->capacity;
+        uint8_t control = in_new ? table->control[i] : table->old_control[i - table->capacity];
+        if (TABLE_CONTROL_IS_FULL(control)) {
+            Entry* entry = in_new ? &table->entries[i] : &table->old_entries[i - table->capacity];
+            *key = entry->key;
+            *value = entry->value;
+            iterator->index = table->array_count + i + 1;
+            return true;
+        }
+    }
+
+    iterator->index = table->array_count + num_slots;
+    return false;
+}
+
+bool table_get_cstring_key(Table* table, const char* key, Value* out) {
+    return table_get(table, MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated(key)), out);
+}
+
+void table_set_cstring_key(Table* table, const char* key, Value value) {
+    table_set(table, MAKE_VALUE_OBJECT(object_string_copy_from_null_terminated(key)), value);
+}
+
+/* A special-case route for cell_table.c solely for optimization reasons. */
+ObjectCell* table_set_value_in_cell(Table* table, Value key, Value value) {
+    if (is_resizing(table)) {
+        migrate_entries(table, TABLE_MIGRATE_SLOTS);
+    }
+
+    uint64_t hash = hash_key(key);
+    Entry* entry = find_entry(table, key, hash);
+
+    if (entry == NULL) {
+        entry = insert_new_entry(table, key, hash);
+        ObjectCell* cell = object_cell_new(value);
+        entry->value = MAKE_VALUE_OBJECT(cell);
+        return cell;
+    }
+
+    assert(object_value_is(entry->value, OBJECT_CELL));
+
+    ObjectCell* cell = (ObjectCell*) VALUE_AS_OBJECT(entry->value);
+    cell->value = value;
+    cell->is_filled = true;
+    return cell;
+}
+
+void table_free(Table* table) {
+    if (table->entries != NULL) {
+        free_hash_part(table->entries, table->capacity);
+    }
+    if (is_resizing(table)) {
+        free_hash_part(table->old_entries, table->old_capacity);
+    }
+    deallocate(table->array, table->array_capacity * sizeof(Value), "Table array part");
+    table_init(table);
 }
 
 void table_print(Table* table) {
-	PointerArray entries = table_iterate(table, "table print table_iterate buffer");
+	TableIterator iterator;
+	table_iterator_init(&iterator, table);
 
 	printf("[");
-	for (int i = 0; i < entries.count; i++) {
-		Entry* entry = entries.values[i];
-		Value value = entry->value;
-		value_print(entry->key);
-		printf(": ");
-		value_print(value);
-
-		if (i < entries.count - 1) {
+	Value key;
+	Value value;
+	for (bool first = true; table_iterator_next(&iterator, &key, &value); first = false) {
+		if (!first) {
 			printf(", ");
 		}
+
+		value_print(key);
+		printf(": ");
+		value_print(value);
 	}
 	printf("]");
-
-	pointer_array_free(&entries);
 }
 
 void table_print_debug(Table* table) {
-    printf("Capacity: %" PRI_SIZET " \nCount: %" PRI_SIZET " \n", table->capacity, table->count);
+    printf("Capacity: %" PRI_SIZET " \nCount: %" PRI_SIZET " \nArray count: %" PRI_SIZET " \n", table->capacity, table->count, table->array_count);
+    if (is_resizing(table)) {
+        printf("Resizing from capacity %" PRI_SIZET ", moved %" PRI_SIZET " slots so far\n", table->old_capacity, table->migrate_index);
+    }
     
     if (table->capacity > 0) {
         printf("Data: \n");
         for (size_t i = 0; i < table->capacity; i++) {
             Entry* entry = &table->entries[i];
-            if (!is_empty(entry)) {
+            if (TABLE_CONTROL_IS_FULL(table->control[i])) {
                 printf("%" PRI_SIZET " = [Key: ", i);
                 value_print(entry->key);
                 printf(", Value: ");
@@ -8,25 +8,49 @@
 typedef struct {
     Value key;
     Value value;
-    char tombstone;
 } Entry;
 
+/* The hash part is laid out in the style of SwissTable: next to the entries is an array of control bytes, one per entry.
+   A control byte is either empty, deleted, or holds 7 bits of the hash of the key in its entry.
+   Lookups compare the control bytes of a whole group of entries at once, and only compare keys where the hash bits match.
+   Resizing is incremental: every write moves a few of the old entries to the new ones, and until all of them are moved,
+   lookups check both. The hash part shrinks once most of it is unused. */
+
+#define TABLE_GROUP_WIDTH 16 /* Entries probed together. The capacity of the hash part is always a multiple of this */
+
+#define TABLE_CONTROL_EMPTY ((uint8_t) 0x80)
+#define TABLE_CONTROL_DELETED ((uint8_t) 0xFE)
+#define TABLE_CONTROL_IS_FULL(control) (((control) & 0x80) == 0)
+
+/* A table has an array part next to its hash part, like Lua tables. The array part holds the values of the keys 0 to array_count - 1
+   in order, so tables used as lists don't pay for hashing, and their length is known without counting.
+   A key which is a whole number is in the array part if it's below array_count, and otherwise in the hash part.
+   The array part grows when the key array_count is set. Deleting a key from the middle of it leaves a hole - an undefined
+   value - so the keys after it stay where they are. Holes at the end of the array part are trimmed off. */
+
 typedef struct {
     size_t capacity; /* Capacity of current underlying entries array */
-    size_t count; /* Number of entries + tombstones, for determining when to grow */
-    size_t num_entries; /* Number of logical entries */
+    size_t count; /* Number of entries + deleted entries, for determining when to grow */
+    size_t num_entries; /* Number of logical entries in the hash part */
     Entry* entries;
-    bool is_memory_infrastructure;
-    bool is_growing; /* For debugging */
+    uint8_t* control; /* Control bytes of the entries, in the same allocation right after them */
+    Entry* old_entries; /* While resizing, the previous entries. NULL when not resizing */
+    uint8_t* old_control;
+    size_t old_capacity;
+    size_t migrate_index; /* Old slots before this one were already moved to the new entries */
+    Value* array;
+    size_t array_count;
+    size_t array_capacity;
+    size_t array_holes; /* Deleted keys below array_count */
     size_t collision_count; /* For debugging */
 } Table;
 
 struct ObjectString;
+struct ObjectCell;
 
 Table table_new_empty(void);
 
 void table_init(Table* table);
-void table_init_memory_infrastructure(Table* table);
 
 void table_set(Table* table, struct Value key, Value value);
 bool table_get(Table* table, Value key, Value* out);
@@ -34,13 +58,27 @@ bool table_get(Table* table, Value key, Value* out);
 void table_set_cstring_key(Table* table, const char* key, Value value);
 bool table_get_cstring_key(Table* table, const char* key, Value* out);
 
-void table_set_value_in_cell(Table* table, Value key, Value value);
+/* Sets the value in the cell which the key maps to, or maps the key to a new cell. Returns the cell */
+struct ObjectCell* table_set_value_in_cell(Table* table, Value key, Value value);
 
 bool table_delete(Table* table, Value key);
 
 void table_free(Table* table);
 
-PointerArray table_iterate(Table* table, const char* alloc_string);
+size_t table_length(Table* table); /* Number of keys in the table, in both of its parts */
+
+/* Appends the value at the key table_length(), and removes the value at the key table_length() - 1 */
+void table_add(Table* table, Value value);
+bool table_pop(Table* table, Value* out);
+
+/* Iterates the array part in order, and then the hash part */
+typedef struct {
+    Table* table;
+    size_t index;
+} TableIterator;
+
+void table_iterator_init(TableIterator* iterator, Table* table);
+bool table_iterator_next(TableIterator* iterator, Value* key, Value* value);
 
 void table_print(Table* table); /* For user display */
 void table_print_debug(Table* table); /* for trace execution and debugging */
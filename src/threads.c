@@ -0,0 +1,41 @@
+#include <windows.h>
+
+#include "threads.h"
+
+typedef struct {
+	ThreadWork work;
+	void* argument;
+	int index;
+} ThreadStart;
+
+static DWORD WINAPI thread_main(LPVOID parameter) {
+	ThreadStart* start = parameter;
+	start->work(start->index, start->argument);
+	return 0;
+}
+
+void threads_run(int count, ThreadWork work, void* argument) {
+	assert(count >= 1 && count <= THREADS_MAX);
+
+	ThreadStart starts[THREADS_MAX];
+	HANDLE handles[THREADS_MAX];
+
+	for (int i = 1; i < count; i++) {
+		starts[i] = (ThreadStart) {.work = work, .argument = argument, .index = i};
+		handles[i] = CreateThread(NULL, 0, thread_main, &starts[i], 0, NULL);
+		if (handles[i] == NULL) {
+			FAIL("Couldn't start a worker thread.");
+		}
+	}
+
+	work(0, argument);
+
+	for (int i = 1; i < count; i++) {
+		WaitForSingleObject(handles[i], INFINITE);
+		CloseHandle(handles[i]);
+	}
+}
+
+void threads_yield(void) {
+	SwitchToThread();
+}
@@ -0,0 +1,56 @@
+#ifndef ribbon_threads_h
+#define ribbon_threads_h
+
+#include "common.h"
+
+/* Short-lived worker threads, used by the GC to mark and sweep in parallel. The calling thread takes part in the work,
+   and nothing else may run on the VM until all threads are done. */
+
+#define THREADS_MAX 64
+
+typedef void (*ThreadWork)(int index, void* argument);
+
+/* Runs work on count threads, with indexes 0 to count - 1. The calling thread is index 0. Returns once all of them are done. */
+void threads_run(int count, ThreadWork work, void* argument);
+void threads_yield(void);
+
+/* Atomic operations for the data the threads share. Relaxed, unless said otherwise. */
+
+static inline uint64_t threads_fetch_or(uint64_t* word, uint64_t bits) {
+	return __atomic_fetch_or(word, bits, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t threads_load_word(uint64_t* word) {
+	return __atomic_load_n(word, __ATOMIC_RELAXED);
+}
+
+static inline int threads_load_int(int* value) {
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+static inline void threads_store_int(int* value, int new_value) {
+	__atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+static inline int threads_add_int(int* value, int addend) {
+	return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+
+/* A lock for short critical sections, which spins instead of sleeping */
+typedef struct {
+	int locked;
+} SpinLock;
+
+static inline void threads_lock(SpinLock* lock) {
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED)) {
+			threads_yield();
+		}
+	}
+}
+
+static inline void threads_unlock(SpinLock* lock) {
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif
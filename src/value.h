@@ -1,6 +1,8 @@
 #ifndef ribbon_value_h
 #define ribbon_value_h
 
+#include <string.h>
+
 #include "bytecode.h"
 #include "common.h"
 #include "dynamic_array.h"
@@ -9,44 +11,85 @@ typedef enum {
     VALUE_NUMBER,
     VALUE_BOOLEAN,
     VALUE_NIL,
-	VALUE_RAW_STRING,
     VALUE_OBJECT,
-    VALUE_ALLOCATION, // Internal
-    VALUE_ADDRESS // Internal
+    VALUE_UNDEFINED // Internal - a local variable slot which wasn't assigned yet
 } ValueType;
 
-typedef struct {
-	const char* data;
-	int length;
-    unsigned long hash;
-} RawString;
+/* Values are NaN-boxed into 64 bits.
+   A number is stored as its own double. Every other value is stored inside the unused space of a quiet NaN:
+   nil, booleans and undefined are small tags in the low bits, and objects have the sign bit set and the pointer
+   in the low 48 bits.
+   Always go through the MAKE_VALUE_*, VALUE_IS_* and VALUE_AS_* macros rather than the bits. */
 
 typedef struct Value {
-    ValueType type;
-    union {
-        double number;
-        bool boolean;
-        RawString raw_string;
-        struct Object* object;
-        Allocation allocation;
-        uintptr_t address;
-    } as;
+    uint64_t bits;
 } Value;
 
-#define MAKE_VALUE_NUMBER(n) (Value){.type = VALUE_NUMBER, .as.number = (n)}
-#define MAKE_VALUE_BOOLEAN(val) (Value){.type = VALUE_BOOLEAN, .as.boolean = (val)}
-#define MAKE_VALUE_NIL() (Value){.type = VALUE_NIL, .as.number = -1}
-#define MAKE_VALUE_RAW_STRING(cstring, the_length, the_hash) (Value){.type = VALUE_RAW_STRING, .as.raw_string \
-                                = (RawString) {.data = (cstring), .length = (the_length), .hash = (the_hash)}}
-#define MAKE_VALUE_OBJECT(o) (Value){.type = VALUE_OBJECT, .as.object = (struct Object*)(o)}
-#define MAKE_VALUE_ALLOCATION(the_name, the_size) (Value) {.type = VALUE_ALLOCATION, \
-                                                            .as.allocation = (Allocation) {.name = the_name, .size = the_size}}
-#define MAKE_VALUE_ADDRESS(the_address) (Value) {.type = VALUE_ADDRESS, .as.address = (uintptr_t) the_address }
+#define VALUE_SIGN_BIT ((uint64_t) 0x8000000000000000)
+#define VALUE_QNAN ((uint64_t) 0x7ffc000000000000)
+
+#define VALUE_TAG_NIL 1
+#define VALUE_TAG_FALSE 2
+#define VALUE_TAG_TRUE 3
+#define VALUE_TAG_UNDEFINED 4
+
+#define VALUE_NIL_BITS (VALUE_QNAN | VALUE_TAG_NIL)
+#define VALUE_FALSE_BITS (VALUE_QNAN | VALUE_TAG_FALSE)
+#define VALUE_TRUE_BITS (VALUE_QNAN | VALUE_TAG_TRUE)
+#define VALUE_UNDEFINED_BITS (VALUE_QNAN | VALUE_TAG_UNDEFINED)
+
+static inline uint64_t value_number_to_bits(double number) {
+    uint64_t bits;
+    memcpy(&bits, &number, sizeof(double));
+    return bits;
+}
+
+static inline double value_bits_to_number(uint64_t bits) {
+    double number;
+    memcpy(&number, &bits, sizeof(double));
+    return number;
+}
+
+#define MAKE_VALUE_NUMBER(n) (Value){.bits = value_number_to_bits(n)}
+#define MAKE_VALUE_BOOLEAN(val) (Value){.bits = (val) ? VALUE_TRUE_BITS : VALUE_FALSE_BITS}
+#define MAKE_VALUE_NIL() (Value){.bits = VALUE_NIL_BITS}
+#define MAKE_VALUE_OBJECT(o) (Value){.bits = VALUE_SIGN_BIT | VALUE_QNAN | (uint64_t) (uintptr_t) (o)}
+#define MAKE_VALUE_UNDEFINED() (Value){.bits = VALUE_UNDEFINED_BITS}
+
+#define VALUE_IS_NUMBER(value) (((value).bits & VALUE_QNAN) != VALUE_QNAN)
+#define VALUE_IS_BOOLEAN(value) (((value).bits | 1) == VALUE_TRUE_BITS)
+#define VALUE_IS_NIL(value) ((value).bits == VALUE_NIL_BITS)
+#define VALUE_IS_OBJECT(value) (((value).bits & (VALUE_SIGN_BIT | VALUE_QNAN)) == (VALUE_SIGN_BIT | VALUE_QNAN))
+#define VALUE_IS_UNDEFINED(value) ((value).bits == VALUE_UNDEFINED_BITS)
+
+#define VALUE_AS_NUMBER(value) value_bits_to_number((value).bits)
+#define VALUE_AS_BOOLEAN(value) ((value).bits == VALUE_TRUE_BITS)
+#define VALUE_AS_OBJECT(value) ((struct Object*) (uintptr_t) ((value).bits & ~(VALUE_SIGN_BIT | VALUE_QNAN)))
+
+static inline ValueType value_type(Value value) {
+    if (VALUE_IS_NUMBER(value)) {
+        return VALUE_NUMBER;
+    }
+    if (VALUE_IS_OBJECT(value)) {
+        return VALUE_OBJECT;
+    }
+    switch (value.bits) {
+        case VALUE_NIL_BITS: return VALUE_NIL;
+        case VALUE_FALSE_BITS:
+        case VALUE_TRUE_BITS: return VALUE_BOOLEAN;
+        case VALUE_UNDEFINED_BITS: return VALUE_UNDEFINED;
+    }
+
+    FAIL("Illegal value bits: %" PRIx64, value.bits);
+    return VALUE_UNDEFINED;
+}
+
+#define VALUE_TYPE(value) value_type(value)
 
 #define ASSERT_VALUE_TYPE(value, expected_type) \
 	do { \
-		if (value.type != expected_type) { \
-			FAIL("Expected value type: %d, found: %d", expected_type, value.type); \
+		if (VALUE_TYPE(value) != expected_type) { \
+			FAIL("Expected value type: %d, found: %d", expected_type, VALUE_TYPE(value)); \
 		} \
 	} while (false)
 
@@ -10,6 +10,7 @@
 #include "ribbon_object.h"
 #include "memory.h"
 #include "table.h"
+#include "heap.h"
 #include "builtins.h"
 #include "bytecode.h"
 #include "disassembler.h"
@@ -20,8 +21,20 @@
 #include "parser.h"
 #include "compiler.h"
 #include "builtin_test_module.h"
-
-#define INITIAL_GC_THRESHOLD 10
+#include "builtin_gc_module.h"
+
+#define GC_NURSERY_BYTES (1024 * 1024) /* Bytes allocated between minor collections */
+#define GC_STRESS_FULL_EVERY 4 /* Under GC_STRESS_TEST, every this many collections one is a full one */
+#define GC_INCREMENT_BYTES (256 * 1024) /* Bytes allocated between the steps of an incremental collection */
+#define GC_SOFT_LIMIT_MIN_HEADROOM 8 /* Past the soft limit, the heap still grows by 1/8 of the live memory between full collections */
+#if GC_STRESS_TEST
+	#define GC_OBJECTS_PER_CLOCK_CHECK 1 /* So that the program runs in between as many steps as possible */
+#else
+	#define GC_OBJECTS_PER_CLOCK_CHECK 128 /* Incremental marking checks for the end of its time slice after tracing this many objects */
+#endif
+#define INITIAL_EVAL_STACK_CAPACITY 256
+#define INITIAL_CALL_STACK_CAPACITY 64
+#define INVOKE_ARGS_BUFFER_SIZE 8 /* Native methods invoked with up to this many arguments get them without an allocation */
 
 #define VM_STDLIB_RELATIVE_PATH "stdlib"
 
@@ -35,10 +48,70 @@ static Bytecode* current_bytecode(void) {
 	return &current_frame()->function->code->bytecode;
 }
 
+#if DEBUG_OPCODE_PAIRS
+static unsigned long opcode_pair_counts[OPCODE_COUNT][OPCODE_COUNT]; /* [first][second] */
+static int previous_opcode = -1;
+
+static void count_opcode_pair(uint8_t opcode) {
+	if (previous_opcode >= 0) {
+		opcode_pair_counts[previous_opcode][opcode]++;
+	}
+	previous_opcode = opcode;
+}
+
+static void print_opcode_pair_counts(void) {
+	printf("Most frequent opcode pairs:\n");
+
+	/* Repeatedly takes out the most frequent remaining pair */
+	for (int rank = 0; rank < 30; rank++) {
+		int first = 0;
+		int second = 0;
+		for (int i = 0; i < OPCODE_COUNT; i++) {
+			for (int j = 0; j < OPCODE_COUNT; j++) {
+				if (opcode_pair_counts[i][j] > opcode_pair_counts[first][second]) {
+					first = i;
+					second = j;
+				}
+			}
+		}
+
+		if (opcode_pair_counts[first][second] == 0) {
+			break;
+		}
+
+		printf("%12lu  %s, %s\n", opcode_pair_counts[first][second],
+				disassembler_opcode_name(first), disassembler_opcode_name(second));
+		opcode_pair_counts[first][second] = 0;
+	}
+}
+#endif
+
+/* Both stacks start small and grow on demand. Growing moves them, so pointers into them
+   mustn't be held across anything which may push. */
+
+static void grow_eval_stack(void) {
+	size_t old_capacity = vm.stack_capacity;
+	size_t top_offset = vm.stack_top - vm.stack;
+
+	vm.stack_capacity = GROW_CAPACITY(old_capacity);
+	vm.stack = reallocate(vm.stack, sizeof(Value) * old_capacity, sizeof(Value) * vm.stack_capacity, "Eval stack");
+	vm.stack_top = vm.stack + top_offset;
+}
+
+static void grow_call_stack(void) {
+	size_t old_capacity = vm.call_stack_capacity;
+	size_t top_offset = vm.call_stack_top - vm.call_stack;
+
+	vm.call_stack_capacity = GROW_CAPACITY(old_capacity);
+	vm.call_stack = reallocate(
+		vm.call_stack, sizeof(StackFrame) * old_capacity, sizeof(StackFrame) * vm.call_stack_capacity, "Call stack");
+	vm.call_stack_top = vm.call_stack + top_offset;
+}
+
 static void push(Value value) {
-	// assert(vm.stack_top - vm.stack < EVAL_STACK_MAX);
-	RIBBON_ASSERT(vm.stack_top - vm.stack < EVAL_STACK_MAX, 
-		"Overflow of *evaluation* stack. Number of frames in *call* stack: %" PRI_SIZET, vm.call_stack_top - vm.call_stack);
+	if (vm.stack_top == vm.stack + vm.stack_capacity) {
+		grow_eval_stack();
+	}
 
 	*vm.stack_top = value;
     vm.stack_top++;
@@ -63,8 +136,8 @@ void vm_push_object(Object* object) {
 
 Object* vm_pop_object() {
 	Value value = pop();
-	assert(value.type == VALUE_OBJECT);
-	return value.as.object;
+	assert(VALUE_IS_OBJECT(value));
+	return VALUE_AS_OBJECT(value);
 }
 
 static Value peek_at(int offset) {
@@ -100,14 +173,26 @@ static StackFrame new_stack_frame(
 	return frame;
 }
 
+/* Returns the new top of the call stack, or NULL if the call stack is at its maximal depth */
+static StackFrame* reserve_frame(void) {
+	if (vm.max_call_depth != 0 && vm.call_stack_top - vm.call_stack >= vm.max_call_depth) {
+		return NULL;
+	}
+
+	if (vm.call_stack_top == vm.call_stack + vm.call_stack_capacity) {
+		grow_call_stack();
+	}
+
+	return vm.call_stack_top++;
+}
+
 static bool push_frame(StackFrame frame) {
-	if (vm.call_stack_top - vm.call_stack == CALL_STACK_MAX) {
+	StackFrame* new_frame = reserve_frame();
+	if (new_frame == NULL) {
 		return false;
 	}
 
-	*vm.call_stack_top = frame;
-	vm.call_stack_top++;
-
+	*new_frame = frame;
 	return true;
 }
 
@@ -139,26 +224,70 @@ StackFrame* vm_peek_previous_frame(void) {
 	return peek_frame(2);
 }
 
+bool vm_get_frame_self(StackFrame* frame, Value* out) {
+	if (frame->is_native) {
+		return false;
+	}
+
+	int self_slot = frame->function->code->bytecode.self_slot;
+	if (self_slot >= 0) {
+		Value self = vm.stack[frame->eval_stack_frame_base_offset + self_slot];
+		if (VALUE_IS_UNDEFINED(self)) {
+			return false;
+		}
+		*out = self;
+		return true;
+	}
+
+	return cell_table_get_value(&frame->local_variables, vm.symbols.self, out);
+}
+
 static CellTable* frame_locals_or_module_table(StackFrame* frame) {
-	return frame->is_entity_base ? &frame->base_entity->attributes : &frame->local_variables;
+	return frame->is_entity_base ? frame->base_entity->attributes : &frame->local_variables;
 }
 
 /* The "correct" locals table depends on whether we are the base function of a module or class or not...
  * This design isn't great, should change it later. */
 static CellTable* locals_or_module_table(void) {
-	return frame_locals_or_module_table(current_frame());
+	StackFrame* frame = current_frame();
+	if (frame->is_entity_base && frame->base_entity->type == OBJECT_CLASS) {
+		/* A class body is defining its class attributes */
+		object_invalidate_attribute_caches();
+	}
+
+	return frame_locals_or_module_table(frame);
+}
+
+/* The cell of the function's upvalue by the name, or NULL if it has none */
+static ObjectCell* find_upvalue_cell(ObjectFunction* function, ObjectString* name) {
+	Bytecode* bytecode = &function->code->bytecode;
+	for (int i = 0; i < function->num_upvalues; i++) {
+		ObjectString* upvalue_name = (ObjectString*) VALUE_AS_OBJECT(bytecode->constants.values[bytecode->upvalues.values[i].name_index]);
+		if (object_strings_equal(upvalue_name, name)) {
+			return function->upvalues[i];
+		}
+	}
+	return NULL;
+}
+
+static bool load_upvalue(ObjectString* name, Value* out) {
+	ObjectCell* cell = find_upvalue_cell(current_frame()->function, name);
+	if (cell != NULL && cell->is_filled) {
+		*out = cell->value;
+		return true;
+	}
+	return false;
 }
 
 static bool load_variable(ObjectString* name, Value* out) {
 	Value value;
 
 	CellTable* locals = &current_frame()->local_variables;
-	CellTable* free_vars = &current_frame()->function->free_vars;
 	CellTable* globals = &vm.globals;
 
 	bool variable_found =
 			cell_table_get_value(locals, name, &value)
-			|| cell_table_get_value(free_vars, name, &value)
+			|| load_upvalue(name, &value)
 			|| (current_frame()->is_entity_base && object_load_attribute(current_frame()->base_entity, name, &value))
 			|| cell_table_get_value(globals, name, &value);
 
@@ -170,22 +299,76 @@ static bool load_variable(ObjectString* name, Value* out) {
 	return false;
 }
 
+/* Fills the cache of a global variable access site with the current bindings of the name */
+static void fill_global_cache(GlobalCache* cache, ObjectModule* module, ObjectString* name) {
+	cache->epoch = cell_table_globals_epoch;
+
+	if (module == NULL || !cell_table_get_cell(module->base.attributes, name, &cache->module_cell)) {
+		cache->module_cell = NULL;
+	}
+	if (!cell_table_get_cell(&vm.globals, name, &cache->builtin_cell)) {
+		cache->builtin_cell = NULL;
+	}
+}
+
+/* The cell the name is bound to in the module or in the builtins, or NULL if it isn't bound */
+static ObjectCell* load_global_cell(GlobalCache* cache, ObjectModule* module, ObjectString* name) {
+	if (cache->epoch != cell_table_globals_epoch) {
+		fill_global_cache(cache, module, name);
+	}
+
+	/* Variables of the module shadow builtins by the same name */
+	if (cache->module_cell != NULL && cache->module_cell->is_filled) {
+		return cache->module_cell;
+	}
+	if (cache->builtin_cell != NULL && cache->builtin_cell->is_filled) {
+		return cache->builtin_cell;
+	}
+	return NULL;
+}
+
+static void store_global(GlobalCache* cache, ObjectModule* module, ObjectString* name, Value value) {
+	if (cache->epoch != cell_table_globals_epoch) {
+		fill_global_cache(cache, module, name);
+	}
+
+	if (cache->module_cell != NULL) {
+		cache->module_cell->value = value;
+		cache->module_cell->is_filled = true;
+		heap_write_barrier((Object*) cache->module_cell, value);
+	} else {
+		/* Creating the binding invalidates the caches of all sites */
+		cell_table_set_value(module->base.attributes, name, value);
+	}
+}
+
 static void gc_mark_object(Object* object);
 
+static void gc_mark_entries(Entry* entries, uint8_t* control, size_t capacity) {
+	for (size_t i = 0; i < capacity; i++) {
+		Entry* entry = &entries[i];
+		if (TABLE_CONTROL_IS_FULL(control[i])) {
+			if (VALUE_IS_OBJECT(entry->value)) {
+				gc_mark_object(VALUE_AS_OBJECT(entry->value));
+			}
+			if (VALUE_IS_OBJECT(entry->key)) {
+				gc_mark_object(VALUE_AS_OBJECT(entry->key));
+			}
+		}
+	}
+}
+
 static void gc_mark_table(Table* table) {
 	/* Gross breaking of table.c encapsulation here, soley for improving proven performance problems. */
 
-	Entry* entries = table->entries;
-	size_t count = table->capacity;
+	gc_mark_entries(table->entries, table->control, table->capacity);
+	if (table->old_entries != NULL) {
+		gc_mark_entries(table->old_entries, table->old_control, table->old_capacity);
+	}
 
-	for (Entry* entry = entries; entry - entries < count; entry++) {
-		if (entry->key.type != VALUE_NIL && entry->tombstone == 0) {
-			if (entry->value.type == VALUE_OBJECT) {
-				gc_mark_object(entry->value.as.object);
-			}
-			if (entry->key.type == VALUE_OBJECT) {
-				gc_mark_object(entry->key.as.object);
-			}
+	for (size_t i = 0; i < table->array_count; i++) {
+		if (VALUE_IS_OBJECT(table->array[i])) {
+			gc_mark_object(VALUE_AS_OBJECT(table->array[i]));
 		}
 	}
 }
@@ -195,36 +378,53 @@ static void gc_mark_object_code(Object* object) {
 	Bytecode* chunk = &code->bytecode;
 	for (int i = 0; i < chunk->constants.count; i++) {
 		Value* constant = &chunk->constants.values[i];
-		if (constant->type == VALUE_OBJECT) {
-			gc_mark_object(constant->as.object);
+		if (VALUE_IS_OBJECT(*constant)) {
+			gc_mark_object(VALUE_AS_OBJECT(*constant));
 		}
 	}
+
+	for (int i = 0; i < code->num_params; i++) {
+		gc_mark_object((Object*) code->parameters[i]);
+	}
 }
 
 static void gc_mark_object_attributes(Object* object) {
-	gc_mark_table(&object->attributes.table);
+	if (object->attributes != NULL) {
+		gc_mark_table(&object->attributes->table);
+	}
 }
 
 static void assert_is_probably_valid_object(Object* object) {
-	assert((object->is_reachable == true) || (object->is_reachable == false));
+	assert(heap_is_allocated(object));
 }
 
-static void gc_mark_function_free_vars(ObjectFunction* function) {
-	gc_mark_table(&function->free_vars.table);
+static void gc_mark_function_upvalues(ObjectFunction* function) {
+	for (int i = 0; i < function->num_upvalues; i++) {
+		if (function->upvalues[i] != NULL) {
+			gc_mark_object((Object*) function->upvalues[i]);
+		}
+	}
 }
 
 static void gc_mark_object_function(Object* object) {
 	ObjectFunction* function = OBJECT_AS_FUNCTION(object);
 
-	for (int i = 0; i < function->num_params; i++) {
-		ObjectString* param = function->parameters[i];
-		gc_mark_object((Object*) param);
+	if (function->name != NULL) {
+		gc_mark_object((Object*) function->name);
 	}
 
-	if (!function->is_native) {
+	if (function->is_native) {
+		for (int i = 0; i < function->num_params; i++) {
+			gc_mark_object((Object*) function->parameters[i]);
+		}
+	} else {
 		ObjectCode* code_object = function->code;
 		gc_mark_object((Object*) code_object);
-		gc_mark_function_free_vars(function);
+		gc_mark_function_upvalues(function);
+	}
+
+	if (function->module != NULL) {
+		gc_mark_object((Object*) function->module);
 	}
 }
 
@@ -234,8 +434,8 @@ static void gc_mark_object_table(Object* object) {
 
 static void gc_mark_object_cell(Object* object) {
 	ObjectCell* cell = (ObjectCell*) object;
-	if (cell->is_filled && cell->value.type == VALUE_OBJECT) {
-		gc_mark_object(cell->value.as.object);
+	if (cell->is_filled && VALUE_IS_OBJECT(cell->value)) {
+		gc_mark_object(VALUE_AS_OBJECT(cell->value));
 	}
 }
 
@@ -248,9 +448,22 @@ static void gc_mark_object_module(Object* object) {
 	}
 }
 
+/* Shapes aren't objects, so they can't go on the gray objects. The recursion is bounded by SHAPE_MAX_FIELDS. */
+static void gc_mark_shape_tree(Shape* shape) {
+	if (shape->name != NULL) {
+		gc_mark_object((Object*) shape->name);
+	}
+
+	for (int i = 0; i < shape->transitions.count; i++) {
+		gc_mark_shape_tree((Shape*) shape->transitions.values[i]);
+	}
+}
+
 static void gc_mark_object_class(Object* object) {
 	ObjectClass* klass = (ObjectClass*) object;
 
+	gc_mark_shape_tree(klass->root_shape);
+
 	if (klass->base_function != NULL) {
 		gc_mark_object((Object*) klass->base_function);
 	}
@@ -266,6 +479,15 @@ static void gc_mark_object_instance(Object* object) {
 
 	gc_mark_object((Object*) klass);
 
+	if (instance->shape != NULL) {
+		for (int i = 0; i < instance->shape->field_count; i++) {
+			Value* field = &instance->fields[i];
+			if (VALUE_IS_OBJECT(*field)) {
+				gc_mark_object(VALUE_AS_OBJECT(*field));
+			}
+		}
+	}
+
 	if (klass->instance_size > 0) {
 		/* Native class */
 
@@ -286,13 +508,12 @@ static void gc_mark_object_bound_method(Object* object) {
 	gc_mark_object((Object*) bound_method->method);
 }
 
-static void gc_mark_object(Object* object) {
-	assert_is_probably_valid_object(object);
-
-	if (object->is_reachable) {
+/* Marks what the object references */
+static void gc_trace_object(Object* object) {
+	/* Native mark functions allocate, which the marker threads mustn't do */
+	if (object->type == OBJECT_INSTANCE && ((ObjectInstance*) object)->klass->gc_mark_func != NULL && heap_defer_trace(object)) {
 		return;
 	}
-	object->is_reachable = true;
 
 	gc_mark_object_attributes(object);
 
@@ -338,14 +559,75 @@ static void gc_mark_object(Object* object) {
 	FAIL("GC couldn't mark object, unknown object type: %d", object->type);
 }
 
-static void gc_mark(void) {
+static bool gc_is_minor = false;
+
+/* The state of the incremental collection in progress */
+typedef enum {
+	GC_PHASE_IDLE,
+	GC_PHASE_MARKING,
+	GC_PHASE_SWEEPING
+} GcPhase;
+
+static GcPhase gc_phase = GC_PHASE_IDLE;
+
+static void gc_mark_object(Object* object) {
+	assert_is_probably_valid_object(object);
+
+	/* A minor collection treats old objects as alive without tracing them. The young objects they reference
+	   are reached through the remembered set instead. */
+	if (gc_is_minor && !heap_is_young(object)) {
+		return;
+	}
+
+	heap_shade(object);
+}
+
+static void gc_trace_gray_objects(void) {
+	Object* object;
+	while ((object = heap_pop_gray()) != NULL) {
+		gc_trace_object(object);
+	}
+}
+
+/* Returns whether all gray objects were traced before the deadline */
+static bool gc_trace_gray_objects_until(clock_t deadline) {
+	int traced = 0;
+	Object* object;
+	while ((object = heap_pop_gray()) != NULL) {
+		gc_trace_object(object);
+		if (++traced % GC_OBJECTS_PER_CLOCK_CHECK == 0 && clock() >= deadline) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void gc_mark_symbols(void) {
+	gc_mark_object((Object*) vm.symbols.self);
+	gc_mark_object((Object*) vm.symbols.init);
+	gc_mark_object((Object*) vm.symbols.add);
+	gc_mark_object((Object*) vm.symbols.get_key);
+	gc_mark_object((Object*) vm.symbols.set_key);
+	gc_mark_object((Object*) vm.symbols.get);
+	gc_mark_object((Object*) vm.symbols.set);
+	gc_mark_object((Object*) vm.symbols.length);
+}
+
+static void gc_mark_roots(void) {
 	gc_mark_table(&vm.globals.table);
 	gc_mark_table(&vm.imported_modules.table);
 	gc_mark_table(&vm.builtin_modules.table);
+	if (vm.string_class != NULL) {
+		gc_mark_symbols();
+		gc_mark_object((Object*) vm.string_class);
+		gc_mark_object((Object*) vm.table_class);
+		gc_mark_object((Object*) vm.descriptor_class);
+	}
 
 	for (Value* value = vm.stack; value != vm.stack_top; value++) {
-		if (value->type == VALUE_OBJECT) {
-			gc_mark_object(value->as.object);
+		if (VALUE_IS_OBJECT(*value)) {
+			gc_mark_object(VALUE_AS_OBJECT(*value));
 		}
 	}
 	
@@ -359,23 +641,40 @@ static void gc_mark(void) {
 	}
 }
 
+static void gc_mark(void) {
+	gc_mark_roots();
+
+	if (gc_is_minor) {
+		heap_trace_remembered(gc_trace_object);
+	}
+
+	/* The young generation is small, and not worth starting threads for */
+	if (!gc_is_minor && vm.gc_threads > 1) {
+		heap_trace_gray_objects_parallel(vm.gc_threads, gc_trace_object);
+	} else {
+		gc_trace_gray_objects();
+	}
+}
+
 static void gc_sweep(void) {
-	Object** current = &vm.objects;
-	while (*current != NULL) {
-		if ((*current)->is_reachable) {
-			(*current)->is_reachable = false;
-			current = &((*current)->next);
-		} else {
-			Object* unreachable = *current;
-			*current = unreachable->next;
-			object_free(unreachable);
-		}
+	heap_sweep(gc_is_minor ? HEAP_SWEEP_YOUNG : HEAP_SWEEP_ALL, gc_is_minor ? 1 : vm.gc_threads);
+}
+
+static double milliseconds_since(clock_t start) {
+	return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static void record_pause(int* collections, double* pause_total, double* pause_max, double pause) {
+	(*collections)++;
+	*pause_total += pause;
+	if (pause > *pause_max) {
+		*pause_max = pause;
 	}
 }
 
-/* vm_gc is only exposed outside for use in the _testing module. Apart from that, never invoke
-   directly without a good reason. */
-void vm_gc(void) {
+static void finish_incremental_collection(void);
+
+static void collect_garbage(bool minor) {
 	#if DISABLE_GC
 
 	DEBUG_GC_PRINT("GC would run, but is disabled");
@@ -383,21 +682,46 @@ void vm_gc(void) {
 	#else
 
 	if (vm.allow_gc) {
+		/* Both kinds of stop-the-world collections need the heap as an incremental collection leaves it */
+		finish_incremental_collection();
+
 		size_t memory_before_gc = get_allocated_memory();
-		DEBUG_GC_PRINT("===== GC Running =====");
-		DEBUG_GC_PRINT("num_objects: %d. max_objects: %d", vm.num_objects, vm.max_objects);
+		size_t young_objects = heap_num_young();
+		int objects_before_gc = vm.num_objects;
+		clock_t start = clock();
+
+		DEBUG_GC_PRINT("===== %s GC Running =====", minor ? "Minor" : "Full");
+		DEBUG_GC_PRINT("num_objects: %d. Young objects: %" PRI_SIZET, vm.num_objects, young_objects);
+		DEBUG_GC_PRINT("Full collection threshold: %" PRI_SIZET " bytes", vm.gc_threshold);
 		DEBUG_GC_PRINT("Allocated memory: %" PRI_SIZET " bytes", memory_before_gc);
 		DEBUG_GC_PRINT("=======================");
 
+		gc_is_minor = minor;
 		gc_mark();
+		double mark_time = milliseconds_since(start);
 		gc_sweep();
+		gc_is_minor = false;
+
+		double pause = milliseconds_since(start);
+
+		if (minor) {
+			record_pause(&vm.gc_stats.minor_collections, &vm.gc_stats.minor_pause_total, &vm.gc_stats.minor_pause_max, pause);
+			vm.gc_stats.young_objects += young_objects;
+			vm.gc_stats.promoted_objects += young_objects - (size_t) (objects_before_gc - vm.num_objects);
+		} else {
+			record_pause(&vm.gc_stats.full_collections, &vm.gc_stats.full_pause_total, &vm.gc_stats.full_pause_max, pause);
+			vm.gc_stats.full_mark_total += mark_time;
+			vm.gc_live_memory = get_allocated_memory();
+			vm_update_gc_threshold();
+		}
 
-		vm.max_objects = vm.num_objects * 2;
+		vm.next_gc = memory_allocated_total + GC_NURSERY_BYTES;
 
 		DEBUG_GC_PRINT("===== GC Finished =====");
-		DEBUG_GC_PRINT("numObjects: %d. maxObjects: %d", vm.num_objects, vm.max_objects);
+		DEBUG_GC_PRINT("numObjects: %d. Full collection threshold: %" PRI_SIZET " bytes", vm.num_objects, vm.gc_threshold);
 		DEBUG_GC_PRINT("Allocated memory before GC: %" PRI_SIZET " bytes", memory_before_gc);
 		DEBUG_GC_PRINT("Allocated memory after GC: %" PRI_SIZET " bytes", get_allocated_memory());
+		DEBUG_GC_PRINT("Pause: %g ms", pause);
 		DEBUG_GC_PRINT("=======================");
 	} else {
 		DEBUG_GC_PRINT("GC should run, but vm.allow_gc is still false.");
@@ -406,6 +730,178 @@ void vm_gc(void) {
 	#endif
 }
 
+/* An incremental collection of the old generation starts with a minor collection, so that every object is old.
+   From then on, the objects allocated during the collection are marked, and later left alone by the sweep.
+   Minor collections wait for the incremental collection to finish. */
+static void start_incremental_collection(void) {
+	collect_garbage(true);
+	if (DISABLE_GC || !vm.allow_gc) {
+		return;
+	}
+
+	DEBUG_GC_PRINT("===== Incremental GC Starting =====");
+
+	heap_incremental_marking = true;
+	gc_mark_roots();
+	gc_phase = GC_PHASE_MARKING;
+	vm.next_gc = memory_allocated_total + GC_INCREMENT_BYTES;
+}
+
+/* The roots aren't behind a write barrier, so they're marked again once everything else is. So are the objects
+   which are always remembered, since the barrier doesn't see their references either. */
+static void finish_marking(void) {
+	gc_mark_roots();
+	heap_trace_always_remembered(gc_trace_object);
+	gc_trace_gray_objects();
+
+	heap_incremental_marking = false;
+	heap_begin_sweep(HEAP_SWEEP_OLD);
+	gc_phase = GC_PHASE_SWEEPING;
+}
+
+static void finish_sweeping(void) {
+	gc_phase = GC_PHASE_IDLE;
+	vm.gc_stats.incremental_collections++;
+	vm.gc_live_memory = get_allocated_memory(); /* Includes what was allocated during the collection, which survived it */
+	vm_update_gc_threshold();
+	vm.next_gc = memory_allocated_total + GC_NURSERY_BYTES;
+
+	DEBUG_GC_PRINT("===== Incremental GC Finished =====");
+	DEBUG_GC_PRINT("numObjects: %d. Full collection threshold: %" PRI_SIZET " bytes", vm.num_objects, vm.gc_threshold);
+}
+
+/* Does the work of the incremental collection until the deadline */
+static void incremental_step(clock_t deadline) {
+	if (!vm.allow_gc) {
+		return;
+	}
+
+	clock_t start = clock();
+
+	if (gc_phase == GC_PHASE_MARKING) {
+		if (gc_trace_gray_objects_until(deadline)) {
+			finish_marking();
+		}
+	} else if (gc_phase == GC_PHASE_SWEEPING) {
+		if (heap_sweep_step(deadline)) {
+			finish_sweeping();
+		}
+	}
+
+	if (gc_phase != GC_PHASE_IDLE) {
+		vm.next_gc = memory_allocated_total + GC_INCREMENT_BYTES;
+	}
+
+	record_pause(&vm.gc_stats.incremental_steps, &vm.gc_stats.incremental_pause_total, &vm.gc_stats.incremental_pause_max,
+			milliseconds_since(start));
+}
+
+static void finish_incremental_collection(void) {
+	if (gc_phase == GC_PHASE_MARKING) {
+		finish_marking();
+	}
+	if (gc_phase == GC_PHASE_SWEEPING) {
+		heap_finish_sweep();
+		finish_sweeping();
+	}
+}
+
+/* Collection at a safepoint of the interpreter loop, once the nursery is full: minor, unless the allocated memory reached
+   gc_threshold. In incremental mode the old objects are collected in steps, one at every safepoint until the collection
+   is done. Past the soft limit, a full collection doesn't wait for that. */
+static void gc_at_safepoint(void) {
+	size_t allocated_memory = get_allocated_memory();
+
+	if (vm.gc_soft_limit > 0 && allocated_memory >= vm.gc_soft_limit && allocated_memory >= vm.gc_threshold) {
+		if (vm.allow_gc) {
+			vm.gc_stats.emergency_collections++;
+		}
+		collect_garbage(false);
+	} else if (gc_phase != GC_PHASE_IDLE) {
+		incremental_step(clock() + (clock_t) (vm.gc_pause_target * CLOCKS_PER_SEC / 1000));
+	} else if (allocated_memory < vm.gc_threshold) {
+		collect_garbage(true);
+	} else if (vm.gc_incremental) {
+		start_incremental_collection();
+	} else {
+		collect_garbage(false);
+	}
+}
+
+#if GC_STRESS_TEST
+/* Mostly minor collections, so that objects are promoted right away and a missing write barrier shows up quickly.
+   In incremental mode, a full collection is an incremental one instead, with a step as small as it gets at every instruction. */
+static void gc_stress(void) {
+	static unsigned int collections = 0;
+
+	if (gc_phase != GC_PHASE_IDLE) {
+		incremental_step(clock());
+	} else if (++collections % GC_STRESS_FULL_EVERY != 0) {
+		collect_garbage(true);
+	} else if (vm.gc_incremental) {
+		start_incremental_collection();
+	} else {
+		collect_garbage(false);
+	}
+}
+#endif
+
+/* vm_gc is only exposed outside for use in the _testing module. Apart from that, never invoke
+   directly without a good reason. Always does a full collection. */
+void vm_gc(void) {
+	collect_garbage(false);
+}
+
+/* Same as vm_gc, for a minor collection */
+void vm_minor_gc(void) {
+	collect_garbage(true);
+}
+
+/* Starts an incremental collection, which then goes on at the following safepoints. Also only for the _testing module. */
+void vm_start_incremental_gc(void) {
+	if (gc_phase == GC_PHASE_IDLE) {
+		start_incremental_collection();
+	}
+}
+
+bool vm_incremental_gc_in_progress(void) {
+	return gc_phase != GC_PHASE_IDLE;
+}
+
+/* Sets the allocated memory at which the next full collection runs, from what the last one left. Call again after changing
+   the growth factor, the minimum heap or the soft limit. */
+void vm_update_gc_threshold(void) {
+	size_t threshold = (size_t) (vm.gc_live_memory * vm.gc_growth_factor);
+	if (threshold < vm.gc_min_heap) {
+		threshold = vm.gc_min_heap;
+	}
+
+	if (vm.gc_soft_limit > 0 && threshold > vm.gc_soft_limit) {
+		/* Once the live memory itself nears the limit, collecting right at it would only thrash */
+		size_t least_threshold = vm.gc_live_memory + vm.gc_live_memory / GC_SOFT_LIMIT_MIN_HEADROOM;
+		threshold = vm.gc_soft_limit > least_threshold ? vm.gc_soft_limit : least_threshold;
+	}
+
+	vm.gc_threshold = threshold;
+}
+
+void vm_print_gc_stats(void) {
+	GcStats* stats = &vm.gc_stats;
+	double promotion_rate = stats->young_objects > 0 ? 100.0 * stats->promoted_objects / stats->young_objects : 0;
+
+	printf("======== GC statistics ========\n");
+	printf("Minor collections: %d. Total pause: %.3f ms. Longest pause: %.3f ms\n",
+			stats->minor_collections, stats->minor_pause_total, stats->minor_pause_max);
+	printf("Promoted %" PRI_SIZET " of %" PRI_SIZET " young objects (%.1f%%)\n",
+			stats->promoted_objects, stats->young_objects, promotion_rate);
+	printf("Full collections: %d (%d forced by the soft limit). Total pause: %.3f ms, %.3f ms of it marking. Longest pause: %.3f ms\n",
+			stats->full_collections, stats->emergency_collections, stats->full_pause_total, stats->full_mark_total,
+			stats->full_pause_max);
+	printf("Incremental collections: %d, in %d steps. Total pause: %.3f ms. Longest pause: %.3f ms\n",
+			stats->incremental_collections, stats->incremental_steps, stats->incremental_pause_total, stats->incremental_pause_max);
+	printf("===============================\n");
+}
+
 static ValueArray collect_values(int count) {
 	ValueArray values;
 	value_array_init(&values);
@@ -469,12 +965,35 @@ static void register_builtin_modules(void) {
 	register_function_on_module(test_module, "get_value_directly_from_object_attributes", 2, (char*[]) {"object", "attribute"}, builtin_test_get_value_directly_from_object_attributes);
 
 	register_function_on_module(test_module, "gc", 0, NULL, builtin_test_gc);
+	register_function_on_module(test_module, "minor_gc", 0, NULL, builtin_test_minor_gc);
+	register_function_on_module(test_module, "allow_gc", 1, (char*[]) {"allow"}, builtin_test_allow_gc);
+	register_function_on_module(test_module, "set_max_call_depth", 1, (char*[]) {"frames"}, builtin_test_set_max_call_depth);
+	register_function_on_module(test_module, "start_incremental_gc", 0, NULL, builtin_test_start_incremental_gc);
+	register_function_on_module(test_module, "incremental_gc_in_progress", 0, NULL, builtin_test_incremental_gc_in_progress);
 
 	register_function_on_module(test_module, "table_details", 1, (char*[]) {"table"}, builtin_test_table_details);
 	
 	register_function_on_module(test_module, "table_delete", 2, (char*[]) {"table", "key"}, builtin_test_table_delete);
 
 	cell_table_set_value_cstring_key(&vm.builtin_modules, test_module_name, MAKE_VALUE_OBJECT(test_module));
+
+	const char* gc_module_name = "gc";
+	ObjectModule* gc_module = object_module_native_new(object_string_copy_from_null_terminated(gc_module_name), NULL);
+
+	register_function_on_module(gc_module, "collect", 0, NULL, builtin_gc_collect);
+	register_function_on_module(gc_module, "get_heap_size", 0, NULL, builtin_gc_get_heap_size);
+	register_function_on_module(gc_module, "get_allocated_total", 0, NULL, builtin_gc_get_allocated_total);
+	register_function_on_module(gc_module, "get_growth_factor", 0, NULL, builtin_gc_get_growth_factor);
+	register_function_on_module(gc_module, "set_growth_factor", 1, (char*[]) {"factor"}, builtin_gc_set_growth_factor);
+	register_function_on_module(gc_module, "get_min_heap", 0, NULL, builtin_gc_get_min_heap);
+	register_function_on_module(gc_module, "set_min_heap", 1, (char*[]) {"size"}, builtin_gc_set_min_heap);
+	register_function_on_module(gc_module, "get_soft_limit", 0, NULL, builtin_gc_get_soft_limit);
+	register_function_on_module(gc_module, "set_soft_limit", 1, (char*[]) {"size"}, builtin_gc_set_soft_limit);
+	register_function_on_module(gc_module, "get_threads", 0, NULL, builtin_gc_get_threads);
+	register_function_on_module(gc_module, "set_threads", 1, (char*[]) {"threads"}, builtin_gc_set_threads);
+	register_function_on_module(gc_module, "get_mark_time", 0, NULL, builtin_gc_get_mark_time);
+
+	cell_table_set_value_cstring_key(&vm.builtin_modules, gc_module_name, MAKE_VALUE_OBJECT(gc_module));
 }
 
 static bool call_native_function(ObjectFunction* function, Object* self, ValueArray arguments, Value* out) {
@@ -569,20 +1088,54 @@ static void configure_library_loading() {
 	deallocate(wide_stdlib_path, stdlib_path_length * 100, "stdlib path wide");
 }
 
+static void init_symbols(void) {
+	vm.symbols.self = object_string_copy_from_null_terminated("self");
+	vm.symbols.init = object_string_copy_from_null_terminated("@init");
+	vm.symbols.add = object_string_copy_from_null_terminated("@add");
+	vm.symbols.get_key = object_string_copy_from_null_terminated("@get_key");
+	vm.symbols.set_key = object_string_copy_from_null_terminated("@set_key");
+	vm.symbols.get = object_string_copy_from_null_terminated("@get");
+	vm.symbols.set = object_string_copy_from_null_terminated("@set");
+	vm.symbols.length = object_string_copy_from_null_terminated("length");
+}
+
 void vm_init(void) {
 	vm.currently_handling_error = false;
+	vm.string_class = vm.table_class = vm.descriptor_class = NULL;
+	vm.symbols = (Symbols) {0};
 
+	vm.stack_capacity = INITIAL_EVAL_STACK_CAPACITY;
+	vm.stack = allocate(sizeof(Value) * vm.stack_capacity, "Eval stack");
 	vm.stack_top = vm.stack;
+	vm.call_stack_capacity = INITIAL_CALL_STACK_CAPACITY;
+	vm.call_stack = allocate(sizeof(StackFrame) * vm.call_stack_capacity, "Call stack");
 	vm.call_stack_top = vm.call_stack;
+	vm.interpreter_depth = 0;
 
+    heap_init();
     vm.num_objects = 0;
-    vm.max_objects = INITIAL_GC_THRESHOLD;
+    vm.next_gc = memory_allocated_total + GC_NURSERY_BYTES;
+    vm.gc_live_memory = 0;
+    vm.gc_stats = (GcStats) {0};
+    vm.gc_incremental = GC_INCREMENTAL;
+    vm.gc_pause_target = GC_DEFAULT_PAUSE_TARGET;
+    vm.gc_growth_factor = GC_DEFAULT_GROWTH_FACTOR;
+    vm.gc_min_heap = GC_DEFAULT_MIN_HEAP;
+    vm.gc_soft_limit = GC_DEFAULT_SOFT_LIMIT;
+    vm.gc_threads = GC_DEFAULT_THREADS;
+    vm.max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+    vm_update_gc_threshold();
     vm.allow_gc = false;
     vm.imported_modules = cell_table_new_empty();
     vm.builtin_modules = cell_table_new_empty();
-	table_init(&vm.string_cache); /* Must appear before the rest of the function - because other functions
-	                                 may create strings, and then table_init would lose hold of and leak them */
+	string_cache_init(&vm.string_cache); /* Must appear before the rest of the function - because other functions
+	                                 may create strings, and then string_cache_init would lose hold of and leak them */
     cell_table_init(&vm.globals);
+    vm.globals.holds_globals = true;
+    init_symbols();
+    vm.string_class = object_string_class_new();
+    vm.table_class = object_table_class_new();
+    vm.descriptor_class = object_descriptor_class_new();
     set_builtin_globals();
 	register_builtin_modules();
 
@@ -601,18 +1154,31 @@ void vm_free(void) {
 	table_debug_print_general_stats();
 	#endif
 
+	#if DEBUG_OPCODE_PAIRS
+	print_opcode_pair_counts();
+	#endif
+
 	vm.stack_top = vm.stack;
 	vm.call_stack_top = vm.call_stack;
 
 	cell_table_free(&vm.globals);
 	cell_table_free(&vm.imported_modules);
 	cell_table_free(&vm.builtin_modules);
-	table_free(&vm.string_cache);	
+	string_cache_free(&vm.string_cache);
+	vm.string_class = vm.table_class = vm.descriptor_class = NULL;
+	vm.symbols = (Symbols) {0};
 
 	vm_gc();
+	heap_free();
+
+	deallocate(vm.stack, sizeof(Value) * vm.stack_capacity, "Eval stack");
+	deallocate(vm.call_stack, sizeof(StackFrame) * vm.call_stack_capacity, "Call stack");
+	vm.stack = vm.stack_top = NULL;
+	vm.call_stack = vm.call_stack_top = NULL;
+	vm.stack_capacity = vm.call_stack_capacity = 0;
 
     vm.num_objects = 0;
-    vm.max_objects = INITIAL_GC_THRESHOLD;
+    vm.next_gc = vm.gc_threshold = vm.gc_live_memory = 0;
     vm.allow_gc = false;
 
 	/* These two will be NULL if we are running in -dry mode. Maybe this isn't the best solution, but for now it's fine. */
@@ -628,7 +1194,7 @@ static void print_call_stack(void) {
 	const int MAX_FRAMES_VISUALIZE = 40;
 	StackFrame* stopping_point = vm.call_stack_top - vm.call_stack <= MAX_FRAMES_VISUALIZE ? vm.call_stack : vm.call_stack_top - MAX_FRAMES_VISUALIZE;
 	for (StackFrame* frame = vm.call_stack_top - 1; frame >= stopping_point; frame--) {
-		printf("    -> %s\n", frame->function->name);
+		printf("    -> %s\n", object_function_name(frame->function));
 	}
 	if (stopping_point != vm.call_stack) {
 		printf("    -> [... %d lower frames truncated ...]\n", (int) (stopping_point - vm.call_stack));
@@ -643,13 +1209,11 @@ static void print_stack_trace(void) {
 static void set_function_name(const Value* function_value, ObjectString* name) {
 	assert(object_value_is(*function_value, OBJECT_FUNCTION));
 
-	ObjectFunction* function = (ObjectFunction*) function_value->as.object;
-	char* new_cstring_name = copy_null_terminated_cstring(name->chars, "Function name");
-	object_function_set_name(function, new_cstring_name);
+	object_function_set_name((ObjectFunction*) VALUE_AS_OBJECT(*function_value), name);
 }
 
 static void set_class_name(const Value* class_value, ObjectString* name) {
-	ObjectClass* klass = (ObjectClass*) class_value->as.object;
+	ObjectClass* klass = (ObjectClass*) VALUE_AS_OBJECT(*class_value);
 	deallocate(klass->name, strlen(klass->name) + 1, "Class name");
 	char* new_cstring_name = copy_null_terminated_cstring(name->chars, "Class name");
 	object_class_set_name(klass, new_cstring_name);
@@ -683,11 +1247,11 @@ static ImportResult load_text_module(ObjectString* module_name, const char* file
 			deallocate(source, source_buffer_size, "File content buffer");
 
 			/* Wrap the Bytecode in an ObjectCode, and wrap the ObjectCode in an ObjectFunction */
-			ObjectCode* code_object = object_code_new(module_bytecode);
-			ObjectFunction* module_base_function = object_user_function_new(code_object, NULL, 0, cell_table_new_empty());
+			ObjectCode* code_object = object_code_new(module_bytecode, NULL, 0);
+			ObjectFunction* module_base_function = object_user_function_new(code_object);
 
 			char* base_func_name = make_base_module_function_name(module_name);
-			object_function_set_name(module_base_function, base_func_name);
+			object_function_set_name(module_base_function, object_string_take(base_func_name, strlen(base_func_name)));
 
 			/* Wrap the ObjectFunction in an ObjectModule */
 			ObjectModule* module = object_module_new(module_name, module_base_function);
@@ -761,28 +1325,51 @@ CallResult vm_call_function(ObjectFunction* function, ValueArray args, Value* ou
 	return result;
 }
 
-static CallResult call_bound_method_leave_on_stack(ObjectBoundMethod* bound_method, ValueArray args) {
-	ObjectFunction* method = bound_method->method;
-
+static CallResult call_method_leave_on_stack(ObjectFunction* method, Object* self, ValueArray args) {
 	if (method->num_params != args.count) {
 		return CALL_RESULT_INVALID_ARGUMENT_COUNT;
 	}
 
 	if (method->is_native) {
 		Value out;
-		if (call_native_function(method, bound_method->self, args, &out)) {
+		if (call_native_function(method, self, args, &out)) {
 			push(out);
 			return CALL_RESULT_SUCCESS;
 		}
 		return CALL_RESULT_NATIVE_EXECUTION_FAILED;
 	}
 
-	if (call_ribbon_function_leave_on_stack(method, bound_method->self, args, NULL)) {
+	if (call_ribbon_function_leave_on_stack(method, self, args, NULL)) {
 		return CALL_RESULT_SUCCESS;
 	}
 	return CALL_RESULT_RIBBON_CODE_EXECUTION_FAILED;
 }
 
+static CallResult call_bound_method_leave_on_stack(ObjectBoundMethod* bound_method, ValueArray args) {
+	return call_method_leave_on_stack(bound_method->method, bound_method->self, args);
+}
+
+/* Calls the method of the object by the given name, leaving the result on the stack.
+   A method the object gets from its class is called with the object as self directly, without creating a bound method.
+   Returns CALL_RESULT_INVALID_CALLABLE if the attribute isn't a method. */
+static CallResult call_method_by_name_leave_on_stack(Object* object, ObjectString* name, ValueArray args) {
+	ObjectFunction* method;
+	if (object_find_method(object, name, &method)) {
+		return call_method_leave_on_stack(method, object, args);
+	}
+
+	Value attribute;
+	if (!object_load_attribute(object, name, &attribute)) {
+		return CALL_RESULT_NO_SUCH_ATTRIBUTE;
+	}
+
+	if (!object_value_is(attribute, OBJECT_BOUND_METHOD)) {
+		return CALL_RESULT_INVALID_CALLABLE;
+	}
+
+	return call_bound_method_leave_on_stack((ObjectBoundMethod*) VALUE_AS_OBJECT(attribute), args);
+}
+
 CallResult vm_call_bound_method(ObjectBoundMethod* bound_method, ValueArray args, Value* out) {
 	CallResult result = call_bound_method_leave_on_stack(bound_method, args);
 	if (result == CALL_RESULT_SUCCESS) {
@@ -796,9 +1383,9 @@ static CallResult instantiate_class_leave_on_stack(ObjectClass* klass, ValueArra
 	ObjectInstance* instance = object_instance_new(klass);
 
 	Value init_method_value;
-	if (object_load_attribute_cstring_key((Object*) instance, "@init", &init_method_value)) {
+	if (object_load_attribute((Object*) instance, vm.symbols.init, &init_method_value)) {
 		ObjectBoundMethod* init_bound_method = NULL;
-		if ((init_bound_method = VALUE_AS_OBJECT(init_method_value, OBJECT_BOUND_METHOD, ObjectBoundMethod)) == NULL) {
+		if ((init_bound_method = VALUE_AS_OBJECT_OF_TYPE(init_method_value, OBJECT_BOUND_METHOD, ObjectBoundMethod)) == NULL) {
 			return CALL_RESULT_CLASS_INIT_NOT_METHOD;
 		}
 
@@ -862,16 +1449,25 @@ static CallResult call_object_leave_on_stack(Object* object, ValueArray args) {
 }
 
 CallResult vm_call_attribute(Object* object, ObjectString* name, ValueArray args, Value* out) {
+	ObjectFunction* method;
+	if (object_find_method(object, name, &method)) {
+		CallResult result = call_method_leave_on_stack(method, object, args);
+		if (result == CALL_RESULT_SUCCESS) {
+			*out = pop();
+		}
+		return result;
+	}
+
 	Value attrval;
 	if (!object_load_attribute(object, name, &attrval)) {
 		return CALL_RESULT_NO_SUCH_ATTRIBUTE;
 	}
 
-	if (attrval.type != VALUE_OBJECT) {
+	if (!VALUE_IS_OBJECT(attrval)) {
 		return CALL_RESULT_INVALID_CALLABLE;
 	}
 
-	Object* callee = attrval.as.object;
+	Object* callee = VALUE_AS_OBJECT(attrval);
 
 	return vm_call_object(callee, args, out);
 }
@@ -962,7 +1558,7 @@ ImportResult vm_import_module(ObjectString* module_name) {
 	Value builtin_module_value;
 	if (cell_table_get_value(&vm.builtin_modules, module_name, &builtin_module_value)) {
 		assert(object_value_is(builtin_module_value, OBJECT_MODULE));
-		ObjectModule* module = (ObjectModule*) builtin_module_value.as.object;
+		ObjectModule* module = (ObjectModule*) VALUE_AS_OBJECT(builtin_module_value);
 
 		cell_table_set_value(locals_or_module_table(), module_name, MAKE_VALUE_OBJECT(module));
 		cell_table_set_value(&vm.imported_modules, module_name, MAKE_VALUE_OBJECT(module));
@@ -1031,7 +1627,7 @@ ObjectModule* vm_get_module(ObjectString* name) {
 	if (cell_table_get_value(&vm.imported_modules, name, &module_value)) {
 		assert(object_value_is(module_value, OBJECT_MODULE));
 
-		return (ObjectModule*) module_value.as.object;
+		return (ObjectModule*) VALUE_AS_OBJECT(module_value);
 	}
 
 	return NULL;
@@ -1041,924 +1637,1414 @@ ObjectModule* vm_get_module_cstring(char* name) {
 	return vm_get_module(object_string_copy_from_null_terminated(name));
 }
 
-static CellTable find_free_vars_for_new_function(ObjectCode* func_code) {
-	IntegerArray names_refd_in_created_func = func_code->bytecode.referenced_names_indices;
-	int names_refd_count = names_refd_in_created_func.count;
-
-	CellTable free_vars = cell_table_new_empty();
-
-	for (int i = 0; i < names_refd_count; i++) {
-		/* Get the name of the variable referenced inside the created function */
-		size_t refd_name_index = names_refd_in_created_func.values[i];
-		Value refd_name_value = func_code->bytecode.constants.values[refd_name_index];
-		assert(object_value_is(refd_name_value, OBJECT_STRING));
-		ObjectString* refd_name = (ObjectString*) refd_name_value.as.object;
-
-		/* If the cell for the refd_name exists in our current local scope, we take that cell
-		* and put it in the free_vars of the created function.
-		* If it doesn't, we check to see if this name is assigned anywhere in the current running function,
-		* even though it hasn't been assigned yet, because if we later assign it in this current function, we would like
-		* the created closure to be able to see the new value.
-		* If it is assigned anywhere in the current function, we create a new empty cell, and we put it in both our
-		* own local scope and the free_vars of the newly created function.
-		* If it isn't assigned in our currently running function, the last resort is to look it up in our own free_vars.
-		* This should create the chain of nested closures.
-		* We look in our free_vars as the "last resort", because we want more inner references to shadow more outer references
-		* for the created closure.
-		* If the cell does exist in the free_vars, we put it in the new free_vars.
-		* If it doesn't, than the name mentioned in the closure is either a reference to a global or an error. We'll find out
-		* when the closure runs. */
+/* Fills in the cell of each upvalue of a function or class body being created, from the current frame, the way the compiler
+   resolved them (see resolve_upvalues in compiler.c). Its own variable by the name comes first, so more inner variables
+   shadow more outer ones. If the frame is going to assign the variable but hasn't yet, the cell is made now,
+   so the created closure sees the value once it's assigned. Otherwise the frame passes on its own upvalue.
+   A NULL cell means the name refers to a global, or to nothing - which will be found out when the closure runs. */
+static void capture_upvalues(ObjectFunction* function) {
+	Bytecode* bytecode = &function->code->bytecode;
+	ObjectFunction* current_function = current_frame()->function;
 
+	for (int i = 0; i < bytecode->upvalues.count; i++) {
+		Upvalue* upvalue = &bytecode->upvalues.values[i];
+		ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(bytecode->constants.values[upvalue->name_index]);
 		ObjectCell* cell = NULL;
 
-		if (cell_table_get_cell_cstring_key(locals_or_module_table(), refd_name->chars, &cell)) {
-			cell_table_set_cell_cstring_key(&free_vars, refd_name->chars, cell);
-		} else {
-			Bytecode* current_bytecode = &current_frame()->function->code->bytecode;
-			IntegerArray* assigned_names_indices = &current_bytecode->assigned_names_indices;
-
-			for (int i = 0; i < assigned_names_indices->count; i++) {
-				size_t assigned_name_index = assigned_names_indices->values[i];
-				Value assigned_name_constant = current_bytecode->constants.values[assigned_name_index];
-				assert(object_value_is(assigned_name_constant, OBJECT_STRING));
-				ObjectString* assigned_name = (ObjectString*) assigned_name_constant.as.object;
-
-				if (object_strings_equal(refd_name, assigned_name)) {
-					cell = object_cell_new_empty();
-					cell_table_set_cell_cstring_key(&free_vars, refd_name->chars, cell);
-					cell_table_set_cell_cstring_key(locals_or_module_table(), refd_name->chars, cell);
-					break;
-				}
+		if (upvalue->in_enclosing_locals && !cell_table_get_cell(locals_or_module_table(), name, &cell)) {
+			cell = NULL;
+			if (upvalue->assigned_in_enclosing) {
+				cell = object_cell_new_empty();
+				cell_table_set_cell(locals_or_module_table(), name, cell);
 			}
+		}
 
-			CellTable* current_func_free_vars = &current_frame()->function->free_vars;
-			if (cell == NULL && cell_table_get_cell_cstring_key(current_func_free_vars, refd_name->chars, &cell)) {
-				cell_table_set_cell_cstring_key(&free_vars, refd_name->chars, cell);
-			}
+		if (cell == NULL && upvalue->enclosing_index >= 0) {
+			assert(upvalue->enclosing_index < current_function->num_upvalues);
+			cell = current_function->upvalues[upvalue->enclosing_index];
 		}
+
+		function->upvalues[i] = cell;
 	}
+}
 
-	return free_vars;
+static ObjectString* local_slot_name(Bytecode* bytecode, int slot) {
+	Value name = bytecode->constants.values[bytecode->local_names_indices.values[slot]];
+	assert(object_value_is(name, OBJECT_STRING));
+	return (ObjectString*) VALUE_AS_OBJECT(name);
 }
 
-#define READ_BYTE() (*vm.ip++)
+/* Pushes the frame of a Ribbon function whose arguments are already on top of the eval stack, and points vm.ip at its code.
+   The arguments aren't copied anywhere - they become the parameter slots at the base of the new frame.
+   Calls push their arguments last to first, so parameter slots are numbered in reverse. */
+static bool push_ribbon_frame(ObjectFunction* function, Object* self, Object* base_entity, int arg_count) {
+	Bytecode* bytecode = &function->code->bytecode;
+	int num_local_slots = bytecode->local_names_indices.count;
 
-static Value read_constant(void) {
-	uint8_t index_byte1 = READ_BYTE();
-	uint8_t index_byte2 = READ_BYTE();
-	uint16_t index = two_bytes_to_short(index_byte1, index_byte2);
-	return current_bytecode()->constants.values[index];
-}
+	assert(arg_count == function->num_params);
+	assert(num_local_slots >= arg_count);
 
-#define READ_CONSTANT() (read_constant())
+	StackFrame* frame = reserve_frame();
+	if (frame == NULL) {
+		return false;
+	}
 
-static bool vm_interpret_frame(StackFrame* frame) {
-	#define BINARY_MATH_OP(op) do { \
-        Value b = pop(); \
-        Value a = pop(); \
-        push(MAKE_VALUE_NUMBER((a.as.number) op (b.as.number))); \
-    } while(false)
+	init_stack_frame(frame);
+	frame->return_address = vm.ip;
+	frame->function = function;
+	frame->base_entity = base_entity;
+	frame->is_entity_base = base_entity != NULL;
+	frame->eval_stack_frame_base_offset = (vm.stack_top - vm.stack) - arg_count;
 
-	#define RUNTIME_ERROR(...) do { \
-		if (!vm.currently_handling_error) { \
-			print_stack_trace(); \
-			fprintf(stdout, __VA_ARGS__); \
-			fprintf(stdout, "\n"); \
-			vm.currently_handling_error = true; \
-		} \
-		runtime_error_occured = true; \
-		is_executing = false; \
-		/* Remember to break manually after using this macro! */ \
-	} while(false)
+	/* Locals other than the parameters are unassigned until the function body sets them */
+	for (int i = arg_count; i < num_local_slots; i++) {
+		push(MAKE_VALUE_UNDEFINED());
+	}
 
-	#define ERROR_IF_WRONG_TYPE(value, value_type, message) do { \
-		if (value.type != value_type	) { \
-			RUNTIME_ERROR(message); \
+	if (self != NULL) {
+		if (bytecode->self_slot >= 0) {
+			vm.stack[frame->eval_stack_frame_base_offset + bytecode->self_slot] = MAKE_VALUE_OBJECT(self);
+		} else {
+			cell_table_set_value(&frame->local_variables, vm.symbols.self, MAKE_VALUE_OBJECT(self));
+		}
+	}
+
+	vm.ip = bytecode->code;
+	return true;
+}
+
+static void report_stack_overflow(void) {
+	if (!vm.currently_handling_error) {
+		print_stack_trace();
+		fprintf(stdout, "Stack overflow\n");
+		vm.currently_handling_error = true;
+	}
+}
+
+#if DEBUG_TRACE_EXECUTION
+static void trace_instruction(void) {
+	DEBUG_TRACE("--------------------------");
+	DEBUG_TRACE("num_objects: %d, allocated memory: %" PRI_SIZET, vm.num_objects, get_allocated_memory());
+
+	disassembler_do_single_instruction(*vm.ip, current_bytecode(), vm.ip - current_bytecode()->code);
+
+	Value* eval_stack = vm.stack;
+	Value* stack_top = vm.stack_top;
+
+	printf("\n");
+	bool stackEmpty = eval_stack == stack_top;
+	if (stackEmpty) {
+		printf("[ -- Empty Stack -- ]");
+	} else {
+		for (Value* value = eval_stack; value < stack_top; value++) {
+			printf("[ ");
+			value_print(*value);
+			printf(" ]");
+		}
+	}
+	printf("\n\nLocal variables:\n");
+	table_print(&locals_or_module_table()->table); // TODO: No encapsulation, fix this
+	printf("\n");
+
+	bytecode_print_constant_table(current_bytecode());
+	printf("\n");
+
+	printf("Call stack:\n");
+	print_call_stack();
+	printf("\n");
+
+	#if DEBUG_MEMORY_EXECUTION
+		printAllObjects();
+	#endif
+}
+#endif
+
+/* Runs the Ribbon frame on top of the call stack until it returns. Calls from it to other Ribbon functions
+   are run by the same loop. */
+static bool vm_interpret_frame(void) {
+	/* The hot interpreter state - instruction pointer, top of the eval stack and the constants of the running code -
+	   lives in locals for the duration of the loop. vm.ip and vm.stack_top are only brought up to date (STORE_FRAME_STATE)
+	   before we leave the loop's control: calls into other functions, the GC and error reporting.
+	   Whatever such a call may have changed is picked up again with LOAD_FRAME_STATE. */
+
+	uint8_t* ip;
+	Value* stack_top;
+	Value* stack_end; /* One past the last value the eval stack can currently hold */
+	Value* constants;
+	Value* slots;
+
+	#define STORE_FRAME_STATE() do { \
+		vm.ip = ip; \
+		vm.stack_top = stack_top; \
+	} while (false)
+
+	#define LOAD_FRAME_STATE() do { \
+		ip = vm.ip; \
+		stack_top = vm.stack_top; \
+		stack_end = vm.stack + vm.stack_capacity; \
+		constants = current_bytecode()->constants.values; \
+		slots = vm.stack + current_frame()->eval_stack_frame_base_offset; \
+	} while (false)
+
+	#define READ_BYTE() (*ip++)
+	#define READ_SHORT() (ip += 2, two_bytes_to_short(ip[-2], ip[-1]))
+	#define READ_CONSTANT() (constants[READ_SHORT()])
+
+	#define PUSH(value) do { \
+		if (stack_top == stack_end) { \
+			/* Growing moves the stack, so everything pointing into it is reloaded */ \
+			vm.stack_top = stack_top; \
+			grow_eval_stack(); \
+			stack_top = vm.stack_top; \
+			stack_end = vm.stack + vm.stack_capacity; \
+			slots = vm.stack + current_frame()->eval_stack_frame_base_offset; \
 		} \
+		*stack_top++ = (value); \
 	} while (false)
+	#define POP() (*--stack_top)
+	#define PEEK_AT(offset) (*(stack_top - (offset)))
+	#define PEEK() PEEK_AT(1)
 
-	#define ERROR_IF_NON_BOOLEAN(value, message) do { \
-		ERROR_IF_WRONG_TYPE(value, VALUE_BOOLEAN, message); \
+	#define BINARY_MATH_OP(op) do { \
+		Value b = POP(); \
+		Value a = POP(); \
+		PUSH(MAKE_VALUE_NUMBER((VALUE_AS_NUMBER(a)) op (VALUE_AS_NUMBER(b)))); \
+	} while(false)
+
+	/* Replaces the two values on top of the stack with their sum. Objects are added through their @add method */
+	#define ADD_TOP_TWO() do { \
+		if (VALUE_IS_OBJECT(PEEK_AT(2))) { \
+			Value subject_val = PEEK_AT(2); /* Leave subject on stack for it to not be GC'd */ \
+\
+			Object* subject = VALUE_AS_OBJECT(subject_val); \
+			STORE_FRAME_STATE(); \
+			ValueArray arguments = collect_values(1); \
+			CallResult call_result = call_method_by_name_leave_on_stack( \
+					subject, vm.symbols.add, arguments); \
+			value_array_free(&arguments); \
+			LOAD_FRAME_STATE(); \
+\
+			if (call_result == CALL_RESULT_NO_SUCH_ATTRIBUTE) { \
+				RUNTIME_ERROR("Object of type %s doesn't support @add method.", object_get_type_name(subject)); \
+			} else if (call_result == CALL_RESULT_INVALID_CALLABLE) { \
+				RUNTIME_ERROR("Objects @add isn't a method."); \
+			} else if (call_result != CALL_RESULT_SUCCESS) { \
+				RUNTIME_ERROR("@add function failed."); \
+			} \
+\
+			Value result = POP(); \
+			POP(); /* The subject */ \
+			PUSH(result); \
+\
+			GC_SAFEPOINT(); \
+		} else if (VALUE_IS_NUMBER(PEEK_AT(2)) && VALUE_IS_NUMBER(PEEK_AT(1))) { \
+			BINARY_MATH_OP(+); \
+		} else { \
+			RUNTIME_ERROR("Attempting to add types which do not support addition."); \
+		} \
 	} while (false)
 
-	#define ERROR_IF_NON_NUMBER(value, message) do { \
-		ERROR_IF_WRONG_TYPE(value, VALUE_NUMBER, message); \
+	/* Pops two values and compares them like value_compare() does, setting compare to -1, 0 or 1 */
+	#define POP_AND_COMPARE(compare, operator_string) do { \
+		Value b = POP(); \
+		Value a = POP(); \
+		if (VALUE_IS_NUMBER(a) && VALUE_IS_NUMBER(b)) { \
+			compare = VALUE_AS_NUMBER(a) == VALUE_AS_NUMBER(b) ? 0 : (VALUE_AS_NUMBER(a) > VALUE_AS_NUMBER(b) ? 1 : -1); \
+		} else if (!value_compare(a, b, &compare)) { \
+			RUNTIME_ERROR("Unable to compare two values " operator_string "."); \
+		} \
 	} while (false)
 
-	#define ERROR_IF_NON_OBJECT(value, message) do { \
-		ERROR_IF_WRONG_TYPE(value, VALUE_OBJECT, message); \
+	/* A comparison fused with the OP_JUMP_IF_FALSE which follows it */
+	#define COMPARE_AND_JUMP_UNLESS(condition, operator_string) do { \
+		uint16_t delta = READ_SHORT(); \
+		int compare = 0; \
+		POP_AND_COMPARE(compare, operator_string); \
+		if (!(condition)) { \
+			ip += delta; \
+		} \
 	} while (false)
 
-	#define ERROR_IF_NOT_NIL(value, message) do { \
-		ERROR_IF_WRONG_TYPE(value, VALUE_NIL, message); \
+	#define RUNTIME_ERROR(...) do { \
+		STORE_FRAME_STATE(); \
+		if (!vm.currently_handling_error) { \
+			print_stack_trace(); \
+			fprintf(stdout, __VA_ARGS__); \
+			fprintf(stdout, "\n"); \
+			vm.currently_handling_error = true; \
+		} \
+		goto runtime_error; \
+	} while(false)
+
+	#define ERROR_IF_NON_BOOLEAN(value, message) do { \
+		if (!VALUE_IS_BOOLEAN(value)) { \
+			RUNTIME_ERROR(message); \
+		} \
 	} while (false)
 
-	bool is_executing = true;
-	bool runtime_error_occured = false;
+	/* Collection is only ever triggered here, between instructions, where every live value is reachable from the roots.
+	   Instructions which may allocate check the threshold once they're done. */
+	#define GC_SAFEPOINT() do { \
+		if (memory_allocated_total >= vm.next_gc) { \
+			STORE_FRAME_STATE(); \
+			gc_at_safepoint(); \
+		} \
+	} while (false)
 
-	if (!push_frame(*frame)) {
-		RUNTIME_ERROR("Stack overflow");
-		stack_frame_free(frame);
-		return false;
-	}
+	#if DEBUG_TRACE_EXECUTION
+		#define TRACE_INSTRUCTION() do { \
+			STORE_FRAME_STATE(); \
+			trace_instruction(); \
+		} while (false)
+	#else
+		#define TRACE_INSTRUCTION() do {} while (false)
+	#endif
+
+	#if GC_STRESS_TEST
+		#define STRESS_GC() do { \
+			STORE_FRAME_STATE(); \
+			gc_stress(); \
+		} while (false)
+	#else
+		#define STRESS_GC() do {} while (false)
+	#endif
+
+	#if DEBUG_PAUSE_AFTER_OPCODES
+		#define PAUSE_AFTER_OPCODE() do { \
+			printf("\nPress ENTER to continue.\n"); \
+			getchar(); \
+		} while (false)
+	#else
+		#define PAUSE_AFTER_OPCODE() do {} while (false)
+	#endif
 
-	vm.ip = current_frame()->function->code->bytecode.code;;
+	#if DEBUG_OPCODE_PAIRS
+		#define COUNT_OPCODE_PAIR() count_opcode_pair(*ip)
+	#else
+		#define COUNT_OPCODE_PAIR() do {} while (false)
+	#endif
+
+	#define BEFORE_INSTRUCTION() do { \
+		PAUSE_AFTER_OPCODE(); \
+		TRACE_INSTRUCTION(); \
+		STRESS_GC(); \
+		COUNT_OPCODE_PAIR(); \
+	} while (false)
+
+	/* With GCC and Clang each instruction jumps straight to the next one through a table of label addresses
+	   (computed goto), which gives the branch predictor one indirect jump per instruction instead of
+	   a single shared one. Other compilers get the portable switch. */
+	#if VM_COMPUTED_GOTO
+		static void* dispatch_table[] = {
+			[OP_CONSTANT] = &&opcode_OP_CONSTANT,
+			[OP_ADD] = &&opcode_OP_ADD,
+			[OP_SUBTRACT] = &&opcode_OP_SUBTRACT,
+			[OP_MULTIPLY] = &&opcode_OP_MULTIPLY,
+			[OP_DIVIDE] = &&opcode_OP_DIVIDE,
+			[OP_MODULO] = &&opcode_OP_MODULO,
+			[OP_NEGATE] = &&opcode_OP_NEGATE,
+			[OP_GREATER_THAN] = &&opcode_OP_GREATER_THAN,
+			[OP_LESS_THAN] = &&opcode_OP_LESS_THAN,
+			[OP_GREATER_EQUAL] = &&opcode_OP_GREATER_EQUAL,
+			[OP_LESS_EQUAL] = &&opcode_OP_LESS_EQUAL,
+			[OP_EQUAL] = &&opcode_OP_EQUAL,
+			[OP_NOT_EQUAL] = &&opcode_OP_NOT_EQUAL,
+			[OP_ACCESS_KEY] = &&opcode_OP_ACCESS_KEY,
+			[OP_SET_KEY] = &&opcode_OP_SET_KEY,
+			[OP_LOAD_VARIABLE] = &&opcode_OP_LOAD_VARIABLE,
+			[OP_SET_VARIABLE] = &&opcode_OP_SET_VARIABLE,
+			[OP_LOAD_LOCAL] = &&opcode_OP_LOAD_LOCAL,
+			[OP_LOAD_UPVALUE] = &&opcode_OP_LOAD_UPVALUE,
+			[OP_SET_LOCAL] = &&opcode_OP_SET_LOCAL,
+			[OP_LOAD_GLOBAL] = &&opcode_OP_LOAD_GLOBAL,
+			[OP_STORE_GLOBAL] = &&opcode_OP_STORE_GLOBAL,
+			[OP_ADD_CONSTANT_TO_LOCAL] = &&opcode_OP_ADD_CONSTANT_TO_LOCAL,
+			[OP_ADD_CONSTANT_TO_GLOBAL] = &&opcode_OP_ADD_CONSTANT_TO_GLOBAL,
+			[OP_CAPTURE_PARAMETER] = &&opcode_OP_CAPTURE_PARAMETER,
+			[OP_DECLARE_EXTERNAL] = &&opcode_OP_DECLARE_EXTERNAL,
+			[OP_MAKE_TABLE] = &&opcode_OP_MAKE_TABLE,
+			[OP_CALL] = &&opcode_OP_CALL,
+			[OP_INVOKE] = &&opcode_OP_INVOKE,
+			[OP_GET_ATTRIBUTE] = &&opcode_OP_GET_ATTRIBUTE,
+			[OP_SET_ATTRIBUTE] = &&opcode_OP_SET_ATTRIBUTE,
+			[OP_POP] = &&opcode_OP_POP,
+			[OP_DUP] = &&opcode_OP_DUP,
+			[OP_DUP_TWO] = &&opcode_OP_DUP_TWO,
+			[OP_SWAP] = &&opcode_OP_SWAP,
+			[OP_SWAP_TOP_WITH_NEXT_TWO] = &&opcode_OP_SWAP_TOP_WITH_NEXT_TWO,
+			[OP_GET_OFFSET_FROM_TOP] = &&opcode_OP_GET_OFFSET_FROM_TOP,
+			[OP_SET_OFFSET_FROM_TOP] = &&opcode_OP_SET_OFFSET_FROM_TOP,
+			[OP_JUMP_IF_FALSE] = &&opcode_OP_JUMP_IF_FALSE,
+			[OP_JUMP_IF_TRUE] = &&opcode_OP_JUMP_IF_TRUE,
+			[OP_JUMP_IF_FALSE_OR_POP] = &&opcode_OP_JUMP_IF_FALSE_OR_POP,
+			[OP_JUMP_IF_TRUE_OR_POP] = &&opcode_OP_JUMP_IF_TRUE_OR_POP,
+			[OP_JUMP_IF_NOT_LESS] = &&opcode_OP_JUMP_IF_NOT_LESS,
+			[OP_JUMP_IF_NOT_GREATER] = &&opcode_OP_JUMP_IF_NOT_GREATER,
+			[OP_JUMP_IF_NOT_LESS_EQUAL] = &&opcode_OP_JUMP_IF_NOT_LESS_EQUAL,
+			[OP_JUMP_IF_NOT_GREATER_EQUAL] = &&opcode_OP_JUMP_IF_NOT_GREATER_EQUAL,
+			[OP_JUMP_IF_NOT_EQUAL] = &&opcode_OP_JUMP_IF_NOT_EQUAL,
+			[OP_JUMP_IF_EQUAL] = &&opcode_OP_JUMP_IF_EQUAL,
+			[OP_JUMP_FORWARD] = &&opcode_OP_JUMP_FORWARD,
+			[OP_JUMP_BACKWARD] = &&opcode_OP_JUMP_BACKWARD,
+			[OP_MAKE_STRING] = &&opcode_OP_MAKE_STRING,
+			[OP_MAKE_FUNCTION] = &&opcode_OP_MAKE_FUNCTION,
+			[OP_MAKE_CLASS] = &&opcode_OP_MAKE_CLASS,
+			[OP_IMPORT] = &&opcode_OP_IMPORT,
+			[OP_NIL] = &&opcode_OP_NIL,
+			[OP_RETURN] = &&opcode_OP_RETURN
+		};
+
+		#define DISPATCH() do { \
+			BEFORE_INSTRUCTION(); \
+			goto *dispatch_table[READ_BYTE()]; \
+		} while (false)
+		#define CASE(opcode) opcode_##opcode
+	#else
+		#define DISPATCH() goto dispatch
+		#define CASE(opcode) case opcode
+	#endif
+
+	bool runtime_error_occured = false;
+	int frames_entered = 0; /* Frames of calls made from this loop, above the one it was started for */
+	int call_arg_count; /* Operand of OP_CALL, also set by OP_INVOKE when it falls back to calling the attribute's value */
+
+	vm.interpreter_depth++;
+	LOAD_FRAME_STATE();
 
 	DEBUG_TRACE("Starting interpreter loop.");
 
-    while (is_executing) {
-		DEBUG_TRACE("--------------------------");
-    	DEBUG_TRACE("num_objects: %d, max_objects: %d", vm.num_objects, vm.max_objects);
+	#if VM_COMPUTED_GOTO
+	DISPATCH();
+	#else
+	dispatch:
+	BEFORE_INSTRUCTION();
+	switch (READ_BYTE())
+	#endif
+	{
+		CASE(OP_CONSTANT): {
+			Value constant = READ_CONSTANT();
+			PUSH(constant);
+			DISPATCH();
+		}
+
+		CASE(OP_ADD): {
+			ADD_TOP_TWO();
+			DISPATCH();
+		}
+
+		CASE(OP_SUBTRACT): {
+			if (!VALUE_IS_NUMBER(PEEK_AT(2)) || !VALUE_IS_NUMBER(PEEK_AT(1))) {
+				RUNTIME_ERROR("Attempting to subtract types which do not support subtraction.");
+			}
+			BINARY_MATH_OP(-);
+			DISPATCH();
+		}
 
-    	OP_CODE opcode = READ_BYTE();
-        
-		#if DEBUG_TRACE_EXECUTION
-			disassembler_do_single_instruction(opcode, current_bytecode(), vm.ip - 1 - current_bytecode()->code);
+		CASE(OP_MULTIPLY): {
+			if (!VALUE_IS_NUMBER(PEEK_AT(2)) || !VALUE_IS_NUMBER(PEEK_AT(1))) {
+				RUNTIME_ERROR("Attempting to multiply types which do not support multiplication.");
+			}
+			BINARY_MATH_OP(*);
+			DISPATCH();
+		}
+
+		CASE(OP_DIVIDE): {
+			if (!VALUE_IS_NUMBER(PEEK_AT(2)) || !VALUE_IS_NUMBER(PEEK_AT(1))) {
+				RUNTIME_ERROR("Attempting to divide types which do not support division.");
+			}
+			BINARY_MATH_OP(/);
+			DISPATCH();
+		}
 
-			Value* eval_stack = vm.stack;
-			Value* stack_top = vm.stack_top;
+		CASE(OP_MODULO): {
+			if (!VALUE_IS_NUMBER(PEEK_AT(2)) || !VALUE_IS_NUMBER(PEEK_AT(1))) {
+				RUNTIME_ERROR("Attempting to perform modulo on types which do not support it.");
+			}
 
-			printf("\n");
-			bool stackEmpty = eval_stack == stack_top;
-			if (stackEmpty) {
-				printf("[ -- Empty Stack -- ]");
+			Value b = POP();
+			Value a = POP();
+
+			if (VALUE_AS_NUMBER(a) < 0 || VALUE_AS_NUMBER(b) < 0) {
+				RUNTIME_ERROR("Modulo with negative numbers not supported.");
+			}
+
+			PUSH(MAKE_VALUE_NUMBER(fmod(VALUE_AS_NUMBER(a), VALUE_AS_NUMBER(b))));
+			DISPATCH();
+		}
+
+		CASE(OP_LESS_THAN): {
+			Value b = POP();
+			Value a = POP();
+
+			int compare = 0;
+			if (!value_compare(a, b, &compare)) {
+				RUNTIME_ERROR("Unable to compare two values <.");
+			}
+			PUSH(MAKE_VALUE_BOOLEAN(compare == -1));
+			DISPATCH();
+		}
+
+		CASE(OP_GREATER_THAN): {
+			Value b = POP();
+			Value a = POP();
+
+			int compare = 0;
+			if (!value_compare(a, b, &compare)) {
+				RUNTIME_ERROR("Unable to compare two values >.");
+			}
+			PUSH(MAKE_VALUE_BOOLEAN(compare == 1));
+			DISPATCH();
+		}
+
+		CASE(OP_LESS_EQUAL): {
+			Value b = POP();
+			Value a = POP();
+
+			int compare = 0;
+			if (!value_compare(a, b, &compare)) {
+				RUNTIME_ERROR("Unable to compare two values <=.");
+			}
+			PUSH(MAKE_VALUE_BOOLEAN(compare == -1 || compare == 0));
+			DISPATCH();
+		}
+
+		CASE(OP_GREATER_EQUAL): {
+			Value b = POP();
+			Value a = POP();
+
+			int compare = 0;
+			if (!value_compare(a, b, &compare)) {
+				RUNTIME_ERROR("Unable to compare two values >=. Types: %d, %d", VALUE_TYPE(a), VALUE_TYPE(b));
+			}
+			PUSH(MAKE_VALUE_BOOLEAN(compare == 1 || compare == 0));
+			DISPATCH();
+		}
+
+		CASE(OP_EQUAL): {
+			Value b = POP();
+			Value a = POP();
+
+			int compare = 0;
+			if (!value_compare(a, b, &compare)) {
+				RUNTIME_ERROR("Unable to compare two values ==.");
+			}
+			PUSH(MAKE_VALUE_BOOLEAN(compare == 0));
+			DISPATCH();
+		}
+
+		CASE(OP_NOT_EQUAL): {
+			int compare = 0;
+			POP_AND_COMPARE(compare, "==");
+			PUSH(MAKE_VALUE_BOOLEAN(compare != 0));
+			DISPATCH();
+		}
+
+		CASE(OP_MAKE_STRING): {
+			Value constant = READ_CONSTANT();
+			assert(object_value_is(constant, OBJECT_STRING));
+			PUSH(constant);
+			DISPATCH();
+		}
+
+		CASE(OP_MAKE_CLASS): {
+			ObjectCode* class_body_code = (ObjectCode*) VALUE_AS_OBJECT(READ_CONSTANT());
+
+			Value superclass_value = PEEK();
+			ObjectClass* superclass;
+			if (VALUE_IS_NIL(superclass_value)) {
+				superclass = NULL;
+			} else if (object_value_is(superclass_value, OBJECT_CLASS)) {
+				superclass = (ObjectClass*) VALUE_AS_OBJECT(superclass_value);
 			} else {
-				for (Value* value = eval_stack; value < stack_top; value++) {
-					printf("[ ");
-					value_print(*value);
-					printf(" ]");
-				}
+				RUNTIME_ERROR("Cannot set non-class value as a superclass.");
 			}
-			printf("\n\nLocal variables:\n");
-			table_print(&locals_or_module_table()->table); // TODO: No encapsulation, fix this
-			printf("\n");
 
-			bytecode_print_constant_table(current_bytecode());
-			printf("\n");
+			STORE_FRAME_STATE();
 
-			printf("Call stack:\n");
-			print_call_stack();
-			printf("\n");
+			ObjectFunction* class_base_function = object_user_function_new(class_body_code);
+			capture_upvalues(class_base_function);
+			class_base_function->module = current_frame()->function->module;
+			object_function_set_name(class_base_function, object_string_copy_from_null_terminated("<Class base function>"));
 
-			#if DEBUG_MEMORY_EXECUTION
-				printAllObjects();
-			#endif
-		#endif
+			ObjectClass* class = object_class_new(class_base_function, superclass, NULL);
 
-		// Possible that vm.num_objects > vm.max_objects if many objects were created during the compiling stage, where GC is disallowed
-		if (vm.num_objects >= vm.max_objects) {
-			vm_gc();
+			ValueArray args;
+			value_array_init(&args);
+			Value throwaway_result;
+			bool class_body_success = call_ribbon_function(class_base_function, NULL, args, (Object*) class, &throwaway_result);
+			value_array_free(&args);
+			LOAD_FRAME_STATE();
+
+			if (!class_body_success) {
+				RUNTIME_ERROR("Error occured when running class initialization code.");
+			}
+
+			POP(); /* Superclass value */
+			PUSH(MAKE_VALUE_OBJECT(class));
+
+			GC_SAFEPOINT();
+			DISPATCH();
 		}
 
-		#if GC_STRESS_TEST
-		vm_gc();
-		#endif
+		CASE(OP_MAKE_FUNCTION): {
+			ObjectCode* object_code = (ObjectCode*) VALUE_AS_OBJECT(READ_CONSTANT());
 
-        switch (opcode) {
-            case OP_CONSTANT: {
-                // int constantIndex = READ_BYTE();
-                // Value constant = current_bytecode()->constants.values[constantIndex];
-				Value constant = READ_CONSTANT();
-                push(constant);
-                break;
-            }
-
-            case OP_ADD: {
-            	if (peek_at(2).type == VALUE_OBJECT) {
-            		Value other = peek_at(1); /* This will be popped later */
-            		Value subject_val = peek_at(2); /* Leave subject on stack for it to not be GC'd */
-
-            		Object* subject = subject_val.as.object;
-            		Value add_method;
-            		if (!object_load_attribute_cstring_key(subject, "@add", &add_method)) {
-            			RUNTIME_ERROR("Object of type %s doesn't support @add method.", object_get_type_name(subject));
-            			break;
-            		}
-
-					if (!object_value_is(add_method, OBJECT_BOUND_METHOD)) {
-						RUNTIME_ERROR("Objects @add isn't a method.");
-						break;
-					}
-
-					ObjectBoundMethod* add_bound_method = (ObjectBoundMethod*) add_method.as.object;
-					Object* self = add_bound_method->self;
-
-					assert(subject == self);
-
-					ValueArray arguments = collect_values(add_bound_method->method->num_params);
-					if (call_bound_method_leave_on_stack(add_bound_method, arguments) != CALL_RESULT_SUCCESS) {
-						RUNTIME_ERROR("@add function failed.");
-						goto op_add_cleanup;
-					}
-
-					op_add_cleanup:
-					value_array_free(&arguments);
-					Value result = pop();
-					pop(); /* The subject */
-					push(result);
-            	} else if (peek_at(2).type == VALUE_NUMBER && peek_at(1).type == VALUE_NUMBER) {
-            		BINARY_MATH_OP(+);
-            	} else {
-					RUNTIME_ERROR("Attempting to add types which do not support addition.");
-				}
-                break;
-            }
-            
-            case OP_SUBTRACT: {
-				if (peek_at(2).type != VALUE_NUMBER || peek_at(1).type != VALUE_NUMBER) {
-					RUNTIME_ERROR("Attempting to subtract types which do not support subtraction.");
-					break;
-				}
-                BINARY_MATH_OP(-);
-                break;
-            }
-            
-            case OP_MULTIPLY: {
-				if (peek_at(2).type != VALUE_NUMBER || peek_at(1).type != VALUE_NUMBER) {
-					RUNTIME_ERROR("Attempting to multiply types which do not support multiplication.");
-					break;
-				}
-                BINARY_MATH_OP(*);
-                break;
-            }
-            
-            case OP_DIVIDE: {
-				if (peek_at(2).type != VALUE_NUMBER || peek_at(1).type != VALUE_NUMBER) {
-					RUNTIME_ERROR("Attempting to divide types which do not support division.");
-					break;
-				}
-                BINARY_MATH_OP(/);
-                break;
-            }
+			ObjectFunction* function = object_user_function_new(object_code);
+			capture_upvalues(function);
+			function->module = current_frame()->function->module;
+			PUSH(MAKE_VALUE_OBJECT(function));
 
-			case OP_MODULO: {
-				if (peek_at(2).type != VALUE_NUMBER || peek_at(1).type != VALUE_NUMBER) {
-					RUNTIME_ERROR("Attempting to perform modulo on types which do not support it.");
-					break;
-				}
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
 
-				Value b = pop();
-				Value a = pop();
+		CASE(OP_MAKE_TABLE): {
+			Table table;
+			table_init(&table);
 
-				if (a.as.number < 0 || b.as.number < 0) {
-					RUNTIME_ERROR("Modulo with negative numbers not supported.");
-					break;
-				}
+			uint8_t num_entries = READ_BYTE();
 
-				push(MAKE_VALUE_NUMBER(fmod(a.as.number, b.as.number)));
-
-                break;
-            }
-
-            case OP_LESS_THAN: {
-        		Value b = pop();
-        		Value a = pop();
-
-        		int compare = 0;
-        		if (!value_compare(a, b, &compare)) {
-        			RUNTIME_ERROR("Unable to compare two values <.");
-        			break;
-        		}
-        		if (compare == -1) {
-        			push(MAKE_VALUE_BOOLEAN(true));
-        		} else {
-        			push(MAKE_VALUE_BOOLEAN(false));
-        		}
-
-            	break;
-            }
-
-            case OP_GREATER_THAN: {
-        		Value b = pop();
-        		Value a = pop();
-
-        		int compare = 0;
-        		if (!value_compare(a, b, &compare)) {
-        			RUNTIME_ERROR("Unable to compare two values >.");
-        			break;
-        		}
-        		if (compare == 1) {
-        			push(MAKE_VALUE_BOOLEAN(true));
-        		} else {
-        			push(MAKE_VALUE_BOOLEAN(false));
-        		}
-
-            	break;
-            }
-
-            case OP_LESS_EQUAL: {
-        		Value b = pop();
-        		Value a = pop();
-
-        		int compare = 0;
-        		if (!value_compare(a, b, &compare)) {
-        			RUNTIME_ERROR("Unable to compare two values <=.");
-        			break;
-        		}
-        		if (compare == -1 || compare == 0) {
-        			push(MAKE_VALUE_BOOLEAN(true));
-        		} else {
-        			push(MAKE_VALUE_BOOLEAN(false));
-        		}
-
-            	break;
-            }
-
-            case OP_GREATER_EQUAL: {
-        		Value b = pop();
-        		Value a = pop();
-
-        		int compare = 0;
-        		if (!value_compare(a, b, &compare)) {
-        			RUNTIME_ERROR("Unable to compare two values >=. Types: %d, %d", a.type, b.type);
-        			break;
-        		}
-        		if (compare == 1 || compare == 0) {
-        			push(MAKE_VALUE_BOOLEAN(true));
-        		} else {
-        			push(MAKE_VALUE_BOOLEAN(false));
-        		}
-
-            	break;
-            }
-
-            case OP_EQUAL: {
-        		Value b = pop();
-        		Value a = pop();
-
-        		int compare = 0;
-        		if (!value_compare(a, b, &compare)) {
-        			RUNTIME_ERROR("Unable to compare two values ==.");
-        			break;
-        		}
-        		if (compare == 0) {
-        			push(MAKE_VALUE_BOOLEAN(true));
-        		} else {
-        			push(MAKE_VALUE_BOOLEAN(false));
-        		}
-
-            	break;
-            }
-
-            case OP_MAKE_STRING: {
-            	Value constant = READ_CONSTANT();
-				assert(object_value_is(constant, OBJECT_STRING));
-            	push(constant);
-            	break;
-            }
-
-			case OP_MAKE_CLASS: {
-				ObjectCode* class_body_code = (ObjectCode*) READ_CONSTANT().as.object;
-				CellTable base_func_free_vars = find_free_vars_for_new_function(class_body_code);
-
-				ObjectFunction* class_base_function = object_user_function_new(class_body_code, NULL, 0, base_func_free_vars);
-				object_function_set_name(class_base_function, copy_null_terminated_cstring("<Class base function>", "Function name"));
-
-				Value superclass_value = peek();
-				ObjectClass* superclass;
-				if (superclass_value.type == VALUE_NIL) {
-					superclass = NULL;
-				} else if (object_value_is(superclass_value, OBJECT_CLASS)) {
-					superclass = (ObjectClass*) superclass_value.as.object;
-				} else {
-					RUNTIME_ERROR("Cannot set non-class value as a superclass.");
-					break;
-				}
+			/* Entries are inserted in source order, so the keys 0, 1, 2... of a list literal go straight into the array part */
+			Value* entries = stack_top - num_entries * 2;
+			for (int i = 0; i < num_entries; i++) {
+				Value value = entries[i * 2];
+				Value key = entries[i * 2 + 1];
+				table_set(&table, key, value);
+			}
+			stack_top = entries;
 
-				ObjectClass* class = object_class_new(class_base_function, superclass, NULL);
+			ObjectTable* table_object = object_table_new(table);
+			PUSH(MAKE_VALUE_OBJECT(table_object));
 
-				ValueArray args;
-				value_array_init(&args);
-				Value throwaway_result;
-				if (!call_ribbon_function(class_base_function, NULL, args, (Object*) class, &throwaway_result)) {
-					RUNTIME_ERROR("Error occured when running class initialization code.");
-					goto op_make_class_cleanup;
-				}
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
 
-				pop(); /* Superclass value */
-				push(MAKE_VALUE_OBJECT(class));
+		CASE(OP_NIL): {
+			PUSH(MAKE_VALUE_NIL());
+			DISPATCH();
+		}
 
-				op_make_class_cleanup:
-				value_array_free(&args);
+		CASE(OP_RETURN): {
+			StackFrame* frame = current_frame();
+
+			Value return_value = POP();
+
+			/* Drop the frame's locals and temporaries, including the arguments it was called with */
+			assert(stack_top - vm.stack >= frame->eval_stack_frame_base_offset);
+			stack_top = vm.stack + frame->eval_stack_frame_base_offset;
+
+			PUSH(return_value);
 
-				break;
+			ip = frame->return_address;
+			STORE_FRAME_STATE();
+
+			if (frames_entered == 0) {
+				/* The frame this loop was started for is popped and freed after the loop */
+				goto frame_finished;
 			}
 
-            case OP_MAKE_FUNCTION: {
-				ObjectCode* object_code = (ObjectCode*) READ_CONSTANT().as.object;
+			frames_entered--;
+			StackFrame finished_frame = pop_frame();
+			stack_frame_free(&finished_frame);
+
+			LOAD_FRAME_STATE();
+			DISPATCH();
+		}
 
-				uint8_t num_params_byte1 = READ_BYTE();
-				uint8_t num_params_byte2 = READ_BYTE();
-				uint16_t num_params = two_bytes_to_short(num_params_byte1, num_params_byte2);
+		CASE(OP_POP): {
+			POP();
+			DISPATCH();
+		}
 
-				ObjectString** params = NULL;
+		CASE(OP_DUP): {
+			Value v = PEEK();
+			PUSH(v);
+			DISPATCH();
+		}
 
-				if (num_params > 0) {
-					/* Build the params array for the created function */
-					params = allocate(sizeof(ObjectString*) * num_params, "Parameters list strings");
-					for (int i = 0; i < num_params; i++) {
-						Value param_value = READ_CONSTANT();
-						assert(object_value_is(param_value, OBJECT_STRING));
-						ObjectString* param_object_string = (ObjectString*) param_value.as.object;
-						params[i] = param_object_string;
-					}
-				}
+		CASE(OP_DUP_TWO): {
+			Value lower = PEEK_AT(2);
+			Value upper = PEEK_AT(1);
+			PUSH(lower);
+			PUSH(upper);
+			DISPATCH();
+		}
+
+		CASE(OP_SWAP): {
+			Value upper = PEEK_AT(1);
+			PEEK_AT(1) = PEEK_AT(2);
+			PEEK_AT(2) = upper;
+			DISPATCH();
+		}
+
+		CASE(OP_SWAP_TOP_WITH_NEXT_TWO): {
+			Value top = POP();
+			Value second = POP();
+			Value third = POP();
+			PUSH(top);
+			PUSH(third);
+			PUSH(second);
+			DISPATCH();
+		}
+
+		CASE(OP_GET_OFFSET_FROM_TOP): {
+			uint16_t offset = READ_SHORT();
+			Value v = PEEK_AT(offset);
+			PUSH(v);
+			DISPATCH();
+		}
+
+		CASE(OP_SET_OFFSET_FROM_TOP): {
+			uint16_t offset = READ_SHORT();
+			Value* target = stack_top - offset; /* Offset is relative to the top before popping the value */
+			*target = POP();
+			DISPATCH();
+		}
 
-				CellTable new_function_free_vars = find_free_vars_for_new_function(object_code);
-				ObjectFunction* function = object_user_function_new(object_code, params, num_params, new_function_free_vars);
-				push(MAKE_VALUE_OBJECT(function));
-				break;
+		CASE(OP_NEGATE): {
+			Value operand = POP();
+			if (VALUE_IS_NUMBER(operand)) {
+				PUSH(MAKE_VALUE_NUMBER(VALUE_AS_NUMBER(operand) * -1));
+			} else if (VALUE_IS_BOOLEAN(operand)) {
+				PUSH(MAKE_VALUE_BOOLEAN(!VALUE_AS_BOOLEAN(operand)));
+			} else {
+				RUNTIME_ERROR("Illegal value to negate.");
 			}
+			DISPATCH();
+		}
 
-            case OP_MAKE_TABLE: {
-            	Table table;
-            	table_init(&table);
+		CASE(OP_LOAD_VARIABLE): {
+			Value name_value = READ_CONSTANT();
+			ASSERT_VALUE_TYPE(name_value, VALUE_OBJECT);
+			ObjectString* name_string = object_as_string(VALUE_AS_OBJECT(name_value));
 
-            	uint8_t num_entries = READ_BYTE();
+			/* May end up calling a descriptor on the module object */
+			STORE_FRAME_STATE();
 
-            	for (int i = 0; i < num_entries; i++) {
-					Value key = pop();
-					Value value = pop();
-					table_set(&table, key, value);
+			Value value;
+			if (!load_variable(name_string, &value)) {
+				RUNTIME_ERROR("Variable %.*s not found.", name_string->length, name_string->chars);
+			}
+
+			LOAD_FRAME_STATE();
+			PUSH(value);
+			DISPATCH();
+		}
+
+		CASE(OP_SET_VARIABLE): {
+			Value name_val = READ_CONSTANT();
+			ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
+			ObjectString* name = OBJECT_AS_STRING(VALUE_AS_OBJECT(name_val));
+
+			Value value = POP();
+
+			if (object_value_is(value, OBJECT_FUNCTION)) {
+				set_function_name(&value, name);
+			}
+			else if (object_value_is(value, OBJECT_CLASS)) {
+				set_class_name(&value, name);
+			}
+
+			cell_table_set_value(locals_or_module_table(), name, value);
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_LOAD_LOCAL): {
+			uint16_t slot = READ_SHORT();
+			Value value = slots[slot];
+
+			if (VALUE_IS_UNDEFINED(value)) {
+				/* Not assigned yet in this call, so the name may still refer to an enclosing or a global variable */
+				ObjectString* name = local_slot_name(current_bytecode(), slot);
+
+				STORE_FRAME_STATE();
+				if (!load_variable(name, &value)) {
+					RUNTIME_ERROR("Variable %.*s not found.", name->length, name->chars);
 				}
+				LOAD_FRAME_STATE();
+			}
+
+			PUSH(value);
+			DISPATCH();
+		}
+
+		CASE(OP_LOAD_UPVALUE): {
+			uint16_t index = READ_SHORT();
+			ObjectCell* cell = current_frame()->function->upvalues[index];
+
+			Value value;
+			if (cell != NULL && cell->is_filled) {
+				value = cell->value;
+			} else {
+				/* Not bound in an enclosing scope (yet), so it's a global or a builtin, if anything */
+				Bytecode* bytecode = current_bytecode();
+				ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(bytecode->constants.values[bytecode->upvalues.values[index].name_index]);
+
+				STORE_FRAME_STATE();
+				if (!load_variable(name, &value)) {
+					RUNTIME_ERROR("Variable %.*s not found.", name->length, name->chars);
+				}
+				LOAD_FRAME_STATE();
+			}
+
+			PUSH(value);
+			DISPATCH();
+		}
+
+		CASE(OP_SET_LOCAL): {
+			uint16_t slot = READ_SHORT();
+			Value value = POP();
+
+			if (object_value_is(value, OBJECT_FUNCTION)) {
+				set_function_name(&value, local_slot_name(current_bytecode(), slot));
+			}
+			else if (object_value_is(value, OBJECT_CLASS)) {
+				set_class_name(&value, local_slot_name(current_bytecode(), slot));
+			}
+
+			slots[slot] = value;
+			DISPATCH();
+		}
+
+		CASE(OP_LOAD_GLOBAL): {
+			Value name_val = READ_CONSTANT();
+			assert(object_value_is(name_val, OBJECT_STRING));
+			ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(name_val);
+			GlobalCache* cache = &current_bytecode()->global_caches[READ_SHORT()];
+
+			ObjectCell* cell = load_global_cell(cache, current_frame()->function->module, name);
+			if (cell == NULL) {
+				RUNTIME_ERROR("Variable %.*s not found.", name->length, name->chars);
+			}
+
+			PUSH(cell->value);
+			DISPATCH();
+		}
 
-            	ObjectTable* table_object = object_table_new(table);
-            	push(MAKE_VALUE_OBJECT(table_object));
+		CASE(OP_STORE_GLOBAL): {
+			Value name_val = READ_CONSTANT();
+			assert(object_value_is(name_val, OBJECT_STRING));
+			ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(name_val);
+			GlobalCache* cache = &current_bytecode()->global_caches[READ_SHORT()];
 
-            	break;
-            }
+			Value value = POP();
 
-            case OP_NIL: {
-            	push(MAKE_VALUE_NIL());
-            	break;
-            }
+			if (object_value_is(value, OBJECT_FUNCTION)) {
+				set_function_name(&value, name);
+			}
+			else if (object_value_is(value, OBJECT_CLASS)) {
+				set_class_name(&value, name);
+			}
+
+			store_global(cache, current_frame()->function->module, name, value);
 
-			case OP_RETURN: {
-                StackFrame* frame = vm_peek_current_frame(); /* Staying on the stack because is popped and freed after interpreter loop */
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_ADD_CONSTANT_TO_LOCAL): {
+			uint16_t slot = READ_SHORT();
+			Value constant = READ_CONSTANT();
+			Value value = slots[slot];
 
-				vm.ip = frame->return_address;
+			if (VALUE_IS_NUMBER(value)) {
+				slots[slot] = MAKE_VALUE_NUMBER(VALUE_AS_NUMBER(value) + VALUE_AS_NUMBER(constant));
+				DISPATCH();
+			}
 
-				Value return_value = pop();
+			/* Anything else is done like the unfused OP_LOAD_LOCAL, OP_CONSTANT, OP_ADD, OP_SET_LOCAL would */
+			if (VALUE_IS_UNDEFINED(value)) {
+				ObjectString* name = local_slot_name(current_bytecode(), slot);
 
-				assert(vm.stack_top - vm.stack >= frame->eval_stack_frame_base_offset);
-				vm.stack_top = vm.stack + frame->eval_stack_frame_base_offset;
+				STORE_FRAME_STATE();
+				if (!load_variable(name, &value)) {
+					RUNTIME_ERROR("Variable %.*s not found.", name->length, name->chars);
+				}
+				LOAD_FRAME_STATE();
+			}
 
-				push(return_value);
+			PUSH(value);
+			PUSH(constant);
+			ADD_TOP_TWO();
+			slots[slot] = POP();
 
-				is_executing = false;
+			DISPATCH();
+		}
 
-                break;
-            }
-            
-            case OP_POP: {
-            	pop();
-            	break;
-            }
+		CASE(OP_ADD_CONSTANT_TO_GLOBAL): {
+			Value name_val = READ_CONSTANT();
+			assert(object_value_is(name_val, OBJECT_STRING));
+			ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(name_val);
+			GlobalCache* cache = &current_bytecode()->global_caches[READ_SHORT()];
+			Value constant = READ_CONSTANT();
 
-			case OP_DUP: {
-				Value v = peek();
-				push(v);
-				break;
+			ObjectCell* cell = load_global_cell(cache, current_frame()->function->module, name);
+			if (cell == NULL) {
+				RUNTIME_ERROR("Variable %.*s not found.", name->length, name->chars);
 			}
 
-			case OP_DUP_TWO: {
-				Value lower = peek_at(2);
-				Value upper = peek_at(1);
-				push(lower);
-				push(upper);
-				break;
+			if (cell == cache->module_cell && VALUE_IS_NUMBER(cell->value)) {
+				cell->value = MAKE_VALUE_NUMBER(VALUE_AS_NUMBER(cell->value) + VALUE_AS_NUMBER(constant));
+				DISPATCH();
 			}
 
-			case OP_SWAP: {
-				Value upper = pop();
-				Value lower = pop();
-				push(upper);
-				push(lower);
-				break;
+			/* Anything else is done like the unfused OP_LOAD_GLOBAL, OP_CONSTANT, OP_ADD, OP_STORE_GLOBAL would */
+			PUSH(cell->value);
+			PUSH(constant);
+			ADD_TOP_TWO();
+			store_global(cache, current_frame()->function->module, name, POP());
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_CAPTURE_PARAMETER): {
+			uint16_t slot = READ_SHORT();
+			ObjectString* name = local_slot_name(current_bytecode(), slot);
+
+			cell_table_set_value(&current_frame()->local_variables, name, slots[slot]);
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_DECLARE_EXTERNAL): {
+			Value name_val = READ_CONSTANT();
+			assert(object_value_is(name_val, OBJECT_STRING));
+			ObjectString* name = (ObjectString*) VALUE_AS_OBJECT(name_val);
+
+			ObjectCell* cell = find_upvalue_cell(current_frame()->function, name);
+			if (cell == NULL) {
+				cell = object_cell_new_empty();
 			}
+			cell_table_set_cell(locals_or_module_table(), name, cell);
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_CALL): {
+			call_arg_count = READ_BYTE();
+
+			call_value_on_top:;
+			int arg_count = call_arg_count;
+			Value callee_value = POP();
 
-			case OP_SWAP_TOP_WITH_NEXT_TWO: {
-				Value top = pop();
-				Value second = pop();
-				Value third = pop();
-				push(top);
-				push(third);
-				push(second);
-				break;
+			if (!VALUE_IS_OBJECT(callee_value)) {
+				RUNTIME_ERROR("Cannot call non object.");
 			}
 
-			case OP_GET_OFFSET_FROM_TOP: {
-				uint8_t byte1 = READ_BYTE();
-            	uint8_t byte2 = READ_BYTE();
-            	uint16_t offset = two_bytes_to_short(byte1, byte2);
-				Value v = peek_at(offset);
-				push(v);
-				break;
+			Object* callee = VALUE_AS_OBJECT(callee_value);
+
+			if (!object_is_callable(callee)) {
+				RUNTIME_ERROR("Cannot call non callable.");
 			}
 
-			case OP_SET_OFFSET_FROM_TOP: {
-				uint8_t byte1 = READ_BYTE();
-            	uint8_t byte2 = READ_BYTE();
-            	uint16_t offset = two_bytes_to_short(byte1, byte2);
-				*(vm.stack_top - offset) = pop();
-				break;
+			ObjectFunction* function = NULL;
+			Object* self = NULL;
+			if (callee->type == OBJECT_FUNCTION) {
+				function = (ObjectFunction*) callee;
+			} else if (callee->type == OBJECT_BOUND_METHOD) {
+				function = ((ObjectBoundMethod*) callee)->method;
+				self = ((ObjectBoundMethod*) callee)->self;
 			}
 
-            case OP_NEGATE: {
-                Value operand = pop();
-                if (operand.type == VALUE_NUMBER) {
-                	push(MAKE_VALUE_NUMBER(operand.as.number * -1));
-                } else if (operand.type == VALUE_BOOLEAN) {
-                	push(MAKE_VALUE_BOOLEAN(!operand.as.boolean));
-                } else {
-                	RUNTIME_ERROR("Illegal value to negate.");
-                }
-                break;
-            }
-            
-            case OP_LOAD_VARIABLE: {
-                Value name_value = READ_CONSTANT();
-                ASSERT_VALUE_TYPE(name_value, VALUE_OBJECT);
-                ObjectString* name_string = object_as_string(name_value.as.object);
-				Value value;
-				if (load_variable(name_string, &value)) {
-					push(value);
-				} else {
-					RUNTIME_ERROR("Variable %.*s not found.", name_string->length, name_string->chars);
+			if (function != NULL && !function->is_native) {
+				/* Calls to Ribbon functions are run by this same loop. The arguments on the stack become the callee's parameters.
+				   The callee object itself is already popped - the frame keeps the function reachable, and self is bound in it. */
+				if (arg_count != function->num_params) {
+					RUNTIME_ERROR("Function %s called with illegal number of arguments.", object_get_callable_name(callee));
 				}
 
-                break;
-            }
-            
-            case OP_SET_VARIABLE: {
-				Value name_val = READ_CONSTANT();
-                ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
-                ObjectString* name = OBJECT_AS_STRING(name_val.as.object);
-
-                Value value = pop();
-
-                if (object_value_is(value, OBJECT_FUNCTION)) {
-                	set_function_name(&value, name);
-                }
-				else if (object_value_is(value, OBJECT_CLASS)) {
-					set_class_name(&value, name);
+				STORE_FRAME_STATE();
+				if (!push_ribbon_frame(function, self, NULL, arg_count)) {
+					RUNTIME_ERROR("Stack overflow");
 				}
+				frames_entered++;
+				LOAD_FRAME_STATE();
 
-                cell_table_set_value(locals_or_module_table(), name, value);
-                break;
-            }
+				DISPATCH();
+			}
 
-			case OP_DECLARE_EXTERNAL: {
-				Value name_val = READ_CONSTANT();
-				assert(object_value_is(name_val, OBJECT_STRING));
-				ObjectString* name = (ObjectString*) name_val.as.object;
+			STORE_FRAME_STATE();
 
-				CellTable* free_vars = &current_frame()->function->free_vars;
-				ObjectCell* cell = NULL;
-				if (!cell_table_get_cell(free_vars, name, &cell)) {
-					cell = object_cell_new_empty();
-				}
-				cell_table_set_cell(locals_or_module_table(), name, cell);
+			ValueArray args = collect_values(arg_count);
+
+			push(callee_value); /* We push the callee so the GC doesn't collect it in any chance */
+
+			CallResult call_result = call_object_leave_on_stack(callee, args);
+			value_array_free(&args);
+
+			LOAD_FRAME_STATE();
+
+			if (call_result == CALL_RESULT_SUCCESS) {
+				Value returnvalue = POP();
+				POP(); /* The callee */
+				PUSH(returnvalue);
 
-				break;
+				GC_SAFEPOINT();
+				DISPATCH();
 			}
-            
-			case OP_CALL: {
-				int arg_count = READ_BYTE();
-				Value callee_value = pop();
 
-				if (callee_value.type != VALUE_OBJECT) {
-					RUNTIME_ERROR("Cannot call non object.");
-					break;
-				}
+			POP(); /* The callee */
 
-				Object* callee = callee_value.as.object;
+			const char* callable_name = object_get_callable_name(callee);
 
-				if (!object_is_callable(callee)) {
-					RUNTIME_ERROR("Cannot call non callable.");
+			switch (call_result) {
+				case CALL_RESULT_SUCCESS: {
+					/* Just to silence the compiler warning */
+					break;
+				}
+				case CALL_RESULT_INVALID_ARGUMENT_COUNT: {
+					RUNTIME_ERROR("Function %s called with illegal number of arguments.", callable_name);
+					break;
+				}
+				case CALL_RESULT_NATIVE_EXECUTION_FAILED: {
+					RUNTIME_ERROR("Native function %s failed.", callable_name);
 					break;
 				}
+				case CALL_RESULT_RIBBON_CODE_EXECUTION_FAILED: {
+					RUNTIME_ERROR("Function %s failed.", callable_name);
+					break;
+				}
+				case CALL_RESULT_CLASS_INIT_NOT_METHOD: {
+					RUNTIME_ERROR("Class @init attribute isn't a method.");
+					break;
+				}
+				case CALL_RESULT_INVALID_CALLABLE: {
+					RUNTIME_ERROR("Cannot invoke non-callable.");
+					break;
+				}
+				case CALL_RESULT_NO_SUCH_ATTRIBUTE: {
+					FAIL("CALL_RESULT_NO_SUCH_ATTRIBUTE should never happen from OP_CALL.");
+					break;
+				}
+			}
 
-				ValueArray args = collect_values(arg_count);
+			FAIL("OP_CALL - shouldn't reach here.");
+		}
 
-				push(callee_value); /* We push the callee so the GC doesn't collect it in any chance */
+		CASE(OP_INVOKE): {
+			ObjectString* name = OBJECT_AS_STRING(VALUE_AS_OBJECT(READ_CONSTANT()));
+			AttributeCache* cache = &current_bytecode()->attribute_caches[READ_SHORT()];
+			int arg_count = READ_BYTE();
 
-				CallResult call_result = call_object_leave_on_stack(callee, args);
-				value_array_free(&args);
+			Value receiver_value = PEEK();
+			if (!VALUE_IS_OBJECT(receiver_value)) {
+				RUNTIME_ERROR("Cannot access attribute on non-object.");
+			}
 
-				if (call_result == CALL_RESULT_SUCCESS) {
-					Value returnvalue = pop();
-					pop(); /* The callee */
-					push(returnvalue);
-					break;
+			Object* receiver = VALUE_AS_OBJECT(receiver_value);
+
+			ObjectFunction* method;
+			if (!object_find_method_cached(receiver, name, cache, &method)) {
+				/* Not a method from the class of the receiver - load the attribute and call its value,
+				   the same as OP_GET_ATTRIBUTE followed by OP_CALL */
+				STORE_FRAME_STATE();
+				Value attr_value;
+				if (!object_load_attribute_cached(receiver, name, cache, &attr_value)) {
+					RUNTIME_ERROR("Cannot find attribute %.*s of object.", name->length, name->chars);
 				}
+				LOAD_FRAME_STATE();
+				PEEK_AT(1) = attr_value;
+
+				call_arg_count = arg_count;
+				goto call_value_on_top;
+			}
+
+			if (arg_count != method->num_params) {
+				RUNTIME_ERROR("Function %s called with illegal number of arguments.", object_function_name(method));
+			}
 
-				pop(); /* The callee */
-
-				char* callable_name = object_get_callable_name(callee);
-				
-				switch (call_result) {
-					case CALL_RESULT_SUCCESS: {
-						/* Just to silence the compiler warning */
-						break;
-					}
-					case CALL_RESULT_INVALID_ARGUMENT_COUNT: {
-						RUNTIME_ERROR("Function %s called with illegal number of arguments.", callable_name);
-						break;
-					}
-					case CALL_RESULT_NATIVE_EXECUTION_FAILED: {
-						RUNTIME_ERROR("Native function %s failed.", callable_name);
-						break;
-					}
-					case CALL_RESULT_RIBBON_CODE_EXECUTION_FAILED: {
-						RUNTIME_ERROR("Function %s failed.", callable_name);
-						break;
-					}
-					case CALL_RESULT_CLASS_INIT_NOT_METHOD: {
-						RUNTIME_ERROR("Class @init attribute isn't a method.");
-						break;
-					}
-					case CALL_RESULT_INVALID_CALLABLE: {
-						RUNTIME_ERROR("Cannot invoke non-callable.");
-						break;
-					}
-					case CALL_RESULT_NO_SUCH_ATTRIBUTE: {
-						FAIL("CALL_RESULT_NO_SUCH_ATTRIBUTE should never happen from OP_CALL.");
-						break;
-					}
+			if (!method->is_native) {
+				POP(); /* The receiver. It stays reachable by being bound as self in the new frame */
+				STORE_FRAME_STATE();
+				if (!push_ribbon_frame(method, receiver, NULL, arg_count)) {
+					RUNTIME_ERROR("Stack overflow");
 				}
+				frames_entered++;
+				LOAD_FRAME_STATE();
 
-				break;
+				DISPATCH();
 			}
 
-            case OP_GET_ATTRIBUTE: {
-				Value name_val = READ_CONSTANT();
-                ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
-                ObjectString* name = OBJECT_AS_STRING(name_val.as.object);
+			/* The arguments lie under the receiver last to first. They stay on the stack to keep them reachable during the call,
+			   and are copied in order to a buffer for the native function, so that the call doesn't allocate anything. */
+			Value args_buffer[INVOKE_ARGS_BUFFER_SIZE];
+			ValueArray args;
+			if (arg_count <= INVOKE_ARGS_BUFFER_SIZE) {
+				args = (ValueArray) {.count = arg_count, .capacity = INVOKE_ARGS_BUFFER_SIZE, .values = args_buffer};
+			} else {
+				value_array_init(&args);
+				args.values = allocate(sizeof(Value) * arg_count, "ValueArray buffer");
+				args.count = args.capacity = arg_count;
+			}
+			for (int i = 0; i < arg_count; i++) {
+				args.values[i] = PEEK_AT(i + 2);
+			}
 
-                Value obj_val = pop();
-                if (obj_val.type != VALUE_OBJECT) {
-                	RUNTIME_ERROR("Cannot access attribute on non-object.");
-                	break;
-                }
+			STORE_FRAME_STATE();
+			Value result;
+			bool success = call_native_function(method, receiver, args, &result);
+			LOAD_FRAME_STATE();
 
-				Value attr_value;
-                if (object_load_attribute(obj_val.as.object, name, &attr_value)) {
-					push(attr_value);
-					break;
-				}
+			if (args.values != args_buffer) {
+				value_array_free(&args);
+			}
+
+			if (!success) {
+				RUNTIME_ERROR("Native function %s failed.", object_function_name(method));
+			}
+
+			stack_top -= arg_count;
+			PEEK_AT(1) = result;
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_GET_ATTRIBUTE): {
+			Value name_val = READ_CONSTANT();
+			ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
+			ObjectString* name = OBJECT_AS_STRING(VALUE_AS_OBJECT(name_val));
+
+			AttributeCache* cache = &current_bytecode()->attribute_caches[READ_SHORT()];
 
+			Value obj_val = PEEK();
+			if (!VALUE_IS_OBJECT(obj_val)) {
+				RUNTIME_ERROR("Cannot access attribute on non-object.");
+			}
+
+			/* The object stays on the stack while the attribute is loaded, as loading may call a descriptor */
+			STORE_FRAME_STATE();
+
+			Value attr_value;
+			if (!object_load_attribute_cached(VALUE_AS_OBJECT(obj_val), name, cache, &attr_value)) {
 				RUNTIME_ERROR("Cannot find attribute %.*s of object.", name->length, name->chars);
-                break;
-            }
-
-            case OP_SET_ATTRIBUTE: {
-                // Value name_val = current_bytecode()->constants.values[READ_BYTE()];
-				Value name_val = READ_CONSTANT();
-                ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
-                ObjectString* name = OBJECT_AS_STRING(name_val.as.object);
-
-                Value obj_value = pop();
-                if (obj_value.type != VALUE_OBJECT) {
-                	RUNTIME_ERROR("Cannot set attribute on non-object.");
-                	break;
-                }
-
-                Object* object = obj_value.as.object;
-                Value attribute_value = pop();
-
-				if (object->type == OBJECT_STRING) {
-					/* We have to treat strings specially because of string caching */
-					RUNTIME_ERROR("Cannot set attribute on strings.");
-					break;
-				}
+			}
 
-                object_set_attribute_cstring_key(object, name->chars, attribute_value);
+			LOAD_FRAME_STATE();
+			PEEK_AT(1) = attr_value;
 
-                break;
-            }
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
 
-            case OP_ACCESS_KEY: {
-            	Value subject_value = pop();
-            	if (subject_value.type != VALUE_OBJECT) {
-					RUNTIME_ERROR("Accessing key on none object. Actual value type: %d", subject_value.type);
-					break;
-            	}
+		CASE(OP_SET_ATTRIBUTE): {
+			Value name_val = READ_CONSTANT();
+			ASSERT_VALUE_TYPE(name_val, VALUE_OBJECT);
+			ObjectString* name = OBJECT_AS_STRING(VALUE_AS_OBJECT(name_val));
 
-            	Object* subject = subject_value.as.object;
-				Value key = pop();
-				push(subject_value);
-				push(key);
+			AttributeCache* cache = &current_bytecode()->attribute_caches[READ_SHORT()];
 
-				Value key_access_method_value;
-				if (!object_load_attribute_cstring_key(subject, "@get_key", &key_access_method_value)) {
-					RUNTIME_ERROR("Object doesn't support @get_key method.");
-					break;
-				}
+			Value obj_value = PEEK_AT(1);
+			if (!VALUE_IS_OBJECT(obj_value)) {
+				RUNTIME_ERROR("Cannot set attribute on non-object.");
+			}
 
-				if (!object_value_is(key_access_method_value, OBJECT_BOUND_METHOD)) {
-					RUNTIME_ERROR("Object's @get_key isn't a method.");
-					break;
-				}
+			Object* object = VALUE_AS_OBJECT(obj_value);
+			Value attribute_value = PEEK_AT(2);
 
-				ObjectBoundMethod* bound_method = (ObjectBoundMethod*) key_access_method_value.as.object;
-				Object* self = bound_method->self;
+			if (object->type == OBJECT_STRING) {
+				/* We have to treat strings specially because of string caching */
+				RUNTIME_ERROR("Cannot set attribute on strings.");
+			}
 
-				assert(subject == self);
-				assert(bound_method->method->num_params == 1);
+			/* Both operands stay on the stack until the store is done, as setting may call a descriptor */
+			STORE_FRAME_STATE();
+			object_set_attribute_cached(object, name, attribute_value, cache);
+			LOAD_FRAME_STATE();
 
-				ValueArray arguments = collect_values(bound_method->method->num_params);
-				if (call_bound_method_leave_on_stack(bound_method, arguments) != CALL_RESULT_SUCCESS) {
-					RUNTIME_ERROR("@get_key function failed.");
-					goto op_access_key_cleanup;
-				}
+			POP(); /* The object */
+			POP(); /* The value */
 
-				Value result = pop();
-				pop(); /* The subject */
-				push(result);
-
-				op_access_key_cleanup:
-				value_array_free(&arguments);				
-
-            	break;
-            }
-
-            case OP_SET_KEY: {
-            	Value subject_as_value = peek_at(1);
-            	Value key = peek_at(2);
-            	Value value = peek_at(3);
-
-            	if (subject_as_value.type != VALUE_OBJECT) {
-            		RUNTIME_ERROR("Cannot set key on non-object.");
-            		break;
-            	}
-
-            	Object* subject = subject_as_value.as.object;
-
-            	ObjectBoundMethod* set_method = NULL;
-            	MethodAccessResult access_result = -1;
-            	if ((access_result = object_get_method(subject, "@set_key", &set_method)) == METHOD_ACCESS_SUCCESS) {
-					Object* self = set_method->self;
-
-					assert(subject == self);
-
-    				ValueArray arguments;
-    				value_array_init(&arguments);
-    				value_array_write(&arguments, &key);
-    				value_array_write(&arguments, &value);
-
-    				Value throwaway_result;
-					if (call_bound_method_leave_on_stack(set_method, arguments) != CALL_RESULT_SUCCESS) {
-						RUNTIME_ERROR("@set_key function failed.");
-						goto op_access_key_cleanup;
-					}
-
-					pop(); /* The result, doesn't matter to us */
-					pop(); /* The subject */
-					pop(); /* The key */
-					pop(); /* The value */
-
-    				op_set_key_cleanup:
-    				value_array_free(&arguments);
-            	} else if (access_result == METHOD_ACCESS_NO_SUCH_ATTR) {
-            		RUNTIME_ERROR("Object doesn't support @set_key method.");
-            		break;
-            	} else if (access_result == METHOD_ACCESS_ATTR_NOT_BOUND_METHOD) {
-            		RUNTIME_ERROR("Object's @set_key isn't a bound method.");
-            		break;
-            	} else {
-            		FAIL("Illegal value for access_result: %d", access_result);
-            	}
-
-            	break;
-            }
-
-            case OP_JUMP_IF_FALSE: {
-            	uint8_t addr_byte1 = READ_BYTE();
-            	uint8_t addr_byte2 = READ_BYTE();
-            	uint16_t delta = two_bytes_to_short(addr_byte1, addr_byte2);
-				Value condition = pop();
-
-				ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
-
-				if (!condition.as.boolean) {
-					vm.ip += delta;
-				}
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
 
-				break;
+		CASE(OP_ACCESS_KEY): {
+			Value subject_value = PEEK_AT(1);
+			if (!VALUE_IS_OBJECT(subject_value)) {
+				RUNTIME_ERROR("Accessing key on none object. Actual value type: %d", VALUE_TYPE(subject_value));
 			}
 
-			case OP_JUMP_IF_TRUE: {
-            	uint8_t addr_byte1 = READ_BYTE();
-            	uint8_t addr_byte2 = READ_BYTE();
-            	uint16_t delta = two_bytes_to_short(addr_byte1, addr_byte2);
-				Value condition = pop();
+			Object* subject = VALUE_AS_OBJECT(subject_value);
 
-				ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
+			/* Reorder to [subject, key] so the subject stays reachable during the call */
+			PEEK_AT(1) = PEEK_AT(2);
+			PEEK_AT(2) = subject_value;
 
-				if (condition.as.boolean) {
-					vm.ip += delta;
-				}
+			STORE_FRAME_STATE();
+
+			ValueArray arguments = collect_values(1);
+			CallResult call_result = call_method_by_name_leave_on_stack(
+					subject, vm.symbols.get_key, arguments);
+			value_array_free(&arguments);
+			LOAD_FRAME_STATE();
+
+			if (call_result == CALL_RESULT_NO_SUCH_ATTRIBUTE) {
+				RUNTIME_ERROR("Object doesn't support @get_key method.");
+			} else if (call_result == CALL_RESULT_INVALID_CALLABLE) {
+				RUNTIME_ERROR("Object's @get_key isn't a method.");
+			} else if (call_result != CALL_RESULT_SUCCESS) {
+				RUNTIME_ERROR("@get_key function failed.");
+			}
+
+			Value result = POP();
+			POP(); /* The subject */
+			PUSH(result);
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_SET_KEY): {
+			Value subject_as_value = PEEK_AT(1);
+			Value key = PEEK_AT(2);
+			Value value = PEEK_AT(3);
+
+			if (!VALUE_IS_OBJECT(subject_as_value)) {
+				RUNTIME_ERROR("Cannot set key on non-object.");
+			}
+
+			Object* subject = VALUE_AS_OBJECT(subject_as_value);
+
+			STORE_FRAME_STATE();
 
-				break;
+			ValueArray arguments;
+			value_array_init(&arguments);
+			value_array_write(&arguments, &key);
+			value_array_write(&arguments, &value);
+
+			CallResult call_result = call_method_by_name_leave_on_stack(
+					subject, vm.symbols.set_key, arguments);
+			value_array_free(&arguments);
+			LOAD_FRAME_STATE();
+
+			if (call_result == CALL_RESULT_NO_SUCH_ATTRIBUTE) {
+				RUNTIME_ERROR("Object doesn't support @set_key method.");
+			} else if (call_result == CALL_RESULT_INVALID_CALLABLE) {
+				RUNTIME_ERROR("Object's @set_key isn't a bound method.");
+			} else if (call_result != CALL_RESULT_SUCCESS) {
+				RUNTIME_ERROR("@set_key function failed.");
+			}
+
+			POP(); /* The result, doesn't matter to us */
+			POP(); /* The subject */
+			POP(); /* The key */
+			POP(); /* The value */
+
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_FALSE): {
+			uint16_t delta = READ_SHORT();
+			Value condition = POP();
+
+			ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
+
+			if (!VALUE_AS_BOOLEAN(condition)) {
+				ip += delta;
+			}
+
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_TRUE): {
+			uint16_t delta = READ_SHORT();
+			Value condition = POP();
+
+			ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
+
+			if (VALUE_AS_BOOLEAN(condition)) {
+				ip += delta;
+			}
+
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_FALSE_OR_POP): {
+			uint16_t delta = READ_SHORT();
+			Value condition = PEEK();
+
+			ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
+
+			if (VALUE_AS_BOOLEAN(condition)) {
+				POP();
+			} else {
+				ip += delta;
+			}
+
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_TRUE_OR_POP): {
+			uint16_t delta = READ_SHORT();
+			Value condition = PEEK();
+
+			ERROR_IF_NON_BOOLEAN(condition, "Expected boolean as condition");
+
+			if (VALUE_AS_BOOLEAN(condition)) {
+				ip += delta;
+			} else {
+				POP();
 			}
 
-            case OP_JUMP_FORWARD: {
-            	uint8_t addr_byte1 = READ_BYTE();
-            	uint8_t addr_byte2 = READ_BYTE();
-            	uint16_t delta = two_bytes_to_short(addr_byte1, addr_byte2);
-
-            	vm.ip += delta;
-
-            	break;
-            }
-
-			case OP_JUMP_BACKWARD: {
-            	uint8_t addr_byte1 = READ_BYTE();
-            	uint8_t addr_byte2 = READ_BYTE();
-            	uint16_t delta = two_bytes_to_short(addr_byte1, addr_byte2);
-
-            	vm.ip -= delta;
-
-            	break;
-            }
-
-			case OP_IMPORT: {
-				ObjectString* module_name = (ObjectString*) READ_CONSTANT().as.object;
-				ImportResult import_result = vm_import_module(module_name);
-
-				switch (import_result) {
-					case IMPORT_RESULT_SUCCESS: {
-						break;
-					}
-					case IMPORT_RESULT_OPEN_FAILED: {
-						RUNTIME_ERROR("Couldn't open module %.*s.", module_name->length, module_name->chars);
-						break;
-					}
-					case IMPORT_RESULT_READ_FAILED: {
-						RUNTIME_ERROR("Couldn't read module %.*s.", module_name->length, module_name->chars);
-						break;
-					}
-					case IMPORT_RESULT_CLOSE_FAILED: {
-						RUNTIME_ERROR("Couldn't close module %.*s.", module_name->length, module_name->chars);
-						break;
-					}
-					case IMPORT_RESULT_EXTENSION_NO_INIT_FUNCTION: {
-						RUNTIME_ERROR("Extension module %.*s doesn't export an init function.", module_name->length, module_name->chars);
-						break;
-					}
-					case IMPORT_RESULT_MODULE_NOT_FOUND: {
-						RUNTIME_ERROR("Couldn't find module %.*s.", module_name->length, module_name->chars);
-						break;
-					}
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_NOT_LESS): {
+			COMPARE_AND_JUMP_UNLESS(compare == -1, "<");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_NOT_GREATER): {
+			COMPARE_AND_JUMP_UNLESS(compare == 1, ">");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_NOT_LESS_EQUAL): {
+			COMPARE_AND_JUMP_UNLESS(compare == -1 || compare == 0, "<=");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_NOT_GREATER_EQUAL): {
+			COMPARE_AND_JUMP_UNLESS(compare == 1 || compare == 0, ">=");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_NOT_EQUAL): {
+			COMPARE_AND_JUMP_UNLESS(compare == 0, "==");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_IF_EQUAL): {
+			COMPARE_AND_JUMP_UNLESS(compare != 0, "==");
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_FORWARD): {
+			uint16_t delta = READ_SHORT();
+			ip += delta;
+			DISPATCH();
+		}
+
+		CASE(OP_JUMP_BACKWARD): {
+			uint16_t delta = READ_SHORT();
+			ip -= delta;
+
+			/* Every loop goes through here, so allocations made by loop bodies can't pile up indefinitely */
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
+
+		CASE(OP_IMPORT): {
+			ObjectString* module_name = (ObjectString*) VALUE_AS_OBJECT(READ_CONSTANT());
+
+			STORE_FRAME_STATE();
+			ImportResult import_result = vm_import_module(module_name);
+			LOAD_FRAME_STATE();
+
+			switch (import_result) {
+				case IMPORT_RESULT_SUCCESS: {
+					break;
+				}
+				case IMPORT_RESULT_OPEN_FAILED: {
+					RUNTIME_ERROR("Couldn't open module %.*s.", module_name->length, module_name->chars);
+					break;
+				}
+				case IMPORT_RESULT_READ_FAILED: {
+					RUNTIME_ERROR("Couldn't read module %.*s.", module_name->length, module_name->chars);
+					break;
+				}
+				case IMPORT_RESULT_CLOSE_FAILED: {
+					RUNTIME_ERROR("Couldn't close module %.*s.", module_name->length, module_name->chars);
+					break;
+				}
+				case IMPORT_RESULT_EXTENSION_NO_INIT_FUNCTION: {
+					RUNTIME_ERROR("Extension module %.*s doesn't export an init function.", module_name->length, module_name->chars);
+					break;
+				}
+				case IMPORT_RESULT_MODULE_NOT_FOUND: {
+					RUNTIME_ERROR("Couldn't find module %.*s.", module_name->length, module_name->chars);
+					break;
 				}
-				
-				break;
 			}
 
-            default: {
-            	FAIL("Unknown opcode: %d. At ip: %p", opcode, vm.ip - 1);
-            }
-        }
+			GC_SAFEPOINT();
+			DISPATCH();
+		}
 
-		#if DEBUG_PAUSE_AFTER_OPCODES
-			printf("\nPress ENTER to continue.\n");
-			getchar();
+		#if !VM_COMPUTED_GOTO
+		default: {
+			FAIL("Unknown opcode: %d. At ip: %p", ip[-1], ip - 1);
+		}
 		#endif
-    }
+	}
 
-	StackFrame finished_frame = pop_frame();
-	stack_frame_free(&finished_frame);
+	runtime_error:
+	runtime_error_occured = true;
 
-    DEBUG_TRACE("\n--------------------------\n");
-	DEBUG_TRACE("Ended interpreter loop.");
+	for (; frames_entered > 0; frames_entered--) {
+		StackFrame failed_frame = pop_frame();
+		stack_frame_free(&failed_frame);
+	}
+
+	frame_finished:
+	{
+		StackFrame finished_frame = pop_frame();
+		stack_frame_free(&finished_frame);
+	}
 
-    #undef BINARY_MATH_OP
+	vm.interpreter_depth--;
 
-    return !runtime_error_occured;
+	DEBUG_TRACE("\n--------------------------\n");
+	DEBUG_TRACE("Ended interpreter loop.");
+
+	#undef STORE_FRAME_STATE
+	#undef LOAD_FRAME_STATE
+	#undef READ_BYTE
+	#undef READ_SHORT
+	#undef READ_CONSTANT
+	#undef PUSH
+	#undef POP
+	#undef PEEK_AT
+	#undef PEEK
+	#undef BINARY_MATH_OP
+	#undef RUNTIME_ERROR
+	#undef ERROR_IF_WRONG_TYPE
+	#undef ERROR_IF_NON_BOOLEAN
+	#undef GC_SAFEPOINT
+	#undef TRACE_INSTRUCTION
+	#undef STRESS_GC
+	#undef PAUSE_AFTER_OPCODE
+	#undef BEFORE_INSTRUCTION
+	#undef DISPATCH
+	#undef CASE
+
+	return !runtime_error_occured;
 }
 
 static bool call_ribbon_function_leave_on_stack(
 		ObjectFunction* function, Object* self, ValueArray args, Object* base_entity) {
-	bool is_entity_base = base_entity != NULL;
-	StackFrame frame = new_stack_frame(vm.ip, function, base_entity, is_entity_base, false);
-
 	assert(args.count == function->num_params);
 
-	for (int i = 0; i < function->num_params; i++) {
-		ObjectString* param_name = function->parameters[i];
-		Value argument = args.values[i];
-		cell_table_set_value(&frame.local_variables, param_name, argument);
+	/* Lay out the arguments the same way a compiled call does - last to first */
+	for (int i = args.count - 1; i >= 0; i--) {
+		push(args.values[i]);
 	}
 
-	if (self != NULL) {
-		cell_table_set_value_cstring_key(&frame.local_variables, "self", MAKE_VALUE_OBJECT(self));
+	if (vm.interpreter_depth == INTERPRETER_REENTRY_MAX || !push_ribbon_frame(function, self, base_entity, args.count)) {
+		vm.stack_top -= args.count;
+		report_stack_overflow();
+		return false;
 	}
 
-	if (vm_interpret_frame(&frame)) {
-		return true;
-	}
-	return false;
+	return vm_interpret_frame();
 }
 
 static bool call_ribbon_function(
@@ -1993,8 +3079,8 @@ static ObjectString* get_base_module_name(char* main_module_path) {
 bool vm_interpret_program(Bytecode* bytecode, char* main_module_path) {
 	vm.main_module_path = main_module_path;
 
-	ObjectCode* code = object_code_new(*bytecode);
-	ObjectFunction* base_function = object_user_function_new(code, NULL, 0, cell_table_new_empty());
+	ObjectCode* code = object_code_new(*bytecode, NULL, 0);
+	ObjectFunction* base_function = object_user_function_new(code);
 
 	/* We want to run the GC before starting the program in order to clear objects created
 	   during compilation and get a fresh start.
@@ -2014,17 +3100,15 @@ bool vm_interpret_program(Bytecode* bytecode, char* main_module_path) {
 	pop();
 
 	ObjectString* base_module_name = get_base_module_name(main_module_path);
-	object_function_set_name(base_function, copy_cstring("<main>", strlen("<main>"), "Object string buffer"));
+	object_function_set_name(base_function, object_string_copy_from_null_terminated("<main>"));
 
 	ObjectModule* module = object_module_new(base_module_name, base_function);
 	cell_table_set_value(&vm.imported_modules, base_module_name, MAKE_VALUE_OBJECT(module));
 
 	assert(vm.stack_top - vm.stack == 0);
-	StackFrame base_frame = new_stack_frame(NULL, base_function, (Object*) module, true, false);
+	push_ribbon_frame(base_function, NULL, (Object*) module, 0);
 
 	DEBUG_TRACE("Starting interpreter loop.");
-	return vm_interpret_frame(&base_frame);
+	return vm_interpret_frame();
 }
 
-#undef READ_BYTE
-#undef READ_CONSTANT
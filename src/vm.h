@@ -4,6 +4,7 @@
 #include "bytecode.h"
 #include "table.h"
 #include "cell_table.h"
+#include "string_cache.h"
 #include "ribbon_object.h"
 #include "value.h"
 
@@ -26,16 +27,49 @@ typedef enum {
     IMPORT_RESULT_MODULE_NOT_FOUND
 } ImportResult;
 
-#define CALL_STACK_MAX 255
-#define EVAL_STACK_MAX (CALL_STACK_MAX * 5)
+/* The eval and call stacks grow on demand, up to vm.max_call_depth frames. Unlike those, the interpreter loop itself
+   can only nest this deep, since every nesting costs C stack */
+#define INTERPRETER_REENTRY_MAX 255 /* Nesting of the interpreter loop through native code, which costs C stack */
 
 typedef struct {
-	Object* objects;
+    int minor_collections;
+    int full_collections;
+    double minor_pause_total; /* Pauses are in milliseconds */
+    double minor_pause_max;
+    double full_pause_total;
+    double full_pause_max;
+    double full_mark_total; /* The part of the full pauses spent marking */
+    size_t young_objects; /* Young objects which minor collections looked at */
+    size_t promoted_objects; /* Young objects which survived a minor collection, and became old */
+    int emergency_collections; /* Full collections forced by the soft memory limit, also counted in full_collections */
+    int incremental_collections;
+    int incremental_steps;
+    double incremental_pause_total;
+    double incremental_pause_max;
+} GcStats;
+
+/* Names the runtime itself looks up, interned once in vm_init and kept alive as GC roots.
+   Looking them up with these doesn't hash and intern a C string every time. Extensions get them through RibbonApi. */
+typedef struct {
+    ObjectString* self;
+    ObjectString* init; /* @init */
+    ObjectString* add; /* @add */
+    ObjectString* get_key; /* @get_key */
+    ObjectString* set_key; /* @set_key */
+    ObjectString* get; /* @get, of descriptors */
+    ObjectString* set; /* @set, of descriptors */
+    ObjectString* length;
+} Symbols;
 
-    Value stack[EVAL_STACK_MAX];
+typedef struct {
+    Value* stack;
     Value* stack_top;
-    StackFrame call_stack[CALL_STACK_MAX];
+    size_t stack_capacity;
+    StackFrame* call_stack;
     StackFrame* call_stack_top;
+    size_t call_stack_capacity;
+    int interpreter_depth;
+    size_t max_call_depth; /* Calls past this many frames fail with a stack overflow. 0 for no limit */
 
     uint8_t* ip;
 
@@ -44,10 +78,26 @@ typedef struct {
     CellTable builtin_modules;
 
     int num_objects;
-    int max_objects;
+    size_t next_gc; /* The next collection runs once memory_allocated_total reaches this */
+    size_t gc_threshold; /* A full collection runs once the allocated memory reaches this */
+    size_t gc_live_memory; /* The allocated memory right after the last full collection */
     bool allow_gc;
+    GcStats gc_stats;
+    bool gc_incremental; /* Collect the old generation incrementally, rather than in a single pause */
+    double gc_pause_target; /* Milliseconds each step of an incremental collection aims to take */
+    double gc_growth_factor; /* How many times gc_live_memory the heap grows to before the next full collection */
+    size_t gc_min_heap; /* No full collection runs before the allocated memory reaches this */
+    size_t gc_soft_limit; /* Past this, full collections stop the world to bring the memory down. 0 for no limit */
+    int gc_threads; /* Threads which mark and sweep in full collections, from 1 to THREADS_MAX */
+
+    StringCache string_cache;
+
+    Symbols symbols;
 
-    Table string_cache;
+    /* Hold the methods shared by all strings and tables */
+    ObjectClass* string_class;
+    ObjectClass* table_class;
+    ObjectClass* descriptor_class; /* Instances of it found as attributes are called to get and set the attribute */
 
     /* Used as roots for locating different modules during imports, etc. */
     char* main_module_path;
@@ -77,8 +127,14 @@ Object* vm_pop_object(void);
 
 StackFrame* vm_peek_current_frame(void);
 StackFrame* vm_peek_previous_frame(void);
+bool vm_get_frame_self(StackFrame* frame, Value* out);
 
 void vm_gc(void);
+void vm_minor_gc(void);
+void vm_start_incremental_gc(void);
+bool vm_incremental_gc_in_progress(void);
+void vm_update_gc_threshold(void);
+void vm_print_gc_stats(void);
 
 void vm_init(void);
 void vm_free(void);